@@ -29,6 +29,8 @@ class AbstractStateMatrix {
  public:
   AbstractStateMatrix(std::string matrixfile);
 
+  virtual ~AbstractStateMatrix() {}
+
   // Return substitution score s(a,b) of context k and abstract state s.
   double s(size_t k, size_t s) const { return s_[k][s]; }
 
@@ -25,6 +25,10 @@
 #include "blast_hits.h"
 #include "sequence-inl.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace cs {
 
 template<class Abc>
@@ -59,27 +63,85 @@ Alignment<Abc>::Alignment(const Sequence<Abc>& seq) {
 
 template<class Abc>
 Alignment<Abc>::Alignment(const BlastHits& hits, bool best) {
-    std::vector<std::string> headers;
-    std::vector<std::string> seqs;
+    AppendHsps(hits, best, std::vector<bool>(hits.size(), true));
+}
 
-    typedef typename BlastHits::ConstHitIter HitIter;
-    typedef typename BlastHits::ConstHspIter HspIter;
-    for (HitIter hit = hits.begin(); hit != hits.end(); ++hit) {
-        for (HspIter hsp = hit->hsps.begin(); hsp != hit->hsps.end(); ++hsp) {
-            // Construct query anchored alignment string
-            std::string seq(hsp->query_start - 1, '-');
-            for (size_t i =  0; i < hsp->length; ++i)
-                if (hsp->query_seq[i] != '-')
-                    seq += hsp->subject_seq[i];
-            seq.append(hits.query_length() - seq.length(), '-');
-
-            headers.push_back(hit->definition);
-            seqs.push_back(seq);
+template<class Abc>
+bool Alignment<Abc>::AssignHsp(Matrix<uint8_t>& seqs, size_t k, const BlastHsp& hsp) {
+    const size_t ncol = seqs.nrows();
+    const size_t start = MIN(ncol, static_cast<size_t>(MAX(1, hsp.query_start)) - 1);
+    bool valid = true;
+    size_t i = 0;
+    for (; i < start; ++i) seqs[i][k] = Abc::kEndGap;
+    for (size_t c = 0; c < hsp.length && i < ncol; ++c) {
+        if (hsp.query_seq[c] == '-') continue;
+        const int s = hsp.subject_seq[c];
+        if (Abc::kValidChar[s] || s == '-' || s == '.')
+            seqs[i][k] = Abc::kCharToInt[s];
+        else
+            valid = false;
+        ++i;
+    }
+    const size_t end = i;
+    for (; i < ncol; ++i) seqs[i][k] = Abc::kEndGap;
+
+    // Gaps at either end of the HSP are end gaps too
+    for (i = start; i < end && seqs[i][k] == Abc::kGap; ++i)
+        seqs[i][k] = Abc::kEndGap;
+    for (i = end; i > start && seqs[i - 1][k] == Abc::kGap; --i)
+        seqs[i - 1][k] = Abc::kEndGap;
+    return valid;
+}
 
-            if (best) break;
+template<class Abc>
+void Alignment<Abc>::AppendHsps(const BlastHits& hits, bool best,
+                                const std::vector<bool>& include) {
+    // Sequence index of the first HSP of each included hit
+    std::vector<size_t> first(hits.size() + 1, 0);
+    for (size_t h = 0; h < hits.size(); ++h) {
+        const size_t nhsps = include[h] ? hits[h].hsps.size() : 0;
+        first[h + 1] = first[h] + (best && nhsps > 1 ? 1 : nhsps);
+    }
+    const size_t nold = headers_.size();
+    const size_t nnew = first.back();
+    const size_t ncol = nold > 0 ? ncols() : hits.query_length();
+    if (nold + nnew == 0 || ncol == 0)
+        throw Exception("Bad alignment dimensions: nseqs=%i ncols=%i", nold + nnew, ncol);
+
+    // Copy existing sequences into grown matrix column by column
+    Matrix<uint8_t> seqs_merged(ncol, nold + nnew);
+    if (nold > 0)
+        for (size_t i = 0; i < ncol; ++i)
+            memcpy(seqs_merged[i], seqs_[i], nold);
+
+    // Write HSPs straight into their sequences
+    std::vector<std::string> headers_merged(headers_);
+    headers_merged.resize(nold + nnew);
+    std::vector<uint8_t> valid(nnew, 1);
+    const int nhits = hits.size();
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int h = 0; h < nhits; ++h) {
+        for (size_t k = first[h]; k < first[h + 1]; ++k) {
+            headers_merged[nold + k] = hits[h].definition;
+            valid[k] = AssignHsp(seqs_merged, nold + k, hits[h].hsps[k - first[h]]);
         }
     }
-    Init(headers, seqs);
+    for (size_t k = 0; k < nnew; ++k)
+        if (!valid[k])
+            throw Exception("Invalid character in HSP of sequence '%s'",
+                            headers_merged[nold + k].c_str());
+
+    if (nold == 0) {
+        col_idx_.resize(ncol);
+        is_match_.resize(ncol);
+        for (size_t i = 0; i < ncol; ++i) {
+            col_idx_[i] = i;
+            is_match_[i] = true;
+        }
+    }
+    headers_.swap(headers_merged);
+    seqs_.Swap(seqs_merged);
+    if (nold == 0) SetMatchIndices();
 }
 
 template<class Abc>
@@ -481,8 +543,7 @@ void Alignment<Abc>::AssignMatchColumnsBySequence(size_t k) {
                 ++j;
             }
         }
-        seqs_.Resize(ref_seq_length, nseqs());
-        seqs_ = new_seqs;
+        seqs_.Swap(new_seqs);
 
         // Update match indices
         col_idx_.resize(ref_seq_length);
@@ -539,8 +600,7 @@ void Alignment<Abc>::RemoveInsertColumns() {
             new_seqs[i][k] = seqs_[match_idx_[i]][k];
         }
     }
-    seqs_.Resize(match_cols, nseqs());
-    seqs_ = new_seqs;
+    seqs_.Swap(new_seqs);
 
     // Update match indices
     col_idx_.resize(match_cols);
@@ -563,8 +623,9 @@ void Alignment<Abc>::Merge(const Alignment<Abc>& ali) {
     // alignment.
     Vector<bool> include_seq(ali.nseqs(), false);
     std::vector<std::string> headers_merged(headers_);
+    const std::unordered_set<std::string> known(headers_.begin(), headers_.end());
     for (size_t k = 0; k < ali.nseqs(); ++k) {
-        if (find(headers_.begin(), headers_.end(), ali.header(k)) == headers_.end()) {
+        if (known.find(ali.header(k)) == known.end()) {
             include_seq[k] = true;
             headers_merged.push_back(ali.header(k));
         }
@@ -586,8 +647,200 @@ void Alignment<Abc>::Merge(const Alignment<Abc>& ali) {
     }
 
     // Apply the merging
-    headers_ = headers_merged;
-    seqs_    = seqs_merged;
+    headers_.swap(headers_merged);
+    seqs_.Swap(seqs_merged);
+}
+
+template<class Abc>
+void Alignment<Abc>::Merge(const BlastHits& hits, bool best) {
+    if (nmatch() != hits.query_length()) return;
+    RemoveInsertColumns();
+
+    // Include only hits whose headers are not already contained in alignment
+    std::vector<bool> include(hits.size(), false);
+    const std::unordered_set<std::string> known(headers_.begin(), headers_.end());
+    for (size_t h = 0; h < hits.size(); ++h)
+        include[h] = known.find(hits[h].definition) == known.end();
+    AppendHsps(hits, best, include);
+}
+
+// Returns the bit set of candidates kept by visiting them in order and keeping
+// each one that is not redundant to a kept one. Bit d of row c in the
+// triangular bit matrix 'redundant', starting at word 'offset[c]', is set if
+// candidate c is redundant to candidate d < c. The first candidate is always
+// kept.
+inline std::vector<uint64_t> GreedyNonRedundant(const std::vector<uint64_t>& redundant,
+                                               const std::vector<size_t>& offset) {
+    const size_t nc = offset.size() - 1;
+    std::vector<uint64_t> kept((nc + 63) / 64, 0);
+    kept[0] = 1;
+    for (size_t c = 1; c < nc; ++c) {
+        bool red = false;
+        for (size_t w = 0; w < offset[c + 1] - offset[c] && !red; ++w)
+            red = (redundant[offset[c] + w] & kept[w]) != 0;
+        if (!red) kept[c / 64] |= static_cast<uint64_t>(1) << (c % 64);
+    }
+    return kept;
+}
+
+template<class Abc>
+size_t Alignment<Abc>::FilterRedundant(double max_identity, double min_coverage,
+                                        size_t min_keep) {
+    const size_t n = nseqs();
+    const size_t m = nmatch();
+
+    // Number of residues of each sequence in match columns
+    std::vector<size_t> len(n, 0);
+    for (size_t i = 0; i < m; ++i) {
+        const uint8_t* col = seqs_[match_idx_[i]];
+        for (size_t k = 0; k < n; ++k)
+            if (col[k] < Abc::kGap) ++len[k];
+    }
+
+    // Candidates with sufficient coverage after the query, longest first
+    std::vector< std::pair<long, size_t> > ranked;
+    for (size_t k = 1; k < n; ++k)
+        if (100.0 * len[k] >= min_coverage * m)
+            ranked.push_back(std::make_pair(-static_cast<long>(len[k]), k));
+    std::sort(ranked.begin(), ranked.end());
+    std::vector<size_t> order(1, 0);
+    for (size_t r = 0; r < ranked.size(); ++r) order.push_back(ranked[r].second);
+
+    // Column-major copy of candidate match columns padded to 16-byte blocks
+    const int nc = order.size();
+    const size_t stride = (nc + 15) / 16 * 16;
+    std::vector<uint8_t> cols(m * stride, Abc::kGap);
+    for (size_t i = 0; i < m; ++i)
+        for (int c = 0; c < nc; ++c)
+            cols[i * stride + c] = seqs_[match_idx_[i]][order[c]];
+
+    // Triangular bit matrix: bit d of row c is set if candidate c is redundant
+    // to candidate d < c
+    std::vector<size_t> offset(nc + 1, 0);
+    for (int c = 0; c < nc; ++c) offset[c + 1] = offset[c] + (c + 63) / 64;
+    std::vector<uint64_t> redundant(offset[nc], 0);
+    // For the diversity filter also the identity of each pair in percent of the
+    // shorter sequence, rounded up, in a triangular byte matrix
+    std::vector<uint8_t> pct(min_keep > 0 ? static_cast<size_t>(nc) * (nc - 1) / 2 : 0);
+
+    // Count identities of each candidate with all earlier ones at once, in
+    // byte counters that are flushed before they can overflow
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int c = 1; c < nc; ++c) {
+        std::vector<uint8_t> count(stride);
+        std::vector<uint32_t> ident(c, 0);
+        for (size_t i0 = 0; i0 < m; i0 += 255) {
+            std::fill(count.begin(), count.end(), 0);
+            for (size_t i = i0; i < MIN(m, i0 + 255); ++i) {
+                const uint8_t a = cols[i * stride + c];
+                if (a >= Abc::kAny) continue;
+                const uint8_t* col = &cols[i * stride];
+#ifdef __SSE2__
+                const __m128i va = _mm_set1_epi8(a);
+                for (int d = 0; d < c; d += 16) {
+                    __m128i* p = reinterpret_cast<__m128i*>(&count[d]);
+                    const __m128i eq = _mm_cmpeq_epi8(
+                        _mm_loadu_si128(reinterpret_cast<const __m128i*>(col + d)), va);
+                    _mm_storeu_si128(p, _mm_sub_epi8(_mm_loadu_si128(p), eq));
+                }
+#else
+                for (int d = 0; d < c; ++d) count[d] += col[d] == a;
+#endif
+            }
+            for (int d = 0; d < c; ++d) ident[d] += count[d];
+        }
+        uint64_t* bits = &redundant[offset[c]];
+        for (int d = 0; d < c; ++d) {
+            const size_t minlen = MIN(len[order[c]], len[order[d]]);
+            if (ident[d] > 0.01 * max_identity * minlen)
+                bits[d / 64] |= static_cast<uint64_t>(1) << (d % 64);
+            if (!pct.empty() && minlen > 0)
+                pct[static_cast<size_t>(c) * (c - 1) / 2 + d] = (100 * ident[d] + minlen - 1) / minlen;
+        }
+    }
+
+    // Greedily keep candidates not redundant to any kept one
+    std::vector<uint64_t> kept(GreedyNonRedundant(redundant, offset));
+
+    // Diversity filter as hhfilter -diff: find the lowest identity threshold
+    // that still keeps 'min_keep' sequences in every block of match columns,
+    // or as many as the filter above keeps if that is less
+    if (min_keep > 0) {
+        const size_t kBlockSize = 50;
+        const size_t nblocks = (m + kBlockSize - 1) / kBlockSize;
+        // Candidates count for a block if they have residues in half its columns
+        std::vector<bool> covers(nc * nblocks, false);
+        for (int c = 0; c < nc; ++c)
+            for (size_t b = 0; b < nblocks; ++b) {
+                const size_t beg = b * kBlockSize, end = MIN(m, beg + kBlockSize);
+                size_t nres = 0;
+                for (size_t i = beg; i < end; ++i) nres += cols[i * stride + c] < Abc::kGap;
+                covers[c * nblocks + b] = 2 * nres >= end - beg;
+            }
+        // Returns the number of kept candidates in each block
+        auto block_counts = [&](const std::vector<uint64_t>& kept_bits) {
+            std::vector<size_t> counts(nblocks, 0);
+            for (int c = 0; c < nc; ++c)
+                if (kept_bits[c / 64] >> (c % 64) & 1)
+                    for (size_t b = 0; b < nblocks; ++b) counts[b] += covers[c * nblocks + b];
+            return counts;
+        };
+        // Returns the candidates kept with integer identity threshold 't'
+        auto filter = [&](int t) {
+            std::vector<uint64_t> bits(offset[nc], 0);
+            for (int c = 1; c < nc; ++c)
+                for (int d = 0; d < c; ++d)
+                    if (pct[static_cast<size_t>(c) * (c - 1) / 2 + d] > t)
+                        bits[offset[c] + d / 64] |= static_cast<uint64_t>(1) << (d % 64);
+            return GreedyNonRedundant(bits, offset);
+        };
+        std::vector<size_t> need(block_counts(kept));
+        for (size_t b = 0; b < nblocks; ++b) need[b] = MIN(need[b], min_keep);
+        auto enough = [&](const std::vector<uint64_t>& kept_bits) {
+            const std::vector<size_t> counts(block_counts(kept_bits));
+            for (size_t b = 0; b < nblocks; ++b)
+                if (counts[b] < need[b]) return false;
+            return true;
+        };
+
+        // Bisect for the lowest threshold, assuming that lower thresholds keep
+        // fewer sequences
+        int hi = static_cast<int>(MIN(floor(max_identity), 100.0));
+        std::vector<uint64_t> best(filter(hi));
+        if (enough(best)) {
+            int lo = 0;
+            while (lo < hi) {
+                const int t = (lo + hi) / 2;
+                std::vector<uint64_t> cand(filter(t));
+                if (enough(cand)) {
+                    hi = t;
+                    best.swap(cand);
+                } else {
+                    lo = t + 1;
+                }
+            }
+            kept.swap(best);
+        }
+    }
+
+    std::vector<bool> keep(n, false);
+    for (int c = 0; c < nc; ++c)
+        if (kept[c / 64] >> (c % 64) & 1) keep[order[c]] = true;
+
+    // Compact sequences and headers in their original order
+    const size_t nkeep = std::count(keep.begin(), keep.end(), true);
+    if (nkeep == n) return 0;
+    Matrix<uint8_t> seqs_kept(ncols(), nkeep);
+    std::vector<std::string> headers_kept;
+    for (size_t k = 0; k < n; ++k) {
+        if (!keep[k]) continue;
+        for (size_t i = 0; i < ncols(); ++i)
+            seqs_kept[i][headers_kept.size()] = seqs_[i][k];
+        headers_kept.push_back(headers_[k]);
+    }
+    headers_.swap(headers_kept);
+    seqs_.Swap(seqs_kept);
+    return n - nkeep;
 }
 
 template<class Abc>
@@ -626,8 +879,8 @@ void Alignment<Abc>::Rearrange(const std::vector<Sequence<Abc> >& seqs) {
         for (size_t i = 0; i < ncols(); ++i)
             new_seqs[i][k] = seqs_[i][mapping[k]];
     }
-    headers_ = new_headers;
-    seqs_ = new_seqs;
+    headers_.swap(new_headers);
+    seqs_.Swap(new_seqs);
 }
 
 
@@ -839,12 +1092,13 @@ Vector<double> PositionSpecificWeightsAndDiversity(const Alignment<Abc>& ali, Ma
             }  // for j over ncols
             Normalize(&wi[0], nseqs);
 
-            if (ncoli < kMinCols)  // number of columns in subalignment insufficient?
+            if (ncoli < kMinCols) {  // number of columns in subalignment insufficient?
                 for (size_t k = 0; k < nseqs; ++k)
                     if (ali[i][k] < any)
                         wi[k] = wg[k];
                     else
                         wi[k] = 0.0f;
+            }
 
             neff[i] = 0.0f;
             for (size_t j = 0; j < ncols; ++j) {
@@ -20,6 +20,7 @@
 #ifndef CS_ALIGNMENT_H_
 #define CS_ALIGNMENT_H_
 
+#include <unordered_set>
 #include <valarray>
 
 #include "blast_hits.h"
@@ -59,12 +60,19 @@ class Alignment {
     Alignment(const Sequence<Abc>& seq);
 
     // Constructs a query anchored alignment from BLAST hits. If flag best is set
-    // to true only the best HSP of each hit is included in the alignment.
+    // to true only the best HSP of each hit is included in the alignment. HSP
+    // residues are written directly into the sequence matrix, in parallel.
     Alignment(const BlastHits& hits, bool best = false);
 
     // All memeber are automatically destructed
     ~Alignment() {}
 
+    // Copies are deep; moves hand over the sequence matrix without copying.
+    Alignment(const Alignment&) = default;
+    Alignment(Alignment&&) = default;
+    Alignment& operator=(const Alignment&) = default;
+    Alignment& operator=(Alignment&&) = default;
+
     // Accessors for integer representation of character in MATCH column i of
     // sequence k.
     uint8_t* operator[](size_t i) { return seqs_[match_idx_[i]]; }
@@ -133,6 +141,24 @@ class Alignment {
     // alignment are lost!
     void Merge(const Alignment<Abc>& ali);
 
+    // Merges the query anchored HSPs of hits that are not already included in
+    // this alignment, writing their residues directly into the grown sequence
+    // matrix. Same as merging Alignment(hits, best) but without building it.
+    void Merge(const BlastHits& hits, bool best = false);
+
+    // Removes sequences that cover less than 'min_coverage' percent of the match
+    // columns or share more than 'max_identity' percent identical residues with
+    // a kept sequence, relative to the shorter of the two, as hhfilter does.
+    // Candidates are visited from longest to shortest so that each group of
+    // near-identical sequences keeps its longest member. The first sequence is
+    // always kept. With 'min_keep' > 0 the identity cutoff is lowered further
+    // as long as every block of 50 match columns keeps 'min_keep' sequences,
+    // like hhfilter -diff, which leaves the most diverse sequences. Unlike
+    // hhfilter, one cutoff is shared by all blocks. Returns the number of
+    // removed sequences.
+    size_t FilterRedundant(double max_identity, double min_coverage = 0.0,
+                           size_t min_keep = 0);
+
     // Returns alignment sequence k as Sequence object without gaps.
     Sequence<Abc> GetSequence(size_t k) const;
 
@@ -156,6 +182,15 @@ class Alignment {
     // Fills match_idx__ with the indices of all match columns.
     void SetMatchIndices();
 
+    // Writes the query anchored residues of 'hsp' into sequence k of matrix
+    // 'seqs' with end gaps outside of the HSP. Returns false if the HSP has an
+    // invalid character.
+    static bool AssignHsp(Matrix<uint8_t>& seqs, size_t k, const BlastHsp& hsp);
+
+    // Appends the HSPs of 'hits' to the sequence matrix, the best only if 'best'
+    // is set, and of those hits only for which 'include' is true.
+    void AppendHsps(const BlastHits& hits, bool best, const std::vector<bool>& include);
+
     // Reads an alignment in FASTA format.
     void ReadFasta(FILE* fin, std::vector<std::string>& headers, std::vector<std::string>& seqs);
 
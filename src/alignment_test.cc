@@ -76,6 +76,62 @@ TEST(AlignmentTest, DISABLED_ConstructionFromBlastHitsWithMultipleHSPs) {
   EXPECT_EQ((size_t)4, ali_best.nseqs());
 }
 
+// Returns an HSP with given query start and aligned query and subject.
+static BlastHsp MakeHsp(int query_start, const string& qali, const string& sali) {
+  BlastHsp hsp;
+  hsp.query_start = query_start;
+  hsp.query_seq.assign(qali.begin(), qali.end());
+  hsp.subject_seq.assign(sali.begin(), sali.end());
+  hsp.length = qali.length();
+  return hsp;
+}
+
+TEST(AlignmentTest, ConstructionFromBlastHitsMatchesFasta) {
+  BlastHits hits;
+  hits.set_query_length(12);
+  BlastHit hit;
+  hit.definition = "hit1";
+  hit.hsps.push_back(MakeHsp(3, "EF-GHIK", "EFWG-IK"));
+  hit.hsps.push_back(MakeHsp(1, "ACDE", "ACDQ"));
+  hits.push_back(hit);
+  hit.hsps.clear();
+  hit.definition = "hit2";
+  hit.hsps.push_back(MakeHsp(7, "IKLMNP", "IRLM-P"));
+  hits.push_back(hit);
+
+  // Subject residues against query insertions are dropped, gaps at the ends
+  // become end gaps
+  FILE* fin = tmpfile();
+  fputs(">hit1\n--EFG-IK----\n>hit1\nACDQ--------\n>hit2\n------IRLM-P\n", fin);
+  rewind(fin);
+  const Alignment<AA> ref(fin, FASTA_ALIGNMENT);
+  fclose(fin);
+
+  const Alignment<AA> ali(hits);
+  ASSERT_EQ(ref.nseqs(), ali.nseqs());
+  ASSERT_EQ(ref.ncols(), ali.ncols());
+  EXPECT_EQ(ref.nmatch(), ali.nmatch());
+  for (size_t k = 0; k < ali.nseqs(); ++k) {
+    EXPECT_EQ(ref.header(k), ali.header(k));
+    for (size_t i = 0; i < ali.ncols(); ++i) EXPECT_EQ(ref(k, i), ali(k, i));
+  }
+  EXPECT_EQ(2u, Alignment<AA>(hits, true).nseqs());
+
+  // Merging skips hits already in alignment
+  Alignment<AA> merged(Sequence<AA>("ACDEFGHIKLMN", "query"));
+  merged.Merge(hits.Select(vector<size_t>(1, 1)), true);
+  ASSERT_EQ(2u, merged.nseqs());
+  merged.Merge(hits);
+  ASSERT_EQ(4u, merged.nseqs());
+  EXPECT_EQ("query", merged.header(0));
+  EXPECT_EQ("hit2", merged.header(1));
+  EXPECT_EQ("hit1", merged.header(3));
+  for (size_t i = 0; i < merged.ncols(); ++i) {
+    EXPECT_EQ(ref(2, i), merged(1, i));
+    EXPECT_EQ(ref(1, i), merged(3, i));
+  }
+}
+
 TEST(AlignmentTest, DISABLED_ConstructionFromA2M) {
   FILE* fin = fopen("../data/d1alx.a2m", "r");
   Alignment<AA> alignment(fin, A2M_ALIGNMENT);
@@ -109,6 +165,84 @@ TEST(AlignmentTest, ConstructionFromA3M) {
   }
 }
 
+TEST(AlignmentTest, FilterRedundant) {
+  FILE* fin = tmpfile();
+  fputs(">query\nACDEFGHIKLMNPQRSTVWY\n>close\nACDEFGHIKLMNPQRSTVWF\n"
+        ">fragment\nACDEFGHIKL----------\n>diverse\nWYVTSRQPNMLKIHGFEDCA\n"
+        ">diverse2\nWYVTSRQPNMLKIHGFEDCC\n", fin);
+  rewind(fin);
+  Alignment<AA> ali(fin, FASTA_ALIGNMENT);
+  fclose(fin);
+  Alignment<AA> ali_cov(ali);
+
+  EXPECT_EQ(3u, ali.FilterRedundant(90));
+  ASSERT_EQ(2u, ali.nseqs());
+  EXPECT_EQ("query", ali.header(0));
+  EXPECT_EQ("diverse", ali.header(1));
+  EXPECT_EQ(ali.chr(1, 19), 'A');
+
+  // Coverage cutoff only removes the fragment
+  EXPECT_EQ(1u, ali_cov.FilterRedundant(100, 60));
+  EXPECT_EQ(4u, ali_cov.nseqs());
+  EXPECT_EQ("close", ali_cov.header(1));
+}
+
+TEST(AlignmentTest, FilterRedundantKeepsMostDiverse) {
+  FILE* fin = fopen("../data/test/101mA.a3m", "r");
+  ASSERT_TRUE(fin != NULL);
+  Alignment<AA> ali(fin, A3M_ALIGNMENT);
+  fclose(fin);
+  Alignment<AA> ali_diff(ali);
+  const size_t nseqs = ali.nseqs();
+
+  // Diversity filter removes more sequences than the identity cutoff alone
+  const size_t removed = ali.FilterRedundant(90);
+  const size_t removed_diff = ali_diff.FilterRedundant(90, 0.0, 5);
+  EXPECT_GT(removed_diff, removed);
+  EXPECT_LT(removed_diff, nseqs - 5);
+  EXPECT_EQ(ali.header(0), ali_diff.header(0));
+
+  // Every block of 50 columns keeps enough sequences with residues in half of it
+  for (size_t beg = 0; beg < ali_diff.nmatch(); beg += 50) {
+    const size_t end = MIN(ali_diff.nmatch(), beg + 50);
+    size_t nfull = 0, nfull_diff = 0;
+    for (size_t k = 0; k < ali.nseqs(); ++k) {
+      size_t nres = 0;
+      for (size_t i = beg; i < end; ++i) nres += ali[i][k] < AA::kGap;
+      nfull += 2 * nres >= end - beg;
+    }
+    for (size_t k = 0; k < ali_diff.nseqs(); ++k) {
+      size_t nres = 0;
+      for (size_t i = beg; i < end; ++i) nres += ali_diff[i][k] < AA::kGap;
+      nfull_diff += 2 * nres >= end - beg;
+    }
+    EXPECT_GE(nfull_diff, MIN(nfull, static_cast<size_t>(5)));
+  }
+}
+
+TEST(AlignmentTest, FilterRedundantLeavesNoRedundantPair) {
+  FILE* fin = fopen("../data/test/101mA.a3m", "r");
+  ASSERT_TRUE(fin != NULL);
+  Alignment<AA> ali(fin, A3M_ALIGNMENT);
+  fclose(fin);
+  const size_t removed = ali.FilterRedundant(70);
+  EXPECT_GT(removed, 0u);
+  EXPECT_EQ(1066u, ali.nseqs() + removed);
+  EXPECT_EQ(0u, ali.FilterRedundant(70));
+
+  vector<size_t> len(ali.nseqs(), 0);
+  for (size_t i = 0; i < ali.nmatch(); ++i)
+    for (size_t k = 0; k < ali.nseqs(); ++k)
+      if (ali[i][k] < AA::kGap) ++len[k];
+  for (size_t k = 0; k < ali.nseqs(); ++k)
+    for (size_t l = 0; l < k; ++l) {
+      size_t ident = 0;
+      for (size_t i = 0; i < ali.nmatch(); ++i)
+        if (ali[i][k] < AA::kAny && ali[i][k] == ali[i][l]) ++ident;
+      EXPECT_LE(ident, 0.7 * MIN(len[k], len[l]));
+    }
+}
+
 TEST(AlignmentTest, DISABLED_AssignMatchColumnsByGapRule) {
   FILE* fin = fopen("../data/MalT_diverse.fas", "r");
   Alignment<AA> ali(fin, FASTA_ALIGNMENT);
@@ -0,0 +1,399 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cs.h"
+#include "as_search.h"
+#include "sw_search.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::string;
+using std::vector;
+
+namespace cs {
+
+// Scale of abstract state matrix scores in nats per score unit (half-bits).
+static const double kStateLambda = log(2.0) / 2.0;
+
+Sequence<AS219> TranslateIntoAS219(const Sequence<AA>& seq,
+                                   const ContextLibrary<AA>& as_lib,
+                                   double weight_as) {
+  Emission<AA> emission(1, weight_as, 1.0);
+  Sequence<AS219> as_seq(TranslateIntoStateSequence<AS219>(seq, as_lib, emission));
+  as_seq.set_header(seq.header());
+  return as_seq;
+}
+
+StateProfileScores::StateProfileScores(const Profile<AS219>& asp,
+                                       const AbstractStateMatrix<AS219>& matrix)
+    : length_(asp.length()),
+      scores_(length_ * AS219::kSizeAny, kAnyScore) {
+  for (size_t i = 0; i < length_; ++i) {
+    for (size_t s = 0; s < AS219::kSize; ++s) {
+      const double p = asp[i][s];
+      int score = p > 0.0 ? iround(log(p / matrix.py(s)) / kStateLambda) : kMinScore;
+      scores_[i * AS219::kSizeAny + s] = MAX(kMinScore, MIN(kMaxScore, score));
+    }
+  }
+}
+
+StripedStateProfile::StripedStateProfile(const StateProfileScores& scores)
+    : seglen_(MAX(static_cast<size_t>(1), (scores.length() + kLanes - 1) / kLanes)),
+      data_(AS219::kSizeAny * seglen_ * kLanes, 0) {
+  for (size_t a = 0; a < AS219::kSizeAny; ++a)
+    for (size_t s = 0; s < seglen_; ++s)
+      for (size_t l = 0; l < kLanes; ++l) {
+        const size_t i = l * seglen_ + s;
+        if (i < scores.length())
+          data_[(a * seglen_ + s) * kLanes + l] = scores(i, a) + kBias;
+      }
+}
+
+// Best local alignment score by the scalar Gotoh recursion in 32-bit integers.
+static int ScalarScore(const StateProfileScores& scores, const uint8_t* seq, size_t len,
+                       int gap_open, int gap_extend) {
+  const int goe = gap_open + gap_extend;
+  const size_t m = scores.length();
+  vector<int> h(m + 1, 0), e(m + 1, INT_MIN / 2);
+  int best = 0;
+  for (size_t j = 0; j < len; ++j) {
+    int hdiag = 0, hup = 0, f = INT_MIN / 2;
+    for (size_t i = 1; i <= m; ++i) {
+      e[i] = MAX(e[i] - gap_extend, h[i] - goe);
+      f = MAX(f - gap_extend, hup - goe);
+      const int hij = MAX(MAX(0, hdiag + scores(i - 1, seq[j])), MAX(e[i], f));
+      hdiag = h[i];
+      h[i] = hup = hij;
+      best = MAX(best, hij);
+    }
+  }
+  return best;
+}
+
+#ifdef __SSE2__
+// Best local alignment score by Farrar's striped recursion in saturated
+// unsigned 8-bit lanes. Zero stands for minus infinity in the gap vectors,
+// which is exact since local alignment scores never fall below zero.
+static int StripedScore(const StripedStateProfile& prof, const uint8_t* seq, size_t len,
+                        int gap_open, int gap_extend) {
+  static thread_local vector<uint8_t> buffer;
+  const size_t seglen = prof.seglen();
+  const __m128i vZero = _mm_setzero_si128();
+  const __m128i vBias = _mm_set1_epi8(StripedStateProfile::kBias);
+  const __m128i vGapOE = _mm_set1_epi8(MIN(255, gap_open + gap_extend));
+  const __m128i vGapE = _mm_set1_epi8(MIN(255, gap_extend));
+
+  __m128i* hstore = reinterpret_cast<__m128i*>(
+      AlignedScratch(buffer, 3 * seglen * sizeof(__m128i)));
+  __m128i* hload = hstore + seglen;
+  __m128i* e = hload + seglen;
+  for (size_t s = 0; s < seglen; ++s) {
+    hstore[s] = vZero;
+    e[s] = vZero;
+  }
+
+  __m128i vMax = vZero;
+  for (size_t j = 0; j < len; ++j) {
+    const __m128i* vP = reinterpret_cast<const __m128i*>(prof.segments(seq[j]));
+    __m128i vF = vZero;
+    __m128i vH = _mm_slli_si128(hstore[seglen - 1], 1);
+    std::swap(hload, hstore);
+
+    for (size_t s = 0; s < seglen; ++s) {
+      vH = _mm_subs_epu8(_mm_adds_epu8(vH, _mm_loadu_si128(vP + s)), vBias);
+      vH = _mm_max_epu8(vH, e[s]);
+      vH = _mm_max_epu8(vH, vF);
+      vMax = _mm_max_epu8(vMax, vH);
+      hstore[s] = vH;
+      vH = _mm_subs_epu8(vH, vGapOE);
+      e[s] = _mm_max_epu8(_mm_subs_epu8(e[s], vGapE), vH);
+      vF = _mm_max_epu8(_mm_subs_epu8(vF, vGapE), vH);
+      vH = hload[s];
+    }
+
+    // Propagate vertical gaps across segment boundaries until they can no
+    // longer improve any cell; vF > vH - gap_open - gap_extend in some lane
+    // if and only if their saturated difference is nonzero there
+    size_t s = 0;
+    vF = _mm_slli_si128(vF, 1);
+    vH = hstore[0];
+    while (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(vF, _mm_subs_epu8(vH, vGapOE)),
+                                            vZero)) != 0xffff) {
+      vH = _mm_max_epu8(vH, vF);
+      hstore[s] = vH;
+      e[s] = _mm_max_epu8(e[s], _mm_subs_epu8(vH, vGapOE));
+      vF = _mm_subs_epu8(vF, vGapE);
+      if (++s >= seglen) {
+        s = 0;
+        vF = _mm_slli_si128(vF, 1);
+      }
+      vH = hstore[s];
+    }
+  }
+
+  uint8_t lanes[StripedStateProfile::kLanes];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), vMax);
+  int best = 0;
+  for (size_t l = 0; l < StripedStateProfile::kLanes; ++l) best = MAX(best, static_cast<int>(lanes[l]));
+  return best;
+}
+#endif
+
+int StateSmithWatermanScore(const StateProfileScores& scores, const StripedStateProfile& prof,
+                            const uint8_t* seq, size_t len, int gap_open, int gap_extend) {
+#ifdef __SSE2__
+  const int score = StripedScore(prof, seq, len, gap_open, gap_extend);
+  if (score < 255 - StripedStateProfile::kBias) return score;
+#endif
+  return ScalarScore(scores, seq, len, gap_open, gap_extend);
+}
+
+BlastHsp StateSmithWatermanAlign(const StateProfileScores& scores, const uint8_t* seq,
+                                 size_t len, int gap_open, int gap_extend) {
+  // Traceback bits as in SmithWatermanAlign: source of H in the lowest two bits
+  // (0: start, 1: diagonal, 2: horizontal gap, 3: vertical gap), extension of E
+  // and F in bits 2 and 3.
+  const int goe = gap_open + gap_extend;
+  const size_t m = scores.length(), n = len;
+  vector<uint8_t> tb((m + 1) * (n + 1), 0);
+  vector<int> h(n + 1, 0), f(n + 1, INT_MIN / 2);
+  int best = 0;
+  size_t bi = 0, bj = 0;
+  for (size_t i = 1; i <= m; ++i) {
+    int hdiag = 0, hleft = 0, e = INT_MIN / 2;
+    for (size_t j = 1; j <= n; ++j) {
+      uint8_t t = 0;
+      if (e - gap_extend >= hleft - goe) { e -= gap_extend; t |= 4; } else { e = hleft - goe; }
+      if (f[j] - gap_extend >= h[j] - goe) { f[j] -= gap_extend; t |= 8; } else { f[j] = h[j] - goe; }
+      int hij = hdiag + scores(i - 1, seq[j - 1]);
+      t |= 1;
+      if (e > hij) { hij = e; t = (t & ~3) | 2; }
+      if (f[j] > hij) { hij = f[j]; t = (t & ~3) | 3; }
+      if (hij <= 0) { hij = 0; t &= ~3; }
+      tb[i * (n + 1) + j] = t;
+      hdiag = h[j];
+      h[j] = hleft = hij;
+      if (hij > best) { best = hij; bi = i; bj = j; }
+    }
+  }
+
+  // Trace back from the best cell to find the start and length of the alignment
+  size_t i = bi, j = bj, ncols = 0;
+  int state = 0;  // 0: H, 2: E, 3: F
+  while (i > 0 && j > 0) {
+    const uint8_t t = tb[i * (n + 1) + j];
+    if (state == 0) {
+      if ((t & 3) == 0) break;
+      if ((t & 3) != 1) {
+        state = t & 3;
+        continue;
+      }
+      --i;
+      --j;
+    } else if (state == 2) {
+      state = (t & 4) ? 2 : 0;
+      --j;
+    } else {
+      state = (t & 8) ? 3 : 0;
+      --i;
+    }
+    ++ncols;
+  }
+
+  BlastHsp hsp;
+  hsp.query_start = i + 1;
+  hsp.query_end = bi;
+  hsp.subject_start = j + 1;
+  hsp.subject_end = bj;
+  hsp.length = ncols;
+  hsp.score = best;
+  return hsp;
+}
+
+vector<double> StateFrequencies(const SequenceDb<AS219>& db) {
+  vector<size_t> counts(AS219::kSize, 0);
+  size_t total = 0;
+  for (size_t k = 0; k < db.size(); ++k)
+    for (const uint8_t* s = db.residues(k); *s != SequenceDb<AS219>::kEnd; ++s)
+      if (*s < AS219::kSize) {
+        ++counts[*s];
+        ++total;
+      }
+  vector<double> freqs(AS219::kSize, 0.0);
+  for (size_t s = 0; s < AS219::kSize; ++s)
+    freqs[s] = static_cast<double>(counts[s]) / MAX(static_cast<size_t>(1), total);
+  return freqs;
+}
+
+AsSearch::AsSearch(const Sequence<AA>* query,
+                   const Pssm* pssm,
+                   const ContextLibrary<AA>* contexts,
+                   const AbstractStateMatrix<AS219>* matrix,
+                   const SequenceDb<AS219>* db,
+                   const CSBlastOptions& opts)
+    : query_(query), pssm_(pssm), contexts_(contexts), matrix_(matrix), db_(db),
+      opts_(opts), index_(NULL), max_candidates_(0), num_aligned_(0), ka_cache_(NULL) {
+  if (contexts_->size() != matrix_->num_contexts())
+    throw Exception("Abstract state matrix has %zu contexts but context library has %zu!",
+                    matrix_->num_contexts(), contexts_->size());
+}
+
+double AsSearch::GetOption(char opt, double def) const {
+  CSBlastOptions::const_iterator it = opts_.find(opt);
+  return it == opts_.end() ? def : atof(it->second.c_str());
+}
+
+int AsSearch::Run(FILE* fout, BlastHits* hits) {
+  if (!pssm_) throw Exception("Abstract state search needs a PSSM!");
+
+  // Translate query profile into abstract state profile
+  const CountProfile<AA> counts(pssm_->profile);
+  const Emission<AA> emission(contexts_->wlen());
+  const Profile<AS219> asp(
+      TranslateIntoStateProfile<AS219>(counts, *contexts_, emission, *matrix_));
+  const StateProfileScores scores(asp, *matrix_);
+  const StripedStateProfile prof(scores);
+
+  const int gap_open = static_cast<int>(GetOption('G', 11));
+  const int gap_extend = static_cast<int>(GetOption('E', 1));
+  const double evalue = GetOption('e', 10.0);
+  const size_t ndescr = static_cast<size_t>(GetOption('v', 500));
+  const size_t nalis = static_cast<size_t>(GetOption('b', 250));
+  if (state_freqs_.empty()) state_freqs_ = StateFrequencies(*db_);
+  const ScoreProbabilities probs(PositionScoreProbabilities(scores, state_freqs_));
+  KarlinAltschulParams ungapped = ka_cache_ ? ka_cache_->Ungapped(probs) : UngappedParams(probs);
+  if (ungapped.lambda <= 0.0) {
+    LOG(WARNING) << "Abstract state scores are positive on average in this database; "
+                 << "E-values use the matrix scale instead";
+    ungapped = KarlinAltschulParams(kStateLambda, Blosum62UngappedParams().K);
+  }
+  try {
+    ka_ = ScaledGappedParams(ungapped, gap_open, gap_extend);
+  } catch (const Exception& e) {
+    LOG(WARNING) << e.what() << " E-values use ungapped statistics instead";
+    ka_ = ungapped;
+  }
+  const KarlinAltschulParams& ka = ka_;
+  const double space = EffectiveSearchSpace(ka, scores.length(), db_->num_residues(), db_->size());
+
+  // Select entries to align, longest first for load balancing
+  const int n = static_cast<int>(db_->size());
+  vector<size_t> selected;
+  if (index_) {
+    if (index_->num_seqs() != db_->size())
+      throw Exception("K-mer index does not belong to abstract state database!");
+    // Look up the most probable state of each query position
+    vector<uint8_t> states(asp.length());
+    for (size_t i = 0; i < asp.length(); ++i)
+      states[i] = std::max_element(&asp[i][0], &asp[i][0] + AS219::kSize) - &asp[i][0];
+    vector<std::pair<size_t, size_t> > cands =
+      index_->Candidates(states.empty() ? NULL : &states[0], states.size(), max_candidates_);
+    vector<bool> is_cand(n, false);
+    for (size_t c = 0; c < cands.size(); ++c) is_cand[cands[c].first] = true;
+    for (int r = 0; r < n; ++r)
+      if (is_cand[db_->by_length(r)]) selected.push_back(db_->by_length(r));
+  } else {
+    for (int r = 0; r < n; ++r) selected.push_back(db_->by_length(r));
+  }
+  num_aligned_ = selected.size();
+
+  // Score selected entries
+  vector<int> raw(n, 0);
+  const int nsel = static_cast<int>(selected.size());
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int r = 0; r < nsel; ++r) {
+    const size_t k = selected[r];
+    raw[k] = StateSmithWatermanScore(scores, prof, db_->residues(k), db_->length(k),
+                                     gap_open, gap_extend);
+  }
+
+  // Collect significant hits sorted by decreasing score. Entries that were not
+  // selected have no score and must not pass a generous E-value cutoff.
+  vector<std::pair<int, int> > ranked;
+  for (int r = 0; r < nsel; ++r) {
+    const int k = static_cast<int>(selected[r]);
+    if (ka.K * space * exp(-ka.lambda * raw[k]) <= evalue)
+      ranked.push_back(std::make_pair(-raw[k], k));
+  }
+  std::sort(ranked.begin(), ranked.end());
+  if (ranked.size() > MAX(ndescr, nalis)) ranked.resize(MAX(ndescr, nalis));
+
+  // Locate aligned regions of hits
+  BlastHits found;
+  found.set_query_length(scores.length());
+  vector<BlastHit> aligned(ranked.size());
+  const int nhits = static_cast<int>(ranked.size());
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int r = 0; r < nhits; ++r) {
+    const size_t k = ranked[r].second;
+    BlastHsp hsp = StateSmithWatermanAlign(scores, db_->residues(k), db_->length(k),
+                                           gap_open, gap_extend);
+    hsp.bit_score = (ka.lambda * hsp.score - log(ka.K)) / log(2.0);
+    hsp.evalue = ka.K * space * exp(-ka.lambda * hsp.score);
+    BlastHit& hit = aligned[r];
+    hit.oid = k + 1;
+    hit.definition = db_->header(k);
+    hit.bit_score = hsp.bit_score;
+    hit.evalue = hsp.evalue;
+    hit.hsps.push_back(hsp);
+  }
+  for (size_t r = 0; r < aligned.size(); ++r) found.push_back(aligned[r]);
+
+  if (fout) WriteReport(fout, found, ndescr, nalis);
+  if (hits) *hits = found;
+  return 0;
+}
+
+void AsSearch::WriteReport(FILE* fout, const BlastHits& hits, size_t ndescr,
+                           size_t nalis) const {
+  fputs("CS-BLAST in-process abstract state search\n\n", fout);
+  fprintf(fout, "Query= %s\n", query_ ? query_->header().c_str() : "");
+  fprintf(fout, "         (%zu letters)\n\n", pssm_->query.length());
+  fprintf(fout, "Database: %zu profiles; %zu total states\n\n", db_->size(),
+          db_->num_residues());
+  if (index_)
+    fprintf(fout, "Index: %zu candidates aligned with seed %s\n\n", num_aligned_,
+            index_->seed().c_str());
+  fprintf(fout, "Lambda     K      H\n  %6.3f %8.4f %8.3f\n\n", ka_.lambda, ka_.K, ka_.H);
+  if (hits.empty()) {
+    fputs(" ***** No hits found ******\n\n", fout);
+    return;
+  }
+
+  fputs("Sequences producing significant alignments:                      (bits) Value\n\n", fout);
+  for (size_t k = 0; k < hits.size() && k < ndescr; ++k)
+    fprintf(fout, "%-66.66s %5.0f   %s\n", hits[k].definition.c_str(),
+            hits[k].bit_score, FormatEvalue(hits[k].evalue).c_str());
+  fputs("\n", fout);
+
+  for (size_t k = 0; k < hits.size() && k < nalis; ++k) {
+    const BlastHit& hit = hits[k];
+    const BlastHsp& hsp = hit.hsps[0];
+    fprintf(fout, ">%s\n          Length = %zu\n\n", hit.definition.c_str(),
+            db_->length(hit.oid - 1));
+    fprintf(fout, " Score = %.1f bits (%d), Expect = %s\n",
+            hsp.bit_score, hsp.score, FormatEvalue(hsp.evalue).c_str());
+    fprintf(fout, " Query: %d-%d, Sbjct: %d-%d, Length = %zu\n\n", hsp.query_start,
+            hsp.query_end, hsp.subject_start, hsp.subject_end, hsp.length);
+  }
+}
+
+}  // namespace cs
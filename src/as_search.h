@@ -0,0 +1,183 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_AS_SEARCH_H_
+#define CS_AS_SEARCH_H_
+
+#include "csblast.h"
+#include "abstract_state_matrix-inl.h"
+#include "context_library-inl.h"
+#include "emission.h"
+#include "karlin_altschul.h"
+#include "kmer_index.h"
+#include "sequence_db.h"
+
+namespace cs {
+
+// Translates sequence 'seq' into its abstract state sequence with the 219-state
+// alphabet 'as_lib' in log-space, as cstranslate does.
+Sequence<AS219> TranslateIntoAS219(const Sequence<AA>& seq,
+                                   const ContextLibrary<AA>& as_lib,
+                                   double weight_as = 1000.0);
+
+// Integer scores of a query abstract state profile against database abstract
+// states in half-bit units, one row of AS219::kSizeAny scores per query position.
+class StateProfileScores {
+ public:
+  // Score of a database state 'ANY' in all query positions.
+  static const int kAnyScore = -1;
+  // Range of scores; states with zero probability get the minimal score.
+  static const int kMinScore = -32;
+  static const int kMaxScore = 32;
+
+  // Scores abstract state probabilities 'asp' against the database-side state
+  // frequencies of 'matrix' as log-odds scaled by the matrix lambda.
+  StateProfileScores(const Profile<AS219>& asp, const AbstractStateMatrix<AS219>& matrix);
+
+  // Returns the score of database state 's' at query position 'i'.
+  int operator() (size_t i, size_t s) const { return scores_[i * AS219::kSizeAny + s]; }
+
+  // Returns the number of query positions.
+  size_t length() const { return length_; }
+
+ private:
+  size_t length_;
+  std::vector<int> scores_;
+};
+
+// Query profile striped for 16-lane byte-wise SIMD Smith-Waterman (Farrar
+// 2007). Scores are stored as unsigned bytes offset by kBias.
+class StripedStateProfile {
+ public:
+  static const size_t kLanes = 16;
+  static const int kBias = -StateProfileScores::kMinScore;
+
+  explicit StripedStateProfile(const StateProfileScores& scores);
+
+  // Returns pointer to the 'seglen' segments of state 's'.
+  const uint8_t* segments(size_t s) const { return &data_[s * seglen_ * kLanes]; }
+
+  // Returns the number of segments.
+  size_t seglen() const { return seglen_; }
+
+ private:
+  size_t seglen_;
+  std::vector<uint8_t> data_;
+};
+
+// Returns the best local alignment score of the query profile against the
+// 'len' state codes at 'seq' with gap costs 'gap_open' + k * 'gap_extend',
+// computed by the byte-wise striped kernel if available and by the scalar
+// recursion if the 8-bit scores saturate.
+int StateSmithWatermanScore(const StateProfileScores& scores, const StripedStateProfile& prof,
+                            const uint8_t* seq, size_t len, int gap_open, int gap_extend);
+
+// Returns the best local alignment of the query profile against the 'len'
+// state codes at 'seq' as a BLAST HSP with raw score and coordinates but
+// without aligned sequences or statistics.
+BlastHsp StateSmithWatermanAlign(const StateProfileScores& scores, const uint8_t* seq,
+                                 size_t len, int gap_open, int gap_extend);
+
+// Returns the frequencies of abstract states in database 'db'. Takes time
+// proportional to the number of residues.
+std::vector<double> StateFrequencies(const SequenceDb<AS219>& db);
+
+// In-process profile-profile search of a query against a database of abstract
+// state sequences written by csformatdb -A. The PSSM is translated into an
+// abstract state profile with context library 'contexts' and the matrix, and
+// every database entry is scored with byte-wise striped Smith-Waterman on all
+// cores. Understands the blastpgp options -e, -v, -b, -G and -E. With a k-mer
+// index of the database only the entries sharing most seeds with the query's
+// most probable states are aligned. E-values use Karlin-Altschul parameters of
+// the query's state scores against the state composition of the database.
+class AsSearch : public SearchEngine {
+ public:
+  AsSearch(const Sequence<AA>* query,
+           const Pssm* pssm,
+           const ContextLibrary<AA>* contexts,
+           const AbstractStateMatrix<AS219>* matrix,
+           const SequenceDb<AS219>* db,
+           const CSBlastOptions& opts);
+
+  virtual ~AsSearch() {}
+
+  // Searches the database with the current PSSM, writes a report listing hits
+  // with their aligned regions and returns found hits in BlastHits object.
+  virtual int Run(FILE* fout, BlastHits* hits = NULL);
+
+  virtual void set_pssm(const Pssm* pssm) { pssm_ = pssm; }
+
+  virtual void set_options(const CSBlastOptions& opts) { opts_ = opts; }
+
+  // Restricts alignment to at most 'max_candidates' entries from 'index'.
+  void set_index(const KmerIndex<AS219>* index, size_t max_candidates) {
+    index_ = index;
+    max_candidates_ = max_candidates;
+  }
+
+  // Shares ungapped statistics between searches through 'cache' if not NULL.
+  void set_statistics_cache(KarlinAltschulCache* cache) { ka_cache_ = cache; }
+
+  // Uses database state frequencies 'freqs' computed by StateFrequencies, so that
+  // searches of many queries scan the database only once. Otherwise they are
+  // computed by the first search.
+  void set_state_frequencies(const std::vector<double>& freqs) { state_freqs_ = freqs; }
+
+  // Returns the gapped Karlin-Altschul parameters of the last search.
+  const KarlinAltschulParams& statistics() const { return ka_; }
+
+ private:
+  // Returns value of option 'opt' or 'def' if not given.
+  double GetOption(char opt, double def) const;
+
+  // Writes hits with their aligned regions.
+  void WriteReport(FILE* fout, const BlastHits& hits, size_t ndescr, size_t nalis) const;
+
+  // Query sequence provided by constructor
+  const Sequence<AA>* query_;
+  // Position-specific scoring matrix
+  const Pssm* pssm_;
+  // Context library on query side of the matrix
+  const ContextLibrary<AA>* contexts_;
+  // Substitution matrix between contexts and abstract states
+  const AbstractStateMatrix<AS219>* matrix_;
+  // Database of abstract state sequences
+  const SequenceDb<AS219>* db_;
+  // Options map with blastpgp-style arguments
+  CSBlastOptions opts_;
+  // Optional seed index of the database
+  const KmerIndex<AS219>* index_;
+  // Maximal number of index candidates to align
+  size_t max_candidates_;
+  // Number of entries aligned in last search
+  size_t num_aligned_;
+  // Optional cache of ungapped statistics
+  KarlinAltschulCache* ka_cache_;
+  // Gapped statistics of last search
+  KarlinAltschulParams ka_;
+  // Frequencies of abstract states in the database, empty until needed
+  std::vector<double> state_freqs_;
+
+  DISALLOW_COPY_AND_ASSIGN(AsSearch);
+};  // class AsSearch
+
+}  // namespace cs
+
+#endif  // CS_AS_SEARCH_H_
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include <numeric>
+
+#include "cs.h"
+#include "as_search.h"
+#include "blast_hits.h"
+#include "sequence-inl.h"
+
+namespace cs {
+
+// Returns a random protein sequence of given length.
+static Sequence<AA> RandomProtein(size_t len, unsigned int* seed, const std::string& header = "") {
+  std::string s;
+  for (size_t i = 0; i < len; ++i)
+    s += AA::kIntToChar[rand_r(seed) % AA::kSize];
+  return Sequence<AA>(s, header);
+}
+
+// Writes an abstract state matrix whose contexts are the abstract states
+// themselves, with target frequencies concentrated on the diagonal.
+static void WriteDiagonalMatrix(const char* path) {
+  FILE* fout = fopen(path, "w");
+  fputs("AS219\n", fout);
+  for (size_t k = 0; k < AS219::kSize; ++k) {
+    for (size_t s = 0; s < AS219::kSize; ++s) fprintf(fout, "%d\t", k == s ? 5000 : 1);
+    fputs("\n", fout);
+  }
+  fclose(fout);
+}
+
+TEST(AsSearchTest, StripedScoreEqualsAlignmentScore) {
+  WriteDiagonalMatrix("/tmp/as_search_test.mat");
+  const AbstractStateMatrix<AS219> matrix("/tmp/as_search_test.mat");
+  remove("/tmp/as_search_test.mat");
+
+  unsigned int seed = 7;
+  std::vector<uint8_t> query(120);
+  Profile<AS219> asp(query.size(), 0.1 / (AS219::kSize - 1));
+  for (size_t i = 0; i < query.size(); ++i) {
+    query[i] = rand_r(&seed) % AS219::kSize;
+    asp[i][query[i]] = 0.9;
+  }
+  const StateProfileScores scores(asp, matrix);
+  const StripedStateProfile prof(scores);
+  const std::vector<double> freqs(AS219::kSize, 1.0 / AS219::kSize);
+  EXPECT_GT(UngappedParams(PositionScoreProbabilities(scores, freqs)).lambda, 0.0);
+
+  for (int k = 0; k < 40; ++k) {
+    // Embed a mutated piece of the query with an insertion into random states;
+    // the longest pieces saturate the byte-wise kernel
+    std::vector<uint8_t> seq;
+    for (int i = 0; i < 30 + k; ++i) seq.push_back(rand_r(&seed) % AS219::kSize);
+    for (size_t i = k % 20; i < MIN(query.size(), static_cast<size_t>(25 + 2 * k)); ++i) {
+      seq.push_back(i % 6 == 0 ? rand_r(&seed) % AS219::kSize : query[i]);
+      if (i == 40) seq.insert(seq.end(), 3, AS219::kAny);
+    }
+    for (int i = 0; i < k; ++i) seq.push_back(rand_r(&seed) % AS219::kSize);
+
+    const int score = StateSmithWatermanScore(scores, prof, &seq[0], seq.size(), 11, 1);
+    const BlastHsp hsp = StateSmithWatermanAlign(scores, &seq[0], seq.size(), 11, 1);
+    EXPECT_EQ(hsp.score, score);
+    EXPECT_GT(score, 0);
+    EXPECT_LE(hsp.query_start, hsp.query_end);
+    EXPECT_LE(hsp.subject_start, hsp.subject_end);
+  }
+}
+
+TEST(AsSearchTest, SearchFindsTranslatedHomolog) {
+  WriteDiagonalMatrix("/tmp/as_search_test.mat");
+  const AbstractStateMatrix<AS219> matrix("/tmp/as_search_test.mat");
+  remove("/tmp/as_search_test.mat");
+  FILE* fin = fopen("../data/CS219.lib", "r");
+  ASSERT_TRUE(fin != NULL);
+  ContextLibrary<AA> as_lib(fin);
+  fclose(fin);
+  TransformToLog(as_lib);
+
+  unsigned int seed = 11;
+  const Sequence<AA> query(RandomProtein(120, &seed, "query"));
+  std::string h = query.ToString();
+  for (size_t i = 0; i < h.length(); i += 4) h[i] = AA::kIntToChar[rand_r(&seed) % AA::kSize];
+
+  FILE* ftmp = tmpfile();
+  SequenceDbWriter<AS219> writer(ftmp);
+  for (int k = 0; k < 60; ++k) {
+    if (k == 30) writer.Add(TranslateIntoAS219(Sequence<AA>(h, "homolog"), as_lib));
+    writer.Add(TranslateIntoAS219(RandomProtein(150, &seed, strprintf("random%d", k)), as_lib));
+  }
+  EXPECT_EQ(61u, writer.Close());
+  const SequenceDb<AS219> db(ftmp);
+  fclose(ftmp);
+
+  Profile<AA> prof(query.length(), 0.02 / (AA::kSize - 1));
+  for (size_t i = 0; i < query.length(); ++i) prof[i][query[i]] = 0.98;
+  const Pssm pssm(query, prof);
+  AsSearch search(&query, &pssm, &as_lib, &matrix, &db, CSBlastOptions());
+  BlastHits hits;
+  EXPECT_EQ(0, search.Run(NULL, &hits));
+  ASSERT_GE(hits.size(), 2u);
+  EXPECT_EQ("homolog", hits[0].definition);
+  EXPECT_GT(hits[0].hsps[0].score, 3 * hits[1].hsps[0].score);
+  EXPECT_LT(hits[0].evalue, 1e-20);
+  EXPECT_LE(hits[0].hsps[0].query_start, 5);
+  EXPECT_GE(hits[0].hsps[0].query_end, 115);
+
+  // Seed index restricts alignment to the best candidates
+  FILE* fidx = tmpfile();
+  KmerIndex<AS219>::Build(db, "11", fidx);
+  const KmerIndex<AS219> index(fidx);
+  fclose(fidx);
+  search.set_index(&index, 5);
+  BlastHits indexed;
+  EXPECT_EQ(0, search.Run(NULL, &indexed));
+  ASSERT_GE(indexed.size(), 1u);
+  EXPECT_LE(indexed.size(), 5u);
+  EXPECT_EQ("homolog", indexed[0].definition);
+  EXPECT_EQ(hits[0].hsps[0].score, indexed[0].hsps[0].score);
+  EXPECT_EQ(120u, hits.query_length());
+
+  // State frequencies computed once and shared give the same statistics
+  const std::vector<double> freqs(StateFrequencies(db));
+  EXPECT_NEAR(1.0, std::accumulate(freqs.begin(), freqs.end(), 0.0), 1e-9);
+  AsSearch shared(&query, &pssm, &as_lib, &matrix, &db, CSBlastOptions());
+  shared.set_state_frequencies(freqs);
+  BlastHits shared_hits;
+  EXPECT_EQ(0, shared.Run(NULL, &shared_hits));
+  ASSERT_GE(shared_hits.size(), 1u);
+  EXPECT_EQ("homolog", shared_hits[0].definition);
+  EXPECT_DOUBLE_EQ(hits[0].evalue, shared_hits[0].evalue);
+
+  // Gap costs without tabulated statistics fall back to ungapped ones
+  CSBlastOptions opts;
+  opts['G'] = "5";
+  opts['E'] = "5";
+  AsSearch untabulated(&query, &pssm, &as_lib, &matrix, &db, opts);
+  BlastHits fallback;
+  EXPECT_EQ(0, untabulated.Run(NULL, &fallback));
+  ASSERT_GE(fallback.size(), 1u);
+  EXPECT_EQ("homolog", fallback[0].definition);
+}
+
+}  // namespace cs
@@ -25,6 +25,9 @@ using std::vector;
 
 namespace cs {
 
+const char* BlastHits::kTabularFields =
+  "qlen sseqid stitle evalue bitscore score qstart qend sstart send qseq sseq";
+
 void BlastHits::Read(FILE* fin) {
   char buffer[KB];
   const char* ptr;
@@ -104,6 +107,48 @@ void BlastHits::Read(FILE* fin) {
   }
 }
 
+void BlastHits::ReadTabular(FILE* fin) {
+  const size_t kNumFields = 12;
+  vector<char> buffer(MB);  // aligned sequences may be long
+  vector<string> fields;
+  hits_.clear();
+  query_length_ = 0;
+
+  while (fgetline(&buffer[0], buffer.size(), fin)) {
+    const string line(&buffer[0]);
+    if (line.empty() || line[0] == '#') continue;
+    fields.clear();
+    Tokenize(line, '\t', &fields);
+    if (fields.size() != kNumFields)
+      throw Exception("Tabular BLAST output has %zu fields but expected %zu!",
+                      fields.size(), kNumFields);
+
+    query_length_ = atoi(fields[0].c_str());
+    const string definition = fields[2] == "N/A" ? fields[1] : fields[1] + " " + fields[2];
+    if (hits_.empty() || hits_.back().definition != definition) {
+      BlastHit h;
+      h.definition = definition;
+      h.evalue = atof(fields[3].c_str());
+      h.bit_score = atof(fields[4].c_str());
+      h.oid = hits_.size() + 1;
+      hits_.push_back(h);
+    }
+
+    BlastHsp hsp;
+    hsp.evalue = atof(fields[3].c_str());
+    hsp.bit_score = atof(fields[4].c_str());
+    hsp.score = atoi(fields[5].c_str());
+    hsp.query_start = atoi(fields[6].c_str());
+    hsp.query_end = atoi(fields[7].c_str());
+    hsp.subject_start = atoi(fields[8].c_str());
+    hsp.subject_end = atoi(fields[9].c_str());
+    hsp.query_seq.assign(fields[10].begin(), fields[10].end());
+    hsp.subject_seq.assign(fields[11].begin(), fields[11].end());
+    hsp.length = hsp.query_seq.size();
+    hits_.back().hsps.push_back(hsp);
+  }
+}
+
 void BlastHits::Filter(double evalue_threshold) {
   // Delete hits below E-value threshold
   for (HitIter hit = begin(); hit != end(); ++hit) {
@@ -124,4 +169,13 @@ void BlastHits::Filter(double evalue_threshold) {
   }
 }
 
+BlastHits BlastHits::Select(const std::vector<size_t>& indices) const {
+  BlastHits sel;
+  sel.query_length_ = query_length_;
+  sel.hits_.reserve(indices.size());
+  for (size_t k = 0; k < indices.size(); ++k)
+    sel.hits_.push_back(hits_[indices[k]]);
+  return sel;
+}
+
 }  // namespace cs
@@ -24,13 +24,17 @@ namespace cs {
 
 // Simple struct for data associated with a HSP.
 struct BlastHsp {
-  BlastHsp() : bit_score(0.0),
+  BlastHsp() : score(0),
+          bit_score(0.0),
           evalue(0.0),
           query_start(0),
           query_end(0),
           subject_start(0),
-          subject_end(0) {}
+          subject_end(0),
+          length(0) {}
 
+  // Raw score of HSP
+  int score;
   // Score (in bits) of HSP
   double bit_score;
   // E-value of HSP
@@ -78,6 +82,9 @@ class BlastHits {
   typedef std::vector<BlastHsp>::iterator HspIter;
   typedef std::vector<BlastHsp>::const_iterator ConstHspIter;
 
+  // Output fields expected by ReadTabular, as passed to BLAST+ -outfmt.
+  static const char* kTabularFields;
+
   // Constructs an empty hits object that can be filled by calling Read
   BlastHits() : query_length_(0) {}
 
@@ -112,15 +119,29 @@ class BlastHits {
   // Returns length of query sequence.
   size_t query_length() const { return query_length_; }
 
+  // Sets length of query sequence.
+  void set_query_length(size_t len) { query_length_ = len; }
+
+  // Appends a hit, e.g. one found by an in-process search engine.
+  void push_back(const BlastHit& hit) { hits_.push_back(hit); }
+
   // Returns true if hit list is empty.
   bool empty() const { return hits_.empty(); }
 
   // Filters hits by e-value threshold.
   void Filter(double evalue_threshold);
 
+  // Returns the hits with given indices in that order.
+  BlastHits Select(const std::vector<size_t>& indices) const;
+
   // Fills the hits object with with hits parsed from BLAST output.
   void Read(FILE* fin);
 
+  // Fills the hits object with hits parsed from BLAST+ tabular output
+  // (-outfmt 6 or 7) with fields kTabularFields. Consecutive lines with the
+  // same subject form the HSPs of one hit.
+  void ReadTabular(FILE* fin);
+
   // Prints the results for logging
   friend std::ostream& operator<< (std::ostream& out, const BlastHits& res);
 
@@ -0,0 +1,202 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_CHECKPOINT_H_
+#define CS_CHECKPOINT_H_
+
+#include "crf-inl.h"
+
+namespace cs {
+
+// Settings for periodic checkpoints of long-running optimizers.
+struct CheckpointParams {
+    CheckpointParams() : interval(1), resume(false) {}
+
+    std::string file;  // checkpoint file; no checkpoints are written if empty
+    size_t interval;   // number of epochs or sampling steps between checkpoints
+    bool resume;       // continue from checkpoint file if it exists
+};
+
+// Checkpoints are raw binary dumps in native byte order of all state needed to
+// continue an optimization exactly where it stopped. They are only meant to be
+// read back by the same build on the same platform.
+const int kCheckpointVersion = 2;
+
+// Writes a plain value to checkpoint stream.
+template<class T>
+inline void WriteBinary(FILE* fout, const T& x) {
+    if (fwrite(&x, sizeof(T), 1, fout) != 1)
+        throw Exception("Failed to write checkpoint!");
+}
+
+// Reads a plain value from checkpoint stream.
+template<class T>
+inline void ReadBinary(FILE* fin, T& x) {
+    if (fread(&x, sizeof(T), 1, fin) != 1)
+        throw Exception("Checkpoint is truncated!");
+}
+
+inline void WriteBinary(FILE* fout, const std::string& str) {
+    WriteBinary(fout, str.size());
+    if (!str.empty() && fwrite(str.data(), 1, str.size(), fout) != str.size())
+        throw Exception("Failed to write checkpoint!");
+}
+
+inline void ReadBinary(FILE* fin, std::string& str) {
+    size_t n = 0;
+    ReadBinary(fin, n);
+    if (n > KB) throw Exception("Checkpoint is corrupt!");
+    std::vector<char> buf(n + 1, '\0');
+    if (n > 0 && fread(&buf[0], 1, n, fin) != n)
+        throw Exception("Checkpoint is truncated!");
+    str.assign(&buf[0], n);
+}
+
+template<class T>
+inline void WriteBinary(FILE* fout, const std::vector<T>& v) {
+    WriteBinary(fout, v.size());
+    if (!v.empty() && fwrite(&v[0], sizeof(T), v.size(), fout) != v.size())
+        throw Exception("Failed to write checkpoint!");
+}
+
+template<class T>
+inline void ReadBinary(FILE* fin, std::vector<T>& v) {
+    size_t n = 0;
+    ReadBinary(fin, n);
+    if (n != v.size())
+        throw Exception("Checkpoint has vector of size %zu but %zu expected!", n, v.size());
+    if (n > 0 && fread(&v[0], sizeof(T), n, fin) != n)
+        throw Exception("Checkpoint is truncated!");
+}
+
+template<class T>
+inline void WriteBinary(FILE* fout, const Vector<T>& v) {
+    WriteBinary(fout, v.size());
+    if (v.size() > 0 && fwrite(&v[0], sizeof(T), v.size(), fout) != v.size())
+        throw Exception("Failed to write checkpoint!");
+}
+
+template<class T>
+inline void ReadBinary(FILE* fin, Vector<T>& v) {
+    size_t n = 0;
+    ReadBinary(fin, n);
+    if (n != v.size())
+        throw Exception("Checkpoint has vector of size %zu but %zu expected!", n, v.size());
+    if (n > 0 && fread(&v[0], sizeof(T), n, fin) != n)
+        throw Exception("Checkpoint is truncated!");
+}
+
+inline void WriteBinary(FILE* fout, const Ran& ran) {
+    WriteBinary(fout, ran.u);
+    WriteBinary(fout, ran.v);
+    WriteBinary(fout, ran.w);
+}
+
+inline void ReadBinary(FILE* fin, Ran& ran) {
+    ReadBinary(fin, ran.u);
+    ReadBinary(fin, ran.v);
+    ReadBinary(fin, ran.w);
+}
+
+// Writes all CRF weights without loss of precision.
+template<class Abc>
+void WriteBinary(FILE* fout, const Crf<Abc>& crf) {
+    WriteBinary(fout, crf.size());
+    WriteBinary(fout, crf.wlen());
+    for (size_t k = 0; k < crf.size(); ++k) {
+        const CrfState<Abc>& state = crf[k];
+        WriteBinary(fout, state.bias_weight);
+        for (size_t j = 0; j < crf.wlen(); ++j)
+            for (size_t a = 0; a < Abc::kSizeAny; ++a)
+                WriteBinary(fout, state.context_weights[j][a]);
+        for (size_t a = 0; a < Abc::kSizeAny; ++a) {
+            WriteBinary(fout, state.pc_weights[a]);
+            WriteBinary(fout, state.pc[a]);
+        }
+    }
+}
+
+// Reads CRF weights into a CRF of matching dimensions.
+template<class Abc>
+void ReadBinary(FILE* fin, Crf<Abc>& crf) {
+    size_t size = 0, wlen = 0;
+    ReadBinary(fin, size);
+    ReadBinary(fin, wlen);
+    if (size != crf.size() || wlen != crf.wlen())
+        throw Exception("Checkpoint has CRF with %zu states and window length %zu "
+                        "but %zu states and window length %zu expected!",
+                        size, wlen, crf.size(), crf.wlen());
+    for (size_t k = 0; k < crf.size(); ++k) {
+        CrfState<Abc>& state = crf[k];
+        ReadBinary(fin, state.bias_weight);
+        for (size_t j = 0; j < crf.wlen(); ++j)
+            for (size_t a = 0; a < Abc::kSizeAny; ++a)
+                ReadBinary(fin, state.context_weights[j][a]);
+        for (size_t a = 0; a < Abc::kSizeAny; ++a) {
+            ReadBinary(fin, state.pc_weights[a]);
+            ReadBinary(fin, state.pc[a]);
+        }
+    }
+}
+
+// Opens a temporary file next to 'path' for writing a checkpoint of the given
+// kind and writes the checkpoint header.
+inline FILE* BeginCheckpoint(const std::string& path, const std::string& kind) {
+    const std::string tmp = path + ".tmp";
+    FILE* fout = fopen(tmp.c_str(), "wb");
+    if (!fout) throw Exception("Can't write to file '%s'!", tmp.c_str());
+    WriteBinary(fout, kind);
+    WriteBinary(fout, kCheckpointVersion);
+    return fout;
+}
+
+// Closes checkpoint stream and atomically replaces 'path' with it, so that an
+// interrupted write never destroys the last complete checkpoint.
+inline void CommitCheckpoint(FILE* fout, const std::string& path) {
+    const std::string tmp = path + ".tmp";
+    if (fflush(fout) != 0 || ferror(fout)) {
+        fclose(fout);
+        throw Exception("Failed to write checkpoint '%s'!", tmp.c_str());
+    }
+    fclose(fout);
+    if (rename(tmp.c_str(), path.c_str()) != 0)
+        throw Exception("Can't rename '%s' to '%s'!", tmp.c_str(), path.c_str());
+}
+
+// Opens checkpoint 'path' and checks its header. Returns NULL if the file
+// does not exist.
+inline FILE* OpenCheckpoint(const std::string& path, const std::string& kind) {
+    FILE* fin = fopen(path.c_str(), "rb");
+    if (!fin) return NULL;
+    std::string k;
+    int version = 0;
+    ReadBinary(fin, k);
+    ReadBinary(fin, version);
+    if (k != kind || version != kCheckpointVersion) {
+        fclose(fin);
+        throw Exception("File '%s' is not a version %d %s checkpoint!",
+                        path.c_str(), kCheckpointVersion, kind.c_str());
+    }
+    return fin;
+}
+
+}  // namespace cs
+
+#endif  // CS_CHECKPOINT_H_
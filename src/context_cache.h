@@ -0,0 +1,193 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_CONTEXT_CACHE_H_
+#define CS_CONTEXT_CACHE_H_
+
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "sequence-inl.h"
+
+namespace cs {
+
+// Bounded least-recently-used cache of pseudocount columns keyed by the
+// sequence window they were predicted from. A single cache can be shared by
+// all queries of a run so that repeated windows, e.g. in repeats or identical
+// domains, are scored only once. Lookups and insertions are thread-safe: the
+// keys are spread over independently locked shards, each with its own LRU
+// list, so that threads scoring different windows rarely wait for each other.
+template<class Abc>
+class ContextCache {
+  public:
+    // Constructs a cache holding at most 'capacity' columns. Small caches use
+    // fewer shards, since a shard evicts as soon as it is full on its own, and
+    // the remainder of the capacity is spread over the first shards.
+    explicit ContextCache(size_t capacity)
+            : capacity_(capacity),
+              shards_(std::max<size_t>(1, std::min(capacity / kMinShardCapacity,
+                                                   size_t(kMaxShards)))) {
+        for (size_t s = 0; s < shards_.size(); ++s)
+            shards_[s].capacity = capacity / shards_.size() +
+                (s < capacity % shards_.size() ? 1 : 0);
+    }
+
+    // Builds the key of the window with 'wlen' columns centered at 'idx' in
+    // 'seq'. Columns beyond the sequence ends get a sentinel.
+    static void MakeKey(const Sequence<Abc>& seq, size_t idx, size_t wlen, std::string* key) {
+        const int center = (wlen - 1) / 2;
+        key->resize(wlen);
+        for (int j = 0, i = idx - center; j < static_cast<int>(wlen); ++j, ++i)
+            (*key)[j] = (i >= 0 && i < static_cast<int>(seq.length())) ? seq[i] : kOutside;
+    }
+
+    // Copies the column cached under 'key' to 'col' and returns true on a hit.
+    bool Lookup(const std::string& key, double* col) {
+        Shard& shard = GetShard(key);
+        bool hit = false;
+        shard.Lock();
+        typename Index::iterator it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            std::copy(it->second->second.begin(), it->second->second.end(), col);
+            hit = true;
+            ++shard.hits;
+        } else {
+            ++shard.misses;
+        }
+        shard.Unlock();
+        return hit;
+    }
+
+    // Caches column 'col' under 'key', evicting the least recently used column
+    // of its shard if the shard is full.
+    void Insert(const std::string& key, const double* col) {
+        if (capacity_ == 0) return;
+        Shard& shard = GetShard(key);
+        shard.Lock();
+        if (shard.index.find(key) == shard.index.end()) {
+            if (shard.entries.size() >= shard.capacity) {
+                shard.index.erase(shard.entries.back().first);
+                shard.entries.pop_back();
+            }
+            shard.entries.push_front(Entry(key, std::vector<double>(col, col + Abc::kSize)));
+            shard.index[key] = shard.entries.begin();
+        }
+        shard.Unlock();
+    }
+
+    // Returns the maximal number of cached columns.
+    size_t capacity() const { return capacity_; }
+
+    // Returns the number of cached columns.
+    size_t size() const {
+        size_t n = 0;
+        for (size_t s = 0; s < shards_.size(); ++s) n += shards_[s].entries.size();
+        return n;
+    }
+
+    // Returns the number of lookups that found their window.
+    size_t hits() const {
+        size_t n = 0;
+        for (size_t s = 0; s < shards_.size(); ++s) n += shards_[s].hits;
+        return n;
+    }
+
+    // Returns the number of lookups that missed.
+    size_t misses() const {
+        size_t n = 0;
+        for (size_t s = 0; s < shards_.size(); ++s) n += shards_[s].misses;
+        return n;
+    }
+
+    // Returns the fraction of lookups that found their window.
+    double HitRate() const {
+        const size_t h = hits(), m = misses();
+        return h + m > 0 ? static_cast<double>(h) / (h + m) : 0.0;
+    }
+
+  private:
+    typedef std::pair<std::string, std::vector<double> > Entry;
+    typedef std::list<Entry> EntryList;
+    typedef std::unordered_map<std::string, typename EntryList::iterator> Index;
+
+    // Independently locked part of the cache.
+    struct Shard {
+        Shard() : capacity(0), hits(0), misses(0) {
+#ifdef OPENMP
+            omp_init_lock(&lock);
+#endif
+        }
+
+        ~Shard() {
+#ifdef OPENMP
+            omp_destroy_lock(&lock);
+#endif
+        }
+
+        void Lock() {
+#ifdef OPENMP
+            omp_set_lock(&lock);
+#endif
+        }
+
+        void Unlock() {
+#ifdef OPENMP
+            omp_unset_lock(&lock);
+#endif
+        }
+
+        size_t capacity;
+        size_t hits;
+        size_t misses;
+        EntryList entries;  // most recently used first
+        Index index;
+#ifdef OPENMP
+        omp_lock_t lock;
+#endif
+
+        DISALLOW_COPY_AND_ASSIGN(Shard);
+    };
+
+    // Returns the shard that holds 'key'.
+    Shard& GetShard(const std::string& key) {
+        return shards_[std::hash<std::string>()(key) % shards_.size()];
+    }
+
+    // Key character for window columns beyond the sequence ends.
+    static const char kOutside = '\xff';
+    // Maximal number of shards.
+    static const size_t kMaxShards = 64;
+    // Minimal number of columns per shard if there is more than one.
+    static const size_t kMinShardCapacity = 256;
+
+    const size_t capacity_;
+    std::vector<Shard> shards_;
+
+    DISALLOW_COPY_AND_ASSIGN(ContextCache);
+};  // class ContextCache
+
+}  // namespace cs
+
+#endif  // CS_CONTEXT_CACHE_H_
@@ -46,6 +46,10 @@ struct CountProfile {
     // a pseudocount factory.
     CountProfile(const Profile<Abc>& p) : counts(p), neff(p.length(), 1.0) {}
 
+    // Same as above but takes over the columns of a temporary profile, e.g. the
+    // one returned by Pseudocounts::AddTo(), without copying them.
+    CountProfile(Profile<Abc>&& p) : neff(p.length(), 1.0) { counts.Swap(p); }
+
     // Construction from alignment with specified sequence weighting method
     CountProfile(const Alignment<Abc>& ali, bool pos_weights = true, bool neff_sum_pairs = false);
 
@@ -68,6 +72,13 @@ struct CountProfile {
     // Returns number of columns.
     size_t length() const { return counts.length(); }
 
+    // Exchanges contents with 'other' without copying any columns.
+    void Swap(CountProfile& other) {
+        name.swap(other.name);
+        counts.Swap(other.counts);
+        neff.Swap(other.neff);
+    }
+
 
     std::string name;               // optional name descriptor
     Profile<Abc> counts;            // absolute counts of alphabet letters
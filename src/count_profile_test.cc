@@ -3,6 +3,7 @@
 #include "cs.h"
 #include "blosum_matrix.h"
 #include "count_profile-inl.h"
+#include "pssm_cache.h"
 
 namespace cs {
 
@@ -66,4 +67,40 @@ TEST(ProfileTest, Insert) {
 
 
 
+TEST(CountProfileTest, PssmCacheRoundTrip) {
+  Sequence<AA> seq("MKVLAAGIVGLLLAQTSWARE");
+  CountProfile<AA> cp(seq);
+  for (size_t i = 0; i < cp.length(); ++i) {
+    for (size_t a = 0; a < AA::kSize; ++a)
+      cp.counts[i][a] = (i + 1.0) / (a + 3.0);
+    cp.neff[i] = 1.0 + i / 7.0;
+  }
+
+  char dir[] = "/tmp/pssm_cache_testXXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  PssmCache<AA> cache(dir);
+  const std::string key = KeyHash().Add(seq.ToString()).str();
+  EXPECT_NE(key, KeyHash().Add(seq.ToString() + "A").str());
+
+  Sequence<AA> query;
+  CountProfile<AA> loaded;
+  EXPECT_FALSE(cache.Load(key, query, loaded));
+  EXPECT_TRUE(cache.Store(key, seq, cp));
+  ASSERT_TRUE(cache.Load(key, query, loaded));
+  EXPECT_EQ(seq.ToString(), query.ToString());
+  ASSERT_EQ(cp.length(), loaded.length());
+  for (size_t i = 0; i < cp.length(); ++i) {
+    EXPECT_EQ(cp.neff[i], loaded.neff[i]);
+    for (size_t a = 0; a < AA::kSizeAny; ++a)
+      EXPECT_EQ(cp.counts[i][a], loaded.counts[i][a]);
+  }
+
+  remove(cache.Path(key).c_str());
+  rmdir(dir);
+
+  // A failed write only drops the entry
+  EXPECT_FALSE(cache.Store(key, seq, cp));
+  EXPECT_FALSE(cache.Load(key, query, loaded));
+}
+
 };  // namespace cs
@@ -0,0 +1,314 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_CRF_KERNELS_H_
+#define CS_CRF_KERNELS_H_
+
+#include "count_profile-inl.h"
+#include "crf-inl.h"
+#include "kernel_shape.h"
+#include "sequence-inl.h"
+#include "substitution_matrix-inl.h"
+
+namespace cs {
+
+// Contiguous copy of all CRF weights in scalar type T. The inference kernels
+// below read weights from this table instead of from the CRF states, so that a
+// single precision table halves the memory traffic of each pass over all states.
+template<class Abc, class T>
+class CrfTable {
+  public:
+    explicit CrfTable(const Crf<Abc>& crf) { Init(crf); }
+
+    // Copies weights and pseudocounts from given CRF.
+    void Init(const Crf<Abc>& crf) {
+        nstates_ = crf.size();
+        wlen_    = crf.wlen();
+        fixed_   = HasFixedKernel<Abc>(wlen_);
+        bias_.resize(nstates_);
+        context_.resize(nstates_ * wlen_ * Abc::kSizeAny);
+        pc_.resize(nstates_ * Abc::kSize);
+        for (size_t k = 0; k < nstates_; ++k) {
+            bias_[k] = static_cast<T>(crf[k].bias_weight);
+            T* cw = &context_[k * wlen_ * Abc::kSizeAny];
+            for (size_t j = 0; j < wlen_; ++j)
+                for (size_t a = 0; a < Abc::kSizeAny; ++a)
+                    cw[j * Abc::kSizeAny + a] = static_cast<T>(crf[k].context_weights[j][a]);
+            for (size_t a = 0; a < Abc::kSize; ++a)
+                pc_[k * Abc::kSize + a] = static_cast<T>(crf[k].pc[a]);
+        }
+    }
+
+    // Returns the number of states.
+    size_t size() const { return nstates_; }
+
+    // Returns the number of columns in context windows.
+    size_t wlen() const { return wlen_; }
+
+    // Returns index of central window column.
+    size_t center() const { return (wlen_ - 1) / 2; }
+
+    // Returns the distance between consecutive rows of context weights.
+    size_t stride() const { return Abc::kSizeAny; }
+
+    // Returns true if the fixed-shape kernels were selected for this CRF.
+    bool fixed() const { return fixed_; }
+
+    // Returns bias weight of state k.
+    T bias(size_t k) const { return bias_[k]; }
+
+    // Returns context weights of state k with row stride stride().
+    const T* context(size_t k) const { return &context_[k * wlen_ * Abc::kSizeAny]; }
+
+    // Returns pseudocount emission probabilities of state k.
+    const T* pc(size_t k) const { return &pc_[k * Abc::kSize]; }
+
+  private:
+    size_t nstates_;
+    size_t wlen_;
+    bool fixed_;
+    std::vector<T> bias_;
+    std::vector<T> context_;
+    std::vector<T> pc_;
+};  // CrfTable
+
+// Double precision weights are read straight from the CRF states instead of
+// being copied. Context weights are Profiles with row stride Profile::stride().
+template<class Abc>
+class CrfTable<Abc, double> {
+  public:
+    explicit CrfTable(const Crf<Abc>& crf)
+            : crf_(crf), fixed_(HasFixedKernel<Abc>(crf.wlen())) {}
+
+    size_t size() const { return crf_.size(); }
+    size_t wlen() const { return crf_.wlen(); }
+    size_t center() const { return crf_.center(); }
+    size_t stride() const { return Profile<Abc>::stride(); }
+    bool fixed() const { return fixed_; }
+    double bias(size_t k) const { return crf_[k].bias_weight; }
+    const double* context(size_t k) const { return crf_[k].context_weights[0]; }
+    const double* pc(size_t k) const { return &crf_[k].pc[0]; }
+
+  private:
+    const Crf<Abc>& crf_;
+    bool fixed_;
+};  // CrfTable<Abc, double>
+
+
+// Transforms state scores 'pp' into posterior probabilities. The log-sum-exp
+// normalization is always carried out in double precision.
+template<class T>
+inline void NormalizePosteriors(T* pp, size_t nstates) {
+    double max = -DBL_MAX;
+    for (size_t k = 0; k < nstates; ++k)
+        if (pp[k] > max) max = pp[k];
+    double sum = 0.0;
+    for (size_t k = 0; k < nstates; ++k)
+        sum += exp(pp[k] - max);
+    const double tmp = max + log(sum);
+    for (size_t k = 0; k < nstates; ++k)
+        pp[k] = static_cast<T>(exp(pp[k] - tmp));
+}
+
+// Posterior kernel for windows of W columns that lie entirely within 'seq'. The
+// weight offsets of the window residues are computed once for all states.
+template<size_t W, class Abc, class T>
+void FixedPosteriors(const CrfTable<Abc, T>& table,
+                     const Sequence<Abc>& seq,
+                     size_t idx,
+                     T* pp) {
+    const size_t stride = table.stride();
+    const size_t beg = idx - (W - 1) / 2;
+    size_t offset[W];
+    for (size_t j = 0; j < W; ++j) offset[j] = j * stride + seq[beg + j];
+    for (size_t k = 0; k < table.size(); ++k) {
+        const T* cw = table.context(k);
+        T score = 0;
+        for (size_t j = 0; j < W; ++j) score += cw[offset[j]];
+        pp[k] = table.bias(k) + score;
+    }
+    NormalizePosteriors(pp, table.size());
+}
+
+// Returns the score of the first 'n' counts in count profile row 'x' under
+// context weights 'w'.
+template<class T>
+inline T ColumnScore(const T* w, const double* x, size_t n) {
+    T score = 0;
+    for (size_t a = 0; a < n; ++a) score += w[a] * static_cast<T>(x[a]);
+    return score;
+}
+
+// Double precision weights are aligned rows of the CRF context profiles, so
+// that weights and counts are both read with aligned vector loads.
+inline double ColumnScore(const double* w, const double* x, size_t n) {
+    return RowDot(w, x, n);
+}
+
+// Posterior kernel for count profile windows of W columns over an alphabet of
+// size A that lie entirely within 'cp'.
+template<size_t W, size_t A, class Abc, class T>
+void FixedPosteriors(const CrfTable<Abc, T>& table,
+                     const CountProfile<Abc>& cp,
+                     size_t idx,
+                     T* pp) {
+    const size_t stride = table.stride();
+    const size_t beg = idx - (W - 1) / 2;
+    const double* x[W];
+    for (size_t j = 0; j < W; ++j) x[j] = cp.counts[beg + j];
+    for (size_t k = 0; k < table.size(); ++k) {
+        const T* cw = table.context(k);
+        T score = 0;
+        for (size_t j = 0; j < W; ++j)
+            score += ColumnScore(cw + j * stride, x[j], A);
+        pp[k] = table.bias(k) + score;
+    }
+    NormalizePosteriors(pp, table.size());
+}
+
+// Calculates posterior probabilities pp[k] of all states given the sequence
+// window centered at index 'idx' in 'seq'.
+template<class Abc, class T>
+void CalculatePosteriors(const CrfTable<Abc, T>& table,
+                         const Sequence<Abc>& seq,
+                         size_t idx,
+                         T* pp) {
+    if (table.fixed() && IsFullWindow(idx, seq.length(), table.wlen())) {
+        FixedPosteriors<KernelShape<Abc>::kWlen>(table, seq, idx, pp);
+        return;
+    }
+    const size_t center = table.center();
+    const size_t beg = MAX(0, static_cast<int>(idx - center));
+    const size_t end = MIN(seq.length(), idx + center + 1);
+    for (size_t k = 0; k < table.size(); ++k) {
+        const T* cw = table.context(k);
+        T score = 0;
+        for(size_t i = beg, j = beg - idx + center; i < end; ++i, ++j)
+            score += cw[j * table.stride() + seq[i]];
+        pp[k] = table.bias(k) + score;
+    }
+    NormalizePosteriors(pp, table.size());
+}
+
+// Calculates posterior probabilities pp[k] of all states given the count
+// profile window centered at index 'idx' in 'cp'.
+template<class Abc, class T>
+void CalculatePosteriors(const CrfTable<Abc, T>& table,
+                         const CountProfile<Abc>& cp,
+                         size_t idx,
+                         T* pp) {
+    if (table.fixed() && IsFullWindow(idx, cp.counts.length(), table.wlen())) {
+        FixedPosteriors<KernelShape<Abc>::kWlen, KernelShape<Abc>::kSize>(table, cp, idx, pp);
+        return;
+    }
+    const size_t center = table.center();
+    const size_t beg = MAX(0, static_cast<int>(idx - center));
+    const size_t end = MIN(cp.counts.length(), idx + center + 1);
+    for (size_t k = 0; k < table.size(); ++k) {
+        const T* cw = table.context(k);
+        T score = 0;
+        for(size_t i = beg, j = beg - idx + center; i < end; ++i, ++j)
+            score += ColumnScore(cw + j * table.stride(), cp.counts[i], Abc::kSize);
+        pp[k] = table.bias(k) + score;
+    }
+    NormalizePosteriors(pp, table.size());
+}
+
+// Calculates the pseudocount vector P(a|X) = sum_k pp[k] * pc_k[a] in double
+// precision.
+template<class Abc, class T>
+void PredictPseudocounts(const CrfTable<Abc, T>& table, const T* pp, double* pa) {
+    for (size_t a = 0; a < Abc::kSize; ++a) pa[a] = 0.0;
+    for (size_t k = 0; k < table.size(); ++k) {
+        const T* pc = table.pc(k);
+        const double ppk = pp[k];
+        for (size_t a = 0; a < Abc::kSize; ++a)
+            pa[a] += ppk * pc[a];
+    }
+}
+
+
+// Maximal deviations of CRF predictions in reduced precision from double
+// precision on a set of training pairs.
+struct PrecisionReport {
+    PrecisionReport()
+            : nsamples(0), max_pc(0.0), max_loglike(0.0), loglike(0.0), loglike_ref(0.0) {}
+
+    size_t nsamples;     // number of evaluated training pairs
+    double max_pc;       // maximal absolute deviation of a pseudocount
+    double max_loglike;  // maximal absolute deviation of a per-sample log-likelihood
+    double loglike;      // average log-likelihood in reduced precision
+    double loglike_ref;  // average log-likelihood in double precision
+};
+
+// Evaluates 'crf' on 'set' both in double precision and in scalar type T and
+// reports the deviation of pseudocounts and log-likelihoods.
+template<class T, class Abc, class TrainingPair>
+PrecisionReport ComparePrecision(const Crf<Abc>& crf,
+                                 const std::vector<TrainingPair>& set,
+                                 const SubstitutionMatrix<Abc>& sm) {
+    const CrfTable<Abc, double> ref_table(crf);
+    const CrfTable<Abc, T> table(crf);
+    const size_t center = crf.center();
+    const int nsamples = set.size();
+    PrecisionReport report;
+    report.nsamples = nsamples;
+    double loglike = 0.0, loglike_ref = 0.0;
+
+#pragma omp parallel
+    {
+        Vector<double> pp_ref(crf.size());
+        Vector<T> pp(crf.size());
+        Vector<double> pa_ref(Abc::kSize), pa(Abc::kSize);
+        double max_pc = 0.0, max_loglike = 0.0;
+
+#pragma omp for schedule(static) reduction(+:loglike,loglike_ref)
+        for (int n = 0; n < nsamples; ++n) {
+            CalculatePosteriors(ref_table, set[n].x, center, &pp_ref[0]);
+            PredictPseudocounts(ref_table, &pp_ref[0], &pa_ref[0]);
+            CalculatePosteriors(table, set[n].x, center, &pp[0]);
+            PredictPseudocounts(table, &pp[0], &pa[0]);
+
+            double ll_ref = 0.0, ll = 0.0;
+            for (size_t a = 0; a < Abc::kSize; ++a) {
+                max_pc = MAX(max_pc, fabs(pa[a] - pa_ref[a]));
+                ll_ref += set[n].y[a] * (log(MAX(DBL_MIN, pa_ref[a])) - log(sm.p(a)));
+                ll     += set[n].y[a] * (log(MAX(DBL_MIN, pa[a])) - log(sm.p(a)));
+            }
+            max_loglike = MAX(max_loglike, fabs(ll - ll_ref));
+            loglike += ll;
+            loglike_ref += ll_ref;
+        }
+#pragma omp critical (precision_report)
+        {
+            report.max_pc = MAX(report.max_pc, max_pc);
+            report.max_loglike = MAX(report.max_loglike, max_loglike);
+        }
+    }
+    if (nsamples > 0) {
+        report.loglike = loglike / nsamples;
+        report.loglike_ref = loglike_ref / nsamples;
+    }
+    return report;
+}
+
+}  // namespace cs
+
+#endif  // CS_CRF_KERNELS_H_
@@ -24,88 +24,64 @@
 
 namespace cs {
 
-template<class Abc>
-CrfPseudocounts<Abc>::CrfPseudocounts(const Crf<Abc>& crf) : crf_(crf) {}
+template<class Abc, class T>
+CrfPseudocounts<Abc, T>::CrfPseudocounts(const Crf<Abc>& crf) : crf_(crf), table_(crf), cache_(NULL) {}
 
-template<class Abc>
-void CrfPseudocounts<Abc>::AddToSequence(const Sequence<Abc>& seq, Profile<Abc>& p) const {
+template<class Abc, class T>
+void CrfPseudocounts<Abc, T>::AddToSequence(const Sequence<Abc>& seq, Profile<Abc>& p) const {
   assert_eq(seq.length(), p.length());
   LOG(INFO) << "Adding CRF pseudocounts to sequence ...";
 
-  const size_t center = crf_.center();
-  Matrix<double> pp(seq.length(), crf_.size(), 0.0);  // posterior probabilities
   int len = static_cast<int>(seq.length());
 
-  // Calculate and add pseudocounts for each sequence window X_i separately
-#pragma omp parallel for schedule(static)
-  for (int i = 0; i < len; ++i) {
-    double* ppi = &pp[i][0];
-
-    // Calculate posterior probability ppi[k] of state k given sequence window
-    // around position 'i'
-    double max = -DBL_MAX;
-    for (size_t k = 0; k < crf_.size(); ++k) {
-      ppi[k] = crf_[k].bias_weight +
-        ContextScore(crf_[k].context_weights, seq, i, center);
-      if (ppi[k] > max)
-        max = ppi[k];  // needed for log-sum-exp trick
+  // Calculate and add pseudocounts for each sequence window X_i separately.
+  // Posteriors are only needed per window, so that each thread reuses one
+  // buffer and memory does not grow with the query length.
+#pragma omp parallel
+  {
+    Vector<T> pp(table_.size(), T(0));  // posterior probabilities
+    std::string key;
+
+#pragma omp for schedule(static)
+    for (int i = 0; i < len; ++i) {
+      double* pc = p[i];
+      if (cache_) {
+        ContextCache<Abc>::MakeKey(seq, i, crf_.wlen(), &key);
+        if (cache_->Lookup(key, pc)) continue;
+      }
+      // Calculate posterior probability pp[k] of state k given sequence window
+      // around position 'i'
+      CalculatePosteriors(table_, seq, i, &pp[0]);
+      // Calculate pseudocount vector P(a|X_i)
+      PredictPseudocounts(table_, &pp[0], pc);
+      Normalize(&pc[0], Abc::kSize);
+      if (cache_) cache_->Insert(key, pc);
     }
-
-    // Log-sum-exp trick begins here
-    double sum = 0.0;
-    for (size_t k = 0; k < crf_.size(); ++k)
-      sum += exp(ppi[k] - max);
-    double tmp = max + log(sum);
-    // Calculate pseudocount vector P(a|X_i)
-    double* pc = p[i];
-    for (size_t a = 0; a < Abc::kSize; ++a) pc[a] = 0.0;
-    for (size_t k = 0; k < crf_.size(); ++k) {
-      ppi[k] = exp(ppi[k] - tmp);
-      for(size_t a = 0; a < Abc::kSize; ++a)
-        pc[a] += ppi[k] * crf_[k].pc[a];
-    }
-    Normalize(&pc[0], Abc::kSize);
   }
 }
 
-template<class Abc>
-void CrfPseudocounts<Abc>::AddToProfile(const CountProfile<Abc>& cp, Profile<Abc>& p) const {
+template<class Abc, class T>
+void CrfPseudocounts<Abc, T>::AddToProfile(const CountProfile<Abc>& cp, Profile<Abc>& p) const {
   assert_eq(cp.counts.length(), p.length());
   LOG(INFO) << "Adding library pseudocounts to profile ...";
 
-  const size_t center = crf_.center();
-  Matrix<double> pp(cp.counts.length(), crf_.size(), 0.0);  // posterior probs
   int len = static_cast<int>(cp.length());
 
-  // Calculate and add pseudocounts for each sequence window X_i separately
-#pragma omp parallel for schedule(static)
-  for (int i = 0; i < len; ++i) {
-    double* ppi = &pp[i][0];
-
-    // Calculate posterior probability ppi[k] of state k given sequence window
-    // around position 'i'
-    double max = -DBL_MAX;
-    for (size_t k = 0; k < crf_.size(); ++k) {
-      ppi[k] = crf_[k].bias_weight +
-        ContextScore(crf_[k].context_weights, cp, i, center);
-      if (ppi[k] > max)
-        max = ppi[k];  // needed for log-sum-exp trick
-    }
-
-     // Log-sum-exp trick begins here
-    double sum = 0.0;
-    for (size_t k = 0; k < crf_.size(); ++k)
-      sum += exp(ppi[k] - max);
-    double tmp = max + log(sum);
-    // Calculate pseudocount vector P(a|X_i)
-    double* pc = p[i];
-    for (size_t a = 0; a < Abc::kSize; ++a) pc[a] = 0.0;
-    for (size_t k = 0; k < crf_.size(); ++k) {
-      ppi[k] = exp(ppi[k] - tmp);
-      for(size_t a = 0; a < Abc::kSize; ++a)
-        pc[a] += ppi[k] * crf_[k].pc[a];
+  // Calculate and add pseudocounts for each profile window X_i separately
+#pragma omp parallel
+  {
+    Vector<T> pp(table_.size(), T(0));  // posterior probabilities
+
+#pragma omp for schedule(static)
+    for (int i = 0; i < len; ++i) {
+      // Calculate posterior probability pp[k] of state k given count profile
+      // window around position 'i'
+      CalculatePosteriors(table_, cp, i, &pp[0]);
+      // Calculate pseudocount vector P(a|X_i)
+      double* pc = p[i];
+      PredictPseudocounts(table_, &pp[0], pc);
+      Normalize(&pc[0], Abc::kSize);
     }
-    Normalize(&pc[0], Abc::kSize);  
   }
 }
 
@@ -20,20 +20,24 @@
 #ifndef CS_CRF_PSEUDOCOUNTS_H_
 #define CS_CRF_PSEUDOCOUNTS_H_
 
+#include "context_cache.h"
 #include "count_profile-inl.h"
 #include "emission.h"
 #include "profile-inl.h"
 #include "pseudocounts-inl.h"
 #include "sequence-inl.h"
 #include "crf-inl.h"
+#include "crf_kernels.h"
 
 namespace cs {
 
-// Encapsulation of context-specific pseudocounts calculated from a context CRF
-template<class Abc>
+// Encapsulation of context-specific pseudocounts calculated from a context CRF.
+// CRF weights and posteriors are held in scalar type T; use T=float for a single
+// precision path with half the memory traffic.
+template<class Abc, class T = double>
 class CrfPseudocounts : public Pseudocounts<Abc> {
  public:
-  CrfPseudocounts(const Crf<Abc>& lib);
+  CrfPseudocounts(const Crf<Abc>& crf);
 
   virtual ~CrfPseudocounts() {}
 
@@ -41,9 +45,19 @@ class CrfPseudocounts : public Pseudocounts<Abc> {
 
   virtual void AddToProfile(const CountProfile<Abc>& cp, Profile<Abc>& p) const;
 
+  virtual size_t ContextLength() const { return crf_.wlen(); }
+
+  // Shares cache 'cache' of pseudocount columns of sequence windows, or turns
+  // caching off if NULL. The cache must outlive this object.
+  void set_cache(ContextCache<Abc>* cache) { cache_ = cache; }
+
  private:
   // CRF with context weights and pseudocount emission weights.
   const Crf<Abc>& crf_;
+  // CRF weights in scalar type T, a view of 'crf_' for T=double.
+  const CrfTable<Abc, T> table_;
+  // Cache of pseudocount columns shared across queries (not owned).
+  ContextCache<Abc>* cache_;
 
   DISALLOW_COPY_AND_ASSIGN(CrfPseudocounts);
 };  // CrfPseudocounts
@@ -21,6 +21,7 @@
 #define CS_CONTEXT_WEIGHT_STATE_INL_H_
 
 #include "crf_state.h"
+#include "kernel_shape.h"
 
 namespace cs {
 
@@ -163,6 +164,14 @@ inline double ContextScore(const Profile<Abc>& context_weights,
                            size_t idx,
                            size_t center) {
     assert(context_weights.length() & 1);
+    const size_t W = KernelShape<Abc>::kWlen;
+    if (HasFixedKernel<Abc>(context_weights.length()) &&
+        IsFullWindow(idx, seq.length(), W)) {
+        const typename Sequence<Abc>::value_type* x = &seq[idx - (W - 1) / 2];
+        double score = 0.0;
+        for (size_t j = 0; j < W; ++j) score += context_weights[j][x[j]];
+        return score;
+    }
     const size_t beg = MAX(0, static_cast<int>(idx - center));
     const size_t end = MIN(seq.length(), idx + center + 1);
     double score = 0.0;
@@ -178,13 +187,21 @@ inline double ContextScore(const Profile<Abc>& context_weights,
                            size_t idx,
                            size_t center) {
     assert(context_weights.length() & 1);
+    const size_t W = KernelShape<Abc>::kWlen;
+    const size_t A = KernelShape<Abc>::kSize;
+    if (HasFixedKernel<Abc>(context_weights.length()) &&
+        IsFullWindow(idx, cp.counts.length(), W)) {
+        const size_t beg = idx - (W - 1) / 2;
+        double score = 0.0;
+        for (size_t j = 0; j < W; ++j)
+            score += RowDot(context_weights[j], cp.counts[beg + j], A);
+        return score;
+    }
     const size_t beg = MAX(0, static_cast<int>(idx - center));
     const size_t end = MIN(cp.counts.length(), idx + center + 1);
     double score = 0.0;
-    for(size_t i = beg, j = beg - idx + center; i < end; ++i, ++j) {
-        for (size_t a = 0; a < Abc::kSize; ++a)
-            score += context_weights[j][a] * cp.counts[i][a];
-    }
+    for(size_t i = beg, j = beg - idx + center; i < end; ++i, ++j)
+        score += RowDot(context_weights[j], cp.counts[i], Abc::kSize);
     return score;
 }
 
@@ -2,6 +2,7 @@
 
 #include "cs.h"
 #include "blosum_matrix.h"
+#include "tamura_nei_matrix.h"
 #include "crf-inl.h"
 #include "matrix_pseudocounts-inl.h"
 #include "training_sequence.h"
@@ -209,6 +210,237 @@ TEST_F(CrfTestInit, DISABLED_LibraryCrfInit) {
   }
 }
 
+TEST_F(CrfTestInit, SinglePrecisionPseudocounts) {
+  const double kDeltaFloat = 1e-4;
+  BlosumMatrix m;
+  GaussianCrfInit<AA> init(0.5, m, 0);
+  Crf<AA> crf(50, 13, init);
+
+  Ran ran(0);
+  ConstantAdmix admix(1.0);
+  CrfPseudocounts<AA> pc(crf);
+  CrfPseudocounts<AA, float> pc_float(crf);
+  vector<TrainingSequence<AA> > tset;
+  for (size_t s = 0; s < 10; ++s) {
+    Sequence<AA> seq(50);
+    for (size_t i = 0; i < seq.length(); ++i)
+      seq[i] = static_cast<size_t>(ran(AA::kSize));
+    Profile<AA> prof = pc.AddTo(seq, admix);
+    Profile<AA> prof_float = pc_float.AddTo(seq, admix);
+    for (size_t i = 0; i < seq.length(); ++i)
+      for (size_t a = 0; a < AA::kSize; ++a)
+        EXPECT_NEAR(prof[i][a], prof_float[i][a], kDeltaFloat);
+
+    Sequence<AA> window(crf.wlen());
+    for (size_t i = 0; i < crf.wlen(); ++i) window[i] = seq[i];
+    tset.push_back(TrainingSequence<AA>(window, ProfileColumn<AA>(prof[crf.center()])));
+  }
+
+  PrecisionReport r = ComparePrecision<float>(crf, tset, m);
+  EXPECT_EQ(tset.size(), r.nsamples);
+  EXPECT_LT(r.max_pc, kDeltaFloat);
+  EXPECT_LT(r.max_loglike, kDeltaFloat);
+  EXPECT_NEAR(r.loglike_ref, r.loglike, kDeltaFloat);
+}
+
+TEST_F(CrfTestInit, FixedShapeKernelsEqualGenericLoops) {
+  BlosumMatrix m;
+  GaussianCrfInit<AA> init(0.5, m, 0);
+  Crf<AA> crf(20, 13, init);
+  const CrfTable<AA, double> table(crf);
+  EXPECT_TRUE(table.fixed());
+  EXPECT_FALSE(HasFixedKernel<AA>(11));
+
+  Ran ran(0);
+  Sequence<AA> seq(30);
+  for (size_t i = 0; i < seq.length(); ++i)
+    seq[i] = static_cast<size_t>(ran(AA::kSize));
+  CountProfile<AA> cp(seq);
+  Vector<double> pp(crf.size()), pp_cp(crf.size()), ref(crf.size()), ref_cp(crf.size());
+
+  for (size_t i = 0; i < seq.length(); ++i) {
+    CalculatePosteriors(table, seq, i, &pp[0]);
+    CalculatePosteriors(table, cp, i, &pp_cp[0]);
+    for (size_t k = 0; k < crf.size(); ++k) {
+      ref[k] = ref_cp[k] = crf[k].bias_weight;
+      for (size_t j = 0; j < crf.wlen(); ++j) {
+        const int l = static_cast<int>(i + j) - static_cast<int>(crf.center());
+        if (l < 0 || l >= static_cast<int>(seq.length())) continue;
+        ref[k] += crf[k].context_weights[j][seq[l]];
+        for (size_t a = 0; a < AA::kSize; ++a)
+          ref_cp[k] += crf[k].context_weights[j][a] * cp.counts[l][a];
+      }
+    }
+    NormalizePosteriors(&ref[0], crf.size());
+    NormalizePosteriors(&ref_cp[0], crf.size());
+    for (size_t k = 0; k < crf.size(); ++k) {
+      EXPECT_NEAR(ref[k], pp[k], kDeltaTiny);
+      EXPECT_NEAR(ref_cp[k], pp_cp[k], kDeltaTiny);
+    }
+  }
+}
+
+TEST_F(CrfTestInit, FixedShapeKernelsOfDnaWindows) {
+  TamuraNeiMatrix m;
+  GaussianCrfInit<Dna> init(0.5, m, 0);
+  Crf<Dna> crf(30, 9, init);
+  const CrfTable<Dna, double> table(crf);
+  const CrfTable<Dna, float> table_float(crf);
+  EXPECT_TRUE(table.fixed());
+  EXPECT_TRUE(table_float.fixed());
+  EXPECT_EQ(crf[0].context_weights[0], table.context(0));
+
+  Ran ran(0);
+  Sequence<Dna> seq(25);
+  for (size_t i = 0; i < seq.length(); ++i)
+    seq[i] = static_cast<size_t>(ran(Dna::kSize));
+  CountProfile<Dna> cp(seq);
+  Vector<double> pp(crf.size()), pp_cp(crf.size()), ref(crf.size()), ref_cp(crf.size());
+  Vector<float> pp_float(crf.size());
+
+  for (size_t i = 0; i < seq.length(); ++i) {
+    CalculatePosteriors(table, seq, i, &pp[0]);
+    CalculatePosteriors(table, cp, i, &pp_cp[0]);
+    CalculatePosteriors(table_float, seq, i, &pp_float[0]);
+    for (size_t k = 0; k < crf.size(); ++k) {
+      ref[k] = ref_cp[k] = crf[k].bias_weight;
+      for (size_t j = 0; j < crf.wlen(); ++j) {
+        const int l = static_cast<int>(i + j) - static_cast<int>(crf.center());
+        if (l < 0 || l >= static_cast<int>(seq.length())) continue;
+        ref[k] += crf[k].context_weights[j][seq[l]];
+        for (size_t a = 0; a < Dna::kSize; ++a)
+          ref_cp[k] += crf[k].context_weights[j][a] * cp.counts[l][a];
+      }
+    }
+    NormalizePosteriors(&ref[0], crf.size());
+    NormalizePosteriors(&ref_cp[0], crf.size());
+    for (size_t k = 0; k < crf.size(); ++k) {
+      EXPECT_NEAR(ref[k], pp[k], kDeltaTiny);
+      EXPECT_NEAR(ref_cp[k], pp_cp[k], kDeltaTiny);
+      EXPECT_NEAR(ref[k], pp_float[k], 1e-4);
+    }
+  }
+}
+
+// Collects chunks emitted by AddToChunked into a full-length profile.
+struct ChunkCollector {
+  ChunkCollector(size_t len) : prof(len), nchunks(0) {}
+
+  void operator() (const Profile<AA>& p, size_t offset) {
+    for (size_t i = 0; i < p.length(); ++i)
+      for (size_t a = 0; a < AA::kSizeAny; ++a)
+        prof[offset + i][a] = p[i][a];
+    ++nchunks;
+  }
+
+  Profile<AA> prof;
+  size_t nchunks;
+};
+
+TEST_F(CrfTestInit, ChunkedPseudocountsEqualFullSequence) {
+  BlosumMatrix m;
+  GaussianCrfInit<AA> init(0.5, m, 0);
+  Crf<AA> crf(50, 13, init);
+  CrfPseudocounts<AA> pc(crf);
+  ConstantAdmix admix(0.9);
+
+  Ran ran(0);
+  Sequence<AA> seq(100);
+  for (size_t i = 0; i < seq.length(); ++i)
+    seq[i] = static_cast<size_t>(ran(AA::kSize));
+  Profile<AA> prof = pc.AddTo(seq, admix);
+
+  ChunkCollector chunked(seq.length());
+  pc.AddToChunked(seq, admix, 17, chunked);
+  EXPECT_EQ(6u, chunked.nchunks);
+  for (size_t i = 0; i < seq.length(); ++i)
+    for (size_t a = 0; a < AA::kSizeAny; ++a)
+      EXPECT_EQ(prof[i][a], chunked.prof[i][a]);
+}
+
+TEST_F(CrfTestInit, IncrementalPseudocountsEqualFullProfile) {
+  BlosumMatrix m;
+  GaussianCrfInit<AA> init(0.5, m, 0);
+  Crf<AA> crf(50, 13, init);
+  CrfPseudocounts<AA> pc(crf);
+  CSBlastAdmix admix(0.9, 12.0);
+
+  Ran ran(0);
+  CountProfile<AA> cp(100);
+  for (size_t i = 0; i < cp.length(); ++i) {
+    for (size_t a = 0; a < AA::kSize; ++a)
+      cp.counts[i][a] = ran.doub();
+    cp.neff[i] = 1.0 + 5.0 * ran.doub();
+  }
+
+  PseudocountsState<AA> state;
+  pc.AddTo(cp, admix, state);
+  EXPECT_EQ(100u, state.ncomputed);
+
+  // Change two columns; only columns whose windows overlap them are recomputed
+  cp.counts[50][3] += 1.0;
+  cp.neff[52] += 1.0;
+  Profile<AA> full = pc.AddTo(cp, admix);
+  Profile<AA> incr = pc.AddTo(cp, admix, state);
+  const size_t radius = (crf.wlen() - 1) / 2;
+  EXPECT_EQ(radius + 3u + radius, state.ncomputed);
+  for (size_t i = 0; i < cp.length(); ++i)
+    for (size_t a = 0; a < AA::kSizeAny; ++a)
+      EXPECT_EQ(full[i][a], incr[i][a]);
+
+  pc.AddTo(cp, admix, state);
+  EXPECT_EQ(0u, state.ncomputed);
+}
+
+TEST_F(CrfTestInit, CachedPseudocountsEqualUncached) {
+  BlosumMatrix m;
+  GaussianCrfInit<AA> init(0.5, m, 0);
+  Crf<AA> crf(50, 13, init);
+  CrfPseudocounts<AA> pc(crf);
+  ConstantAdmix admix(0.9);
+
+  // Sequence made of three copies of the same 40-residue repeat
+  Ran ran(0);
+  Sequence<AA> seq(120);
+  for (size_t i = 0; i < 40; ++i)
+    seq[i] = seq[i + 40] = seq[i + 80] = static_cast<size_t>(ran(AA::kSize));
+  Profile<AA> prof = pc.AddTo(seq, admix);
+
+  ContextCache<AA> cache(1000);
+  pc.set_cache(&cache);
+  Profile<AA> cached = pc.AddTo(seq, admix);
+  for (size_t i = 0; i < seq.length(); ++i)
+    for (size_t a = 0; a < AA::kSizeAny; ++a)
+      EXPECT_EQ(prof[i][a], cached[i][a]);
+  // 40 distinct full windows plus 12 windows overlapping the sequence ends
+  EXPECT_EQ(120u, cache.hits() + cache.misses());
+  EXPECT_EQ(52u, cache.size());
+
+  // Second query is served entirely from the cache
+  const size_t hits = cache.hits();
+  cached = pc.AddTo(seq, admix);
+  EXPECT_EQ(hits + 120u, cache.hits());
+
+  ContextCache<AA> small(10);
+  pc.set_cache(&small);
+  cached = pc.AddTo(seq, admix);
+  // A small cache is a single LRU list that fills up to its capacity
+  EXPECT_EQ(10u, small.capacity());
+  EXPECT_EQ(10u, small.size());
+  for (size_t i = 0; i < seq.length(); ++i)
+    for (size_t a = 0; a < AA::kSizeAny; ++a)
+      EXPECT_EQ(prof[i][a], cached[i][a]);
+
+  // Shards of a larger cache together hold exactly its capacity
+  ContextCache<AA> sharded(1000);
+  pc.set_cache(&sharded);
+  Sequence<AA> longseq(3000);
+  for (size_t i = 0; i < longseq.length(); ++i)
+    longseq[i] = static_cast<size_t>(ran(AA::kSize));
+  pc.AddTo(longseq, admix);
+  EXPECT_EQ(1000u, sharded.size());
+}
+
 TEST_F(CrfTestInit, LibToCrf) {
   const double wcenter = 1.6;
   const double wdecay  = 0.85;
@@ -30,8 +30,24 @@ namespace cs {
 
 typedef std::map<char, std::string> CSBlastOptions;
 
+// Interface of the database search engines driven by CS-BLAST.
+class SearchEngine {
+ public:
+  virtual ~SearchEngine() {}
+
+  // Runs one search iteration with the current PSSM, writes results to 'fout'
+  // and returns found hits in BlastHits object if 'hits' is not NULL.
+  virtual int Run(FILE* fout, BlastHits* hits = NULL) = 0;
+
+  // Sets position specific scoring matrix
+  virtual void set_pssm(const Pssm* pssm) = 0;
+
+  // Sets command line options of the search
+  virtual void set_options(const CSBlastOptions& opts) = 0;
+};
+
 // Encapsulation of database searching with PSI-BLAST.
-class CSBlast {
+class CSBlast : public SearchEngine {
  public:
   // Constructor to compare a single sequence against a database of protein
   // sequences.
@@ -49,7 +65,7 @@ class CSBlast {
 
   // Runs one iteration of PSI-BLAST with cs-PSSM and returns found hits
   // in BlastHits object. Works for alignment format "-m 0" only!
-  int Run(FILE* fout, BlastHits* hits = NULL);
+  virtual int Run(FILE* fout, BlastHits* hits = NULL);
 
   // Sets path to PSI-BLAST executable.
   void set_exec_path(std::string exec_path) {
@@ -61,10 +77,10 @@ class CSBlast {
   std::string exec_path() const { return exec_path_; }
 
   // Sets position specific scoring matrix
-  void set_pssm(const Pssm* pssm) { pssm_ = pssm; }
+  virtual void set_pssm(const Pssm* pssm) { pssm_ = pssm; }
 
   // Sets command line options for PSI-BLAST
-  void set_options(const CSBlastOptions& opts) { opts_ = opts; }
+  virtual void set_options(const CSBlastOptions& opts) { opts_ = opts; }
 
   // Sets BLAST call emulation
   void set_emulate(bool emulate = true) { emulate_ = emulate; }
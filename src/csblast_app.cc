@@ -20,6 +20,7 @@
 #include "cs.h"
 #include "alignment-inl.h"
 #include "application.h"
+#include "as_search.h"
 #include "blast_hits.h"
 #include "blosum_matrix.h"
 #include "context_library.h"
@@ -32,7 +33,10 @@
 #include "library_pseudocounts-inl.h"
 #include "matrix_pseudocounts-inl.h"
 #include "pssm.h"
+#include "psiblast_plus.h"
+#include "pssm_cache.h"
 #include "sequence-inl.h"
+#include "sw_search.h"
 
 using namespace GetOpt;
 using std::string;
@@ -53,14 +57,22 @@ struct CSBlastAppOptions {
     pc_neff         = 0.0;
     pc_engine       = "auto";
     global_weights  = false;
+    pc_float        = false;
+    pc_cache        = 0;
     weight_center   = 1.6;
     weight_decay    = 0.85;
     iterations      = 1;
     inclusion       = 0.002;
     best            = false;
+    filter_id       = 0.0;
+    filter_cov      = 0.0;
+    filter_diff     = 0;
     ndescr          = 500;
     nalis           = 250;
     emulate         = false;
+    search_engine   = "blast";
+    no_prefilter    = false;
+    as_candidates   = 1000;
     shift           = -0.005;
     // penalty_alpha       = 0.0;
     // penalty_beta        = 0.1;
@@ -75,6 +87,21 @@ struct CSBlastAppOptions {
     if (pc_admix <= 0 || pc_admix > 1.0) throw Exception("Pseudocounts admix invalid!");
     if (pc_neff < 1.0 && pc_neff != 0.0) 
       throw Exception("Target Neff for pseudocounts admixture invalid!");
+    if (search_engine != "blast" && search_engine != "psiblast" && search_engine != "sw" &&
+        search_engine != "as")
+      throw Exception("Unknown search engine '%s'!", search_engine.c_str());
+    if (search_engine == "as" && as_matrixfile.empty())
+      throw Exception("Abstract state search needs an abstract state matrix!");
+    if (search_engine == "as" && iterations > 1)
+      throw Exception("Abstract state search supports only one iteration!");
+    if (as_candidates < 1)
+      throw Exception("Number of abstract state search candidates must be at least 1!");
+    if (filter_id < 0.0 || filter_id > 100.0)
+      throw Exception("Maximal pairwise identity must be between 0 and 100!");
+    if (filter_cov < 0.0 || filter_cov > 100.0)
+      throw Exception("Minimal coverage must be between 0 and 100!");
+    if (filter_diff < 0)
+      throw Exception("Number of diverse sequences per block must not be negative!");
   }
 
   // The input alignment file with training data.
@@ -99,6 +126,12 @@ struct CSBlastAppOptions {
   string pc_engine;
   // Use global instead of position specific weights for sequence weighting.
   bool global_weights;
+  // Compute CRF pseudocounts in single precision.
+  bool pc_float;
+  // Number of CRF pseudocount columns to cache across queries (0 = off).
+  size_t pc_cache;
+  // Directory for caching query PSSMs across runs
+  string pssm_cache;
   // Path to PSI-BLAST executable
   string blast_path;
   // Maximum number of iterations to use in CSI-BLAST
@@ -107,6 +140,15 @@ struct CSBlastAppOptions {
   double inclusion;
   // Include only the best HSP per hit in alignment
   bool best;
+  // Maximal pairwise identity in percent of alignment sequences used for
+  // profile construction (0 = no filter)
+  double filter_id;
+  // Minimal coverage of query in percent of alignment sequences used for
+  // profile construction
+  double filter_cov;
+  // Number of most diverse alignment sequences to keep in each block of 50
+  // columns for profile construction (0 = no diversity filter)
+  int filter_diff;
   // Weight of central column in multinomial emission
   double weight_center;
   // Exponential decay of window weights
@@ -117,6 +159,17 @@ struct CSBlastAppOptions {
   int nalis;
   // Emulate BLAST call
   bool emulate;
+  // Search engine: blastpgp, BLAST+ psiblast, in-process Smith-Waterman or
+  // abstract state search
+  string search_engine;
+  // Abstract state matrix for abstract state search
+  string as_matrixfile;
+  // Context library on query side of the abstract state matrix
+  string as_contextsfile;
+  // Number of k-mer index candidates to align in abstract state search
+  int as_candidates;
+  // Align all database sequences in in-process search
+  bool no_prefilter;
   // Substitution score offset
   double shift;
   // Baseline penalty for adjusting E-values.
@@ -152,6 +205,12 @@ class CSBlastApp : public Application {
   void SaveAlignment() const;
   // Add pseudocounts and prepares CS-BLAST engine for run with given query
   void PrepareForRun(const Sequence<AA>& query);
+  // Returns the PSSM cache key of given query and the pseudocount settings
+  string PssmCacheKey(const Sequence<AA>& query) const;
+  // Returns true if any of the alignment filter options is set
+  bool FilterEnabled() const;
+  // Removes redundant sequences from alignment if the filter is enabled
+  void FilterAlignment(Alignment<AA>& ali) const;
 
   // Default number of one-line descriptions and alignments in BLAST output.
   // This should be large enough to ensure that the BLAST output parser can
@@ -166,16 +225,35 @@ class CSBlastApp : public Application {
   scoped_ptr<ContextLibrary<AA> > lib_;
   // CRF for pseudocounts
   scoped_ptr<Crf<AA> > crf_;
+  // Cache of CRF pseudocount columns shared across queries
+  scoped_ptr<ContextCache<AA> > pc_cache_;
   // Pseudocount engine
   scoped_ptr<Pseudocounts<AA> > pc_;
+  // Pseudocounts of the last CSI-BLAST iteration
+  PseudocountsState<AA> pc_state_;
+  // On-disk cache of query PSSMs
+  scoped_ptr<PssmCache<AA> > pssm_cache_;
+  // Hash of the context model file for PSSM cache keys
+  string model_hash_;
   // PSI-BLAST engine
-  scoped_ptr<CSBlast> csblast_;
+  scoped_ptr<SearchEngine> csblast_;
   // PSSM for PSI-BLAST jumpstarting
   scoped_ptr<Pssm> pssm_;
   // Alignment of included sequences
   scoped_ptr<Alignment<AA> > ali_;
   // Vector with pointers to query sequences
   SeqVec queries_;
+  // Sequence database for in-process search
+  scoped_ptr<SequenceDb<AA> > db_;
+  // Abstract state database, matrix and contexts for abstract state search
+  scoped_ptr<SequenceDb<AS219> > as_db_;
+  scoped_ptr<AbstractStateMatrix<AS219> > as_matrix_;
+  scoped_ptr<ContextLibrary<AA> > as_contexts_;
+  scoped_ptr<KmerIndex<AS219> > as_index_;
+  // Abstract state frequencies of the database shared by all queries
+  vector<double> as_freqs_;
+  // Karlin-Altschul statistics shared by the PSSMs of all queries
+  KarlinAltschulCache ka_cache_;
   // Repeat penalizer
   // scoped_ptr<RepeatPenalizer<AA> > penalizer_;
 };  // class CSBlastApp
@@ -201,9 +279,20 @@ void CSBlastApp::ParseOptions(GetOpt_pp& ops) {
   ops >> Option(' ', "weight-decay", opts_.weight_decay, opts_.weight_decay);
   ops >> Option(' ', "blast-path", opts_.blast_path, opts_.blast_path);
   ops >> Option(' ', "shift", opts_.shift, opts_.shift);
+  ops >> Option(' ', "pc-cache", opts_.pc_cache, opts_.pc_cache);
+  ops >> Option(' ', "pssm-cache", opts_.pssm_cache, opts_.pssm_cache);
+  ops >> Option(' ', "search-engine", opts_.search_engine, opts_.search_engine);
+  ops >> Option(' ', "as-matrix", opts_.as_matrixfile, opts_.as_matrixfile);
+  ops >> Option(' ', "as-contexts", opts_.as_contextsfile, opts_.as_contextsfile);
+  ops >> Option(' ', "as-candidates", opts_.as_candidates, opts_.as_candidates);
   ops >> OptionPresent(' ', "emulate", opts_.emulate);
   ops >> OptionPresent(' ', "global-weights", opts_.global_weights);
+  ops >> OptionPresent(' ', "pc-float", opts_.pc_float);
+  ops >> Option(' ', "filter-id", opts_.filter_id, opts_.filter_id);
+  ops >> Option(' ', "filter-cov", opts_.filter_cov, opts_.filter_cov);
+  ops >> Option(' ', "filter-diff", opts_.filter_diff, opts_.filter_diff);
   ops >> OptionPresent(' ', "best", opts_.best);
+  ops >> OptionPresent(' ', "no-prefilter", opts_.no_prefilter);
 
   // Put remaining arguments into PSI-BLAST options map
   for(GetOpt_pp::short_iterator it = ops.begin(); it != ops.end(); ++it) {
@@ -271,12 +360,37 @@ void CSBlastApp::PrintOptions() const {
           "Parameter for exponential decay of window weights", opts_.weight_decay);
   fprintf(out_, "  %-30s %s\n", "    --global-weights",
           "Use global instead of position-specific sequence weights (def=off)");
+  fprintf(out_, "  %-30s %s\n", "    --pc-float",
+          "Compute CRF pseudocounts in single precision (def=off)");
+  fprintf(out_, "  %-30s %s (def=%zu)\n", "    --pc-cache [0,inf[",
+          "Number of CRF pseudocount columns to cache across queries", opts_.pc_cache);
+  fprintf(out_, "  %-30s %s\n", "    --pssm-cache <dir>",
+          "Reuse query PSSMs cached in directory across runs (def=off)");
   fprintf(out_, "  %-30s %s\n", "    --best",
           "Include only the best HSP per hit in alignment (def=off)");
+  fprintf(out_, "  %-30s %s\n", "    --filter-id [0,100]",
+          "Maximal pairwise identity of sequences in profile alignment (def=off)");
+  fprintf(out_, "  %-30s %s (def=%-.0f)\n", "    --filter-cov [0,100]",
+          "Minimal coverage of query by sequences in profile alignment", opts_.filter_cov);
+  fprintf(out_, "  %-30s %s\n", "    --filter-diff [0,inf[",
+          "Keep the N most diverse sequences per 50 columns in profile alignment (def=off)");
   // fprintf(out_, "  %-30s %s\n", "    --emulate",
   //        "Emulate BLAST call (def=off)");
   // fprintf(out_, "  %-30s %s\n", "    --no-penalty",
   //         "Turn off score penalty for repeat regions (def=penalty on).");
+  fprintf(out_, "  %-30s %s (def=%s)\n", "    --search-engine blast|psiblast|sw|as",
+          "Search with PSI-BLAST or in-process Smith-Waterman (-d csformatdb or FASTA)",
+          opts_.search_engine.c_str());
+  fprintf(out_, "  %-30s %s\n", "",
+          "or abstract states (-d csformatdb -A)");
+  fprintf(out_, "  %-30s %s\n", "    --as-matrix <file>",
+          "Abstract state matrix for abstract state search");
+  fprintf(out_, "  %-30s %s\n", "    --as-contexts <file>",
+          "Contexts of abstract state matrix (def=context library of -D)");
+  fprintf(out_, "  %-30s %s (def=%i)\n", "    --as-candidates [1,inf[",
+          "Entries to align if the database has a k-mer index", opts_.as_candidates);
+  fprintf(out_, "  %-30s %s\n", "    --no-prefilter",
+          "Align all database sequences in in-process search (def=off)");
   fprintf(out_, "  %-30s %s\n", "    --blast-path <path>",
           "Path to directory with blastpgp executable (or set BLAST_PATH)");
   fprintf(out_, "  %-30s %s (def=%g)\n", "    --shift [-1,1]",
@@ -290,6 +404,7 @@ int CSBlastApp::Run() {
   for (SeqVec::iterator it = queries_.begin(); it != queries_.end(); ++it) {
     PrepareForRun(*it);
     CSBlastIteration itr(opts_.iterations);
+    pc_state_ = PseudocountsState<AA>();
 
     while (itr) {
       LOG(INFO) << strprintf("Starting iteration %i ...", itr.IterationNumber());
@@ -315,16 +430,29 @@ int CSBlastApp::Run() {
       if (status != 0 || opts_.iterations == 1 || opts_.emulate || hits.empty()) break;
 
       hits.Filter(opts_.inclusion);
-      if (!hits.empty() && !hits[0].hsps.empty())
-        ali_->Merge(Alignment<AA>(hits, opts_.best));
       LOG(INFO) << strprintf("Found %zu seqs in iteration %i (E-value < %5.0E)",
                              hits.size(), itr.IterationNumber(), opts_.inclusion);
       itr.Advance(hits);
+      LOG(INFO) << strprintf("%zu new and %zu lost seqs since last iteration",
+                             itr.NewHits().size(), itr.NumLostHits());
+
+      // Hits of the last iteration are already in the alignment, so only
+      // merge the new ones
+      if (!itr.NewHits().empty() && !hits[itr.NewHits()[0]].hsps.empty())
+        ali_->Merge(hits.Select(itr.NewHits()), opts_.best);
 
       if (itr) {
-        CountProfile<AA> ali_profile(*ali_, !opts_.global_weights);
+        // Redundancy filter works on a copy, so that all hits are saved
+        scoped_ptr<Alignment<AA> > filtered;
+        if (FilterEnabled()) {
+          filtered.reset(new Alignment<AA>(*ali_));
+          FilterAlignment(*filtered);
+        }
+        CountProfile<AA> ali_profile(filtered ? *filtered : *ali_, !opts_.global_weights);
         CSBlastAdmix admix(opts_.pc_admix, opts_.pc_ali);
-        pssm_.reset(new Pssm(*it, pc_->AddTo(ali_profile, admix)));
+        pssm_.reset(new Pssm(*it, pc_->AddTo(ali_profile, admix, pc_state_)));
+        LOG(INFO) << strprintf("Recomputed pseudocounts of %zu of %zu columns",
+                               pc_state_.ncomputed, ali_profile.length());
         pssm_->Shift(opts_.shift);
         csblast_->set_pssm(pssm_.get());
       }
@@ -336,6 +464,12 @@ int CSBlastApp::Run() {
       SaveAlignment();
   }
 
+  if (pc_cache_) {
+    LOG(INFO) << strprintf("Context cache: %zu hits, %zu misses (hit rate %.1f%%), %zu of %zu columns used",
+                           pc_cache_->hits(), pc_cache_->misses(), 100.0 * pc_cache_->HitRate(),
+                           pc_cache_->size(), pc_cache_->capacity());
+  }
+
   return status;
 }
 
@@ -373,12 +507,70 @@ void CSBlastApp::Init() {
     crf_.reset(new Crf<AA>(fin));
     fclose(fin);
 
-    pc_.reset(new CrfPseudocounts<AA>(*crf_));
+    if (opts_.pc_cache > 0)
+      pc_cache_.reset(new ContextCache<AA>(opts_.pc_cache));
+    if (opts_.pc_float) {
+      CrfPseudocounts<AA, float>* pc = new CrfPseudocounts<AA, float>(*crf_);
+      pc->set_cache(pc_cache_.get());
+      pc_.reset(pc);
+    } else {
+      CrfPseudocounts<AA>* pc = new CrfPseudocounts<AA>(*crf_);
+      pc->set_cache(pc_cache_.get());
+      pc_.reset(pc);
+    }
   } else {
     throw Exception("Unknown pseudocount engine '%s'!", opts_.pc_engine.c_str());
   }
   pc_->SetTargetNeff(opts_.pc_neff);
 
+  // Load FASTA database for in-process search
+  if (opts_.search_engine == "sw") {
+    CSBlastOptions::const_iterator db = opts_.csblast.find('d');
+    if (db == opts_.csblast.end())
+      throw Exception("In-process search needs a sequence database (-d)!");
+    if (SequenceDb<AA>::IsDatabase(db->second)) {
+      db_.reset(new SequenceDb<AA>(db->second));
+    } else {
+      // Convert FASTA database on the fly
+      fin = fopen(db->second.c_str(), "r");
+      if (!fin) throw Exception("Unable to read file '%s'!", db->second.c_str());
+      FILE* ftmp = tmpfile();
+      if (!ftmp) throw Exception("Unable to create temporary file!");
+      SequenceDb<AA>::Format(fin, ftmp);
+      fclose(fin);
+      db_.reset(new SequenceDb<AA>(ftmp));
+      fclose(ftmp);
+    }
+    LOG(INFO) << strprintf("Using %zu database sequences", db_->size());
+  }
+
+  // Load abstract state database, matrix and its contexts
+  if (opts_.search_engine == "as") {
+    CSBlastOptions::const_iterator db = opts_.csblast.find('d');
+    if (db == opts_.csblast.end())
+      throw Exception("Abstract state search needs an abstract state database (-d)!");
+    as_db_.reset(new SequenceDb<AS219>(db->second));
+    as_matrix_.reset(new AbstractStateMatrix<AS219>(opts_.as_matrixfile));
+    const string& libfile = opts_.as_contextsfile.empty() ? opts_.modelfile :
+      opts_.as_contextsfile;
+    fin = fopen(libfile.c_str(), "r");
+    if (!fin) throw Exception("Unable to read file '%s'!", libfile.c_str());
+    as_contexts_.reset(new ContextLibrary<AA>(fin));
+    fclose(fin);
+    TransformToLog(*as_contexts_);
+    LOG(INFO) << strprintf("Using %zu abstract state sequences", as_db_->size());
+    as_freqs_ = StateFrequencies(*as_db_);
+    if (KmerIndex<AS219>::IsIndex(db->second + ".csidx")) {
+      as_index_.reset(new KmerIndex<AS219>(db->second + ".csidx"));
+      LOG(INFO) << strprintf("Using k-mer index with seed %s", as_index_->seed().c_str());
+    }
+  }
+
+  if (!opts_.pssm_cache.empty()) {
+    pssm_cache_.reset(new PssmCache<AA>(opts_.pssm_cache));
+    model_hash_ = KeyHash().AddFile(opts_.modelfile).str();
+  }
+
   // if (!opts_.no_penalty) {
   //   // Setup repeat penalizer
   //   penalizer_.reset(new RepeatPenalizer<AA>(opts_.penalty_alpha,
@@ -392,7 +584,14 @@ void CSBlastApp::PrepareForRun(const Sequence<AA>& query) {
   // Setup PSSM of query profile with context-specific pseudocounts if no
   // restart file is provided
   if (opts_.csblast.find('R') == opts_.csblast.end()) {
-    if (opts_.ali_infile.empty()) {
+    const string key = pssm_cache_ ? PssmCacheKey(query) : "";
+    Sequence<AA> cached_query;
+    CountProfile<AA> cached;
+    const bool hit = pssm_cache_ && pssm_cache_->Load(key, cached_query, cached);
+    if (hit) {
+      LOG(INFO) << "Using cached PSSM " << pssm_cache_->Path(key);
+      pssm_.reset(new Pssm(query, std::move(cached.counts)));
+    } else if (opts_.ali_infile.empty()) {
       ConstantAdmix admix(opts_.pc_admix);
       pssm_.reset(new Pssm(query, pc_->AddTo(query, admix)));
     } else {
@@ -400,10 +599,13 @@ void CSBlastApp::PrepareForRun(const Sequence<AA>& query) {
       Alignment<AA> query_ali(fp, PSI_ALIGNMENT);
       query_ali.AssignMatchColumnsBySequence(0);
       fclose(fp);
+      FilterAlignment(query_ali);
       CountProfile<AA> ali_profile(query_ali, !opts_.global_weights);
       CSBlastAdmix admix(opts_.pc_admix, opts_.pc_ali);
       pssm_.reset(new Pssm(query, pc_->AddTo(ali_profile, admix)));
     }
+    if (pssm_cache_ && !hit)
+      pssm_cache_->Store(key, query, CountProfile<AA>(pssm_->profile));
     pssm_->Shift(opts_.shift);
   }
   // Use composition based score adjustment type 1 to avoid
@@ -415,23 +617,82 @@ void CSBlastApp::PrepareForRun(const Sequence<AA>& query) {
   opts_.csblast['v']  = strprintf("%i", kNumOutputAlis);
   opts_.csblast['b']  = strprintf("%i", kNumOutputAlis);
 
-  // Setup CS-BLAST engine
-  if (opts_.csblast.find('R') == opts_.csblast.end())
-    csblast_.reset(new CSBlast(&query, pssm_.get(), opts_.csblast));
-  else
-    csblast_.reset(new CSBlast(&query, opts_.csblast));
+  // Engines other than blastpgp restart from the PSSM in the checkpoint
+  if (opts_.search_engine != "blast" && opts_.csblast.find('R') != opts_.csblast.end()) {
+    FILE* fchk = fopen(opts_.csblast['R'].c_str(), "rb");
+    if (!fchk)
+      throw Exception("Unable to read file '%s'!", opts_.csblast['R'].c_str());
+    pssm_.reset(new Pssm(fchk));
+    fclose(fchk);
+  }
 
-  // Set path to PSI-BLAST executable
-  if (!opts_.blast_path.empty())
-    csblast_->set_exec_path(opts_.blast_path);
+  // Setup search engine
+  if (opts_.search_engine == "sw") {
+    SwSearch* sw = new SwSearch(&query, pssm_.get(), db_.get(), opts_.csblast);
+    sw->set_prefilter(!opts_.no_prefilter);
+    sw->set_statistics_cache(&ka_cache_);
+    csblast_.reset(sw);
+  } else if (opts_.search_engine == "as") {
+    AsSearch* as = new AsSearch(&query, pssm_.get(), as_contexts_.get(), as_matrix_.get(),
+                                as_db_.get(), opts_.csblast);
+    if (as_index_) as->set_index(as_index_.get(), opts_.as_candidates);
+    as->set_statistics_cache(&ka_cache_);
+    as->set_state_frequencies(as_freqs_);
+    csblast_.reset(as);
+  } else if (opts_.search_engine == "psiblast") {
+    PsiBlastPlus* blast = new PsiBlastPlus(&query, pssm_.get(), opts_.csblast);
+    if (!opts_.blast_path.empty())
+      blast->set_exec_path(opts_.blast_path);
+    blast->set_emulate(opts_.emulate);
+    csblast_.reset(blast);
+  } else {
+    CSBlast* blast = opts_.csblast.find('R') == opts_.csblast.end() ?
+      new CSBlast(&query, pssm_.get(), opts_.csblast) :
+      new CSBlast(&query, opts_.csblast);
 
-  // Set BLAST call emulation
-  csblast_->set_emulate(opts_.emulate);
+    // Set path to PSI-BLAST executable
+    if (!opts_.blast_path.empty())
+      blast->set_exec_path(opts_.blast_path);
+
+    // Set BLAST call emulation
+    blast->set_emulate(opts_.emulate);
+    csblast_.reset(blast);
+  }
 
   // Setup alignment of included sequences
   ali_.reset(new Alignment<AA>(query));
 }
 
+string CSBlastApp::PssmCacheKey(const Sequence<AA>& query) const {
+  KeyHash h;
+  h.Add(model_hash_).Add(opts_.pc_engine);
+  h.Add(strprintf("%.17g %.17g %.17g %.17g %d", opts_.pc_admix, opts_.pc_neff,
+                  opts_.weight_center, opts_.weight_decay, opts_.pc_float));
+  if (opts_.ali_infile.empty()) {
+    h.Add(query.ToString());
+  } else {
+    h.AddFile(opts_.ali_infile);
+    h.Add(strprintf("%.17g %d", opts_.pc_ali, opts_.global_weights));
+    if (FilterEnabled())
+      h.Add(strprintf("%.17g %.17g %d", opts_.filter_id, opts_.filter_cov, opts_.filter_diff));
+  }
+  return h.str();
+}
+
+bool CSBlastApp::FilterEnabled() const {
+  return opts_.filter_id > 0.0 || opts_.filter_cov > 0.0 || opts_.filter_diff > 0;
+}
+
+void CSBlastApp::FilterAlignment(Alignment<AA>& ali) const {
+  if (!FilterEnabled()) return;
+  // Without --filter-id only the coverage and diversity filters apply
+  const double max_id = opts_.filter_id > 0.0 ? opts_.filter_id : 100.0;
+  const size_t nseqs = ali.nseqs();
+  const size_t removed = ali.FilterRedundant(max_id, opts_.filter_cov, opts_.filter_diff);
+  LOG(INFO) << strprintf("Filtered %zu of %zu sequences (max id %.0f%%, min cov %.0f%%, diff %d)",
+                         removed, nseqs, max_id, opts_.filter_cov, opts_.filter_diff);
+}
+
 void CSBlastApp::SavePssm() const {
   if (!opts_.checkpointfile.empty() && pssm_) {
     FILE* fchk = fopen(opts_.checkpointfile.c_str(), "wb");
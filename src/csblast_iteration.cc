@@ -26,39 +26,50 @@ using std::vector;
 namespace cs {
 
 CSBlastIteration::CSBlastIteration(int niters)
-    : iterations_todo_(niters), iterations_done_(0) {}
+    : iterations_todo_(niters), iterations_done_(0), num_lost_(0) {}
 
 bool CSBlastIteration::HasConverged() const {
   // For an object that hasn't been 'advanced' or one that only has performed
   // one iteration it doesn't make sense to have converged
   if (iterations_done_ <= 1)
     return false;
-  // If the size differs, we obviously have not converged
-  if (previous_data_.size() != current_data_.size())
-    return false;
+  // Converged if no sequence was gained or lost
+  return new_hits_.empty() && num_lost_ == 0;
+}
 
-  bool retval = true;
-  SeqIds::const_iterator end  = previous_data_.end();
-  SeqIds::const_iterator prev = previous_data_.begin();
-  SeqIds::const_iterator curr = current_data_.begin();
-  for (; prev != end; ++prev, ++curr) {
-    if (*prev != *curr) {
-      retval = false;
-      break;
-    }
+size_t CSBlastIteration::IndexOf(const string& id) {
+  std::pair<std::unordered_map<string, size_t>::iterator, bool> ins =
+      index_.insert(std::make_pair(id, index_.size()));
+  if (ins.second) {
+    in_previous_.push_back(false);
+    in_current_.push_back(false);
   }
-
-  return retval;
+  return ins.first->second;
 }
 
 void CSBlastIteration::Advance(const BlastHits& hits) {
-  previous_data_ = current_data_;
+  // Make the current iteration the previous one, touching only its members
+  for (size_t k = 0; k < previous_data_.size(); ++k)
+    in_previous_[previous_data_[k]] = false;
+  for (size_t k = 0; k < current_data_.size(); ++k) {
+    in_current_[current_data_[k]] = false;
+    in_previous_[current_data_[k]] = true;
+  }
+  previous_data_.swap(current_data_);
   current_data_.clear();
+  new_hits_.clear();
 
-  for (BlastHits::ConstHitIter it = hits.begin(); it != hits.end(); ++it) {
-    current_data_.push_back(it->definition);
+  size_t nkept = 0;
+  for (size_t n = 0; n < hits.size(); ++n) {
+    const size_t idx = IndexOf(hits[n].definition);
+    if (!in_current_[idx]) {
+      in_current_[idx] = true;
+      current_data_.push_back(idx);
+      if (in_previous_[idx]) ++nkept;
+    }
+    if (!in_previous_[idx]) new_hits_.push_back(n);
   }
-  std::sort(current_data_.begin(), current_data_.end());
+  num_lost_ = previous_data_.size() - nkept;
   ++iterations_done_;
 }
 
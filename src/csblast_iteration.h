@@ -20,6 +20,8 @@
 #ifndef CS_CSBLAST_ITERATION_H_
 #define CS_CSBLAST_ITERATION_H_
 
+#include <unordered_map>
+
 #include "blast_hits.h"
 
 namespace cs {
@@ -29,6 +31,8 @@ class CSBlastIteration {
  public:
   // List of sequence IDs
   typedef std::vector<std::string> SeqIds;
+  // List of indices into the hits passed to Advance()
+  typedef std::vector<size_t> HitIndices;
 
   // Number of iterations to perform. Use 0 to indicate that iterations must
   // take place until convergence.
@@ -55,15 +59,36 @@ class CSBlastIteration {
   // criteria for the current iteration
   void Advance(const BlastHits& hits);
 
+  // Returns the indices of hits passed to the last call of Advance() whose
+  // sequences were not found in the iteration before.
+  const HitIndices& NewHits() const { return new_hits_; }
+
+  // Returns the number of sequences found in the iteration before the last
+  // call of Advance() but not in the last one.
+  size_t NumLostHits() const { return num_lost_; }
+
  private:
+  // Returns the dense index of the sequence with given ID, assigning the next
+  // free index to IDs not seen before.
+  size_t IndexOf(const std::string& id);
+
   // Number of iterations to perform
   int iterations_todo_;
   // Number of iterations already performed
   int iterations_done_;
-  // Identifiers for sequences found in the previous iteration
-  SeqIds previous_data_;
-  // Identifiers for sequences found in the current iteration
-  SeqIds current_data_;
+  // Dense indices of all sequence IDs seen so far
+  std::unordered_map<std::string, size_t> index_;
+  // Indices of sequences found in the previous iteration
+  std::vector<size_t> previous_data_;
+  // Indices of sequences found in the current iteration
+  std::vector<size_t> current_data_;
+  // Membership bitsets of the previous and current iteration
+  std::vector<bool> in_previous_;
+  std::vector<bool> in_current_;
+  // Hits of the current iteration not found in the previous one
+  HitIndices new_hits_;
+  // Number of sequences of the previous iteration missing in the current one
+  size_t num_lost_;
 };  // class CSBlastIteration
 
 }  // namespace cs
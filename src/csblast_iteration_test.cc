@@ -0,0 +1,54 @@
+#include <gtest/gtest.h>
+
+#include "cs.h"
+#include "blast_hits.h"
+#include "csblast_iteration.h"
+
+namespace cs {
+
+// Returns hits parsed from a BLAST hitlist with given sequence IDs.
+BlastHits MakeHits(const char* ids[], size_t n) {
+  FILE* fp = tmpfile();
+  fputs("Sequences producing significant alignments:\n\n", fp);
+  for (size_t k = 0; k < n; ++k)
+    fprintf(fp, "%s  100  1e-20\n", ids[k]);
+  fputs("\n", fp);
+  rewind(fp);
+  BlastHits hits(fp);
+  fclose(fp);
+  return hits;
+}
+
+TEST(CSBlastIterationTest, NewAndLostHits) {
+  const char* round1[] = { "seqA", "seqB", "seqC" };
+  const char* round2[] = { "seqC", "seqD", "seqA", "seqE" };
+  const char* round3[] = { "seqE", "seqD", "seqC", "seqA" };
+  CSBlastIteration itr(0);
+
+  itr.Advance(MakeHits(round1, 3));
+  EXPECT_EQ(3u, itr.NewHits().size());
+  EXPECT_FALSE(itr.HasConverged());
+
+  itr.Advance(MakeHits(round2, 4));
+  ASSERT_EQ(2u, itr.NewHits().size());
+  EXPECT_EQ(1u, itr.NewHits()[0]);
+  EXPECT_EQ(3u, itr.NewHits()[1]);
+  EXPECT_EQ(1u, itr.NumLostHits());
+  EXPECT_FALSE(itr.HasConverged());
+  EXPECT_TRUE(itr);
+
+  // Same set in a different order
+  itr.Advance(MakeHits(round3, 4));
+  EXPECT_TRUE(itr.NewHits().empty());
+  EXPECT_EQ(0u, itr.NumLostHits());
+  EXPECT_TRUE(itr.HasConverged());
+  EXPECT_FALSE(itr);
+
+  // A previously lost sequence counts as new again
+  itr.Advance(MakeHits(round1, 3));
+  ASSERT_EQ(1u, itr.NewHits().size());
+  EXPECT_EQ(1u, itr.NewHits()[0]);
+  EXPECT_EQ(2u, itr.NumLostHits());
+}
+
+}  // namespace cs
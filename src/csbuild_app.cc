@@ -29,6 +29,7 @@
 #include "library_pseudocounts-inl.h"
 #include "matrix_pseudocounts-inl.h"
 #include "pssm.h"
+#include "pssm_cache.h"
 #include "sequence-inl.h"
 
 using namespace GetOpt;
@@ -52,6 +53,8 @@ struct CSBuildAppOptions {
     pc_engine        = "auto";
     match_assign     = kAssignMatchColsByQuery;
     global_weights   = false;
+    pc_float         = false;
+    pc_cache         = 0;
     weight_center    = 1.6;
     weight_decay     = 0.85;
   }
@@ -85,6 +88,12 @@ struct CSBuildAppOptions {
   int match_assign;
   // Use global instead of position specific weights for sequence weighting.
   bool global_weights;
+  // Compute CRF pseudocounts in single precision.
+  bool pc_float;
+  // Number of CRF pseudocount columns to cache (0 = off).
+  size_t pc_cache;
+  // Directory for caching profiles across runs
+  string pssm_cache;
   // Weight of central column in multinomial emission
   double weight_center;
   // Exponential decay of window weights
@@ -112,6 +121,8 @@ class CSBuildApp : public Application {
                        const CountProfile<Abc>& cp) const;
   // Initialize alphabet dependent pseudocount engine
   void InitAbcPcEngine();
+  // Returns the cache key of the input file and the pseudocount settings
+  string PssmCacheKey() const;
 
   // Parameter wrapper
   CSBuildAppOptions opts_;
@@ -119,8 +130,12 @@ class CSBuildApp : public Application {
   scoped_ptr<ContextLibrary<Abc> > lib_;
   // CRF for CRF context pseudocounts
   scoped_ptr< Crf<Abc> > crf_;
+  // Cache of CRF pseudocount columns
+  scoped_ptr< ContextCache<Abc> > pc_cache_;
   // Pseudocount engine
   scoped_ptr< Pseudocounts<Abc> > pc_;
+  // On-disk cache of profiles with pseudocounts
+  scoped_ptr< PssmCache<Abc> > pssm_cache_;
 };  // class CSBuildApp
 
 
@@ -138,6 +153,9 @@ void CSBuildApp<Abc>::ParseOptions(GetOpt_pp& ops) {
   ops >> Option('D', "context-data", opts_.modelfile, opts_.modelfile);
   ops >> Option('p', "pc-engine", opts_.pc_engine, opts_.pc_engine);
   ops >> OptionPresent(' ', "global-weights", opts_.global_weights);
+  ops >> OptionPresent(' ', "pc-float", opts_.pc_float);
+  ops >> Option(' ', "pc-cache", opts_.pc_cache, opts_.pc_cache);
+  ops >> Option(' ', "pssm-cache", opts_.pssm_cache, opts_.pssm_cache);
   ops >> Option(' ', "weight-center", opts_.weight_center, opts_.weight_center);
   ops >> Option(' ', "weight-decay", opts_.weight_decay, opts_.weight_decay);
 
@@ -193,6 +211,12 @@ void CSBuildApp<Abc>::PrintOptions() const {
           "Parameter for exponential decay of window weights", opts_.weight_decay);
   fprintf(out_, "  %-30s %s\n", "    --global-weights",
           "Use global instead of position-specific sequence weights (def=off)");
+  fprintf(out_, "  %-30s %s\n", "    --pc-float",
+          "Compute CRF pseudocounts in single precision (def=off)");
+  fprintf(out_, "  %-30s %s (def=%zu)\n", "    --pc-cache [0,inf[",
+          "Number of CRF pseudocount columns to cache", opts_.pc_cache);
+  fprintf(out_, "  %-30s %s\n", "    --pssm-cache <dir>",
+          "Reuse profiles cached in directory across runs (def=off)");
 }
 
 template<class Abc>
@@ -237,8 +261,39 @@ void CSBuildApp<AA>::InitAbcPcEngine() {
   }
 }
 
+template<class Abc>
+string CSBuildApp<Abc>::PssmCacheKey() const {
+  KeyHash h;
+  h.AddFile(opts_.modelfile).Add(opts_.pc_engine);
+  h.Add(strprintf("%zu %.17g %.17g %.17g %.17g %.17g %d %d", Abc::kSize,
+                  opts_.pc_admix, opts_.pc_neff, opts_.pc_ali, opts_.weight_center,
+                  opts_.weight_decay, opts_.pc_float, opts_.global_weights));
+  h.Add(opts_.informat).Add(strprintf("%d", opts_.match_assign));
+  h.AddFile(opts_.infile);
+  return h.str();
+}
+
 template<class Abc>
 int CSBuildApp<Abc>::Run() {
+  // Reuse cached profile if input and settings are unchanged
+  string cache_key;
+  if (!opts_.pssm_cache.empty() && !opts_.modelfile.empty()) {
+    pssm_cache_.reset(new PssmCache<Abc>(opts_.pssm_cache));
+    cache_key = PssmCacheKey();
+    Sequence<Abc> query;
+    CountProfile<Abc> profile;
+    if (pssm_cache_->Load(cache_key, query, profile)) {
+      fprintf(out_, "Using cached profile %s\n", pssm_cache_->Path(cache_key).c_str());
+      profile.name = GetBasename(opts_.infile, false);
+      profile.name = profile.name.substr(0, profile.name.length() - 1);
+      if (opts_.outformat == "chk")
+        WriteCheckpoint(query, profile);
+      else
+        WriteProfile(profile);
+      return 0;
+    }
+  }
+
   // Setup pseudocount engine
   if (!opts_.modelfile.empty() && opts_.pc_engine == "lib") {
     fprintf(out_, "Reading context library from %s ...\n",
@@ -261,7 +316,17 @@ int CSBuildApp<Abc>::Run() {
       throw Exception("Unable to read file '%s'!", opts_.modelfile.c_str());
     crf_.reset(new Crf<Abc>(fin));
     fclose(fin);
-    pc_.reset(new CrfPseudocounts<Abc>(*crf_));
+    if (opts_.pc_cache > 0)
+      pc_cache_.reset(new ContextCache<Abc>(opts_.pc_cache));
+    if (opts_.pc_float) {
+      CrfPseudocounts<Abc, float>* pc = new CrfPseudocounts<Abc, float>(*crf_);
+      pc->set_cache(pc_cache_.get());
+      pc_.reset(pc);
+    } else {
+      CrfPseudocounts<Abc>* pc = new CrfPseudocounts<Abc>(*crf_);
+      pc->set_cache(pc_cache_.get());
+      pc_.reset(pc);
+    }
     pc_->SetTargetNeff(opts_.pc_neff);
   } else {
     InitAbcPcEngine();
@@ -282,6 +347,7 @@ int CSBuildApp<Abc>::Run() {
       fputs("Adding pseudocounts ...\n", out_);
       ConstantAdmix admix(opts_.pc_admix);
       profile.counts = pc_->AddTo(seq, admix);
+      if (pssm_cache_) pssm_cache_->Store(cache_key, seq, profile);
     }
     fprintf(out_, "Effective number of sequences exp(entropy) = %.2f\n", 
         Neff(profile.counts));
@@ -310,6 +376,7 @@ int CSBuildApp<Abc>::Run() {
       CSBlastAdmix admix(opts_.pc_admix, opts_.pc_ali);
       profile.counts = pc_->AddTo(profile, admix);
       Normalize(profile.counts, profile.neff);
+      if (pssm_cache_) pssm_cache_->Store(cache_key, ali.GetSequence(0), profile);
     }
     Profile<Abc> prof = profile.counts;
     Normalize(prof, 1.0);
@@ -323,6 +390,10 @@ int CSBuildApp<Abc>::Run() {
   }
 
   fclose(fin);
+
+  if (pc_cache_)
+    fprintf(out_, "Context cache: %zu hits, %zu misses (hit rate %.1f%%)\n",
+            pc_cache_->hits(), pc_cache_->misses(), 100.0 * pc_cache_->HitRate());
   return 0;
 }
 
@@ -0,0 +1,188 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cs.h"
+#include "application.h"
+#include "getopt_pp.h"
+#include "sequence_db.h"
+#include "as_search.h"
+#include "kmer_index.h"
+
+using namespace GetOpt;
+using std::string;
+
+namespace cs {
+
+struct CSFormatDbAppOptions {
+  CSFormatDbAppOptions() { Init(); }
+
+  void Init() {
+    weight_as = 1000.0;
+  }
+
+  // Validates the parameter settings and throws exception if needed.
+  void Validate() {
+    if (infile.empty()) throw Exception("No input file provided!");
+  }
+
+  // The input file with sequences in FASTA format.
+  string infile;
+  // The output database file.
+  string outfile;
+  // Profile library with abstract states for translating sequences
+  string alphabetfile;
+  // Weight in emission calculation of abstract states
+  double weight_as;
+  // Spaced seed pattern for k-mer index
+  string seed;
+};  // CSFormatDbAppOptions
+
+
+template<class Abc>
+class CSFormatDbApp : public Application {
+ private:
+  // Runs the csformatdb application.
+  virtual int Run();
+  // Parses command line options.
+  virtual void ParseOptions(GetOpt_pp& ops);
+  // Prints options summary to stream.
+  virtual void PrintOptions() const;
+  // Prints short application description.
+  virtual void PrintBanner() const;
+  // Prints usage banner to stream.
+  virtual void PrintUsage() const;
+
+  // Writes k-mer index of database in 'opts_.outfile' if a seed is given.
+  template<class DbAbc>
+  void WriteIndex() const;
+
+  // Parameter wrapper
+  CSFormatDbAppOptions opts_;
+};  // class CSFormatDbApp
+
+
+
+template<class Abc>
+void CSFormatDbApp<Abc>::ParseOptions(GetOpt_pp& ops) {
+  ops >> Option('i', "infile", opts_.infile, opts_.infile);
+  ops >> Option('o', "outfile", opts_.outfile, opts_.outfile);
+  ops >> Option('A', "alphabet", opts_.alphabetfile, opts_.alphabetfile);
+  ops >> Option('w', "weight", opts_.weight_as, opts_.weight_as);
+  ops >> Option('s', "seed", opts_.seed, opts_.seed);
+  opts_.Validate();
+
+  if (opts_.outfile.empty()) opts_.outfile = opts_.infile + ".csdb";
+}
+
+template<class Abc>
+void CSFormatDbApp<Abc>::PrintBanner() const {
+  fputs("Convert sequences in FASTA format into a memory-mapped sequence database.\n",
+        out_);
+}
+
+template<class Abc>
+void CSFormatDbApp<Abc>::PrintUsage() const {
+  fputs("Usage: csformatdb -i <infile> [options]\n", out_);
+}
+
+template<class Abc>
+void CSFormatDbApp<Abc>::PrintOptions() const {
+  fprintf(out_, "  %-30s %s\n", "-i, --infile <file>",
+          "Input file with sequences in FASTA format");
+  fprintf(out_, "  %-30s %s\n", "-o, --outfile <file>",
+          "Output file for sequence database (def: <infile>.csdb)");
+  fprintf(out_, "  %-30s %s (def=off)\n", "-A, --alphabet <file>",
+          "Translate sequences with this 219-state abstract state alphabet");
+  fprintf(out_, "  %-30s %s (def=%-.2f)\n", "-w, --weight [0,inf[",
+          "Weight of abstract state column in emission calculation", opts_.weight_as);
+  fprintf(out_, "  %-30s %s\n", "-s, --seed <pattern>",
+          "Write k-mer index with spaced seed, e.g. 1101, to <outfile>.csidx");
+}
+
+template<class Abc>
+int CSFormatDbApp<Abc>::Run() {
+  FILE* fin = fopen(opts_.infile.c_str(), "r");
+  if (!fin) throw Exception("Can't read input file '%s'!", opts_.infile.c_str());
+  FILE* fout = fopen(opts_.outfile.c_str(), "wb");
+  if (!fout) throw Exception("Can't write output file '%s'!", opts_.outfile.c_str());
+  if (opts_.alphabetfile.empty()) {
+    SequenceDb<Abc>::Format(fin, fout);
+    fclose(fin);
+    fclose(fout);
+
+    SequenceDb<Abc> db(opts_.outfile);
+    fprintf(out_, "Wrote %zu sequences with %zu residues to %s\n", db.size(),
+            db.num_residues(), opts_.outfile.c_str());
+    WriteIndex<Abc>();
+    return 0;
+  }
+
+  // Translate each sequence into abstract states for profile-profile search
+  fprintf(out_, "Reading abstract state alphabet from %s ...\n",
+          GetBasename(opts_.alphabetfile).c_str());
+  FILE* flib = fopen(opts_.alphabetfile.c_str(), "r");
+  if (!flib) throw Exception("Unable to read file '%s'!", opts_.alphabetfile.c_str());
+  ContextLibrary<AA> as_lib(flib);
+  fclose(flib);
+  if (as_lib.size() != AS219::kSize)
+    throw Exception("Abstract state alphabet should have %zu states but actually "
+                    "has %zu states!", AS219::kSize, as_lib.size());
+  if (as_lib.wlen() != 1)
+    throw Exception("Abstract state alphabet should have a window length of 1 "
+                    "but actually has %zu!", as_lib.wlen());
+  TransformToLog(as_lib);
+
+  SequenceDbWriter<AS219> writer(fout);
+  for (int c = getc(fin); c != EOF; c = getc(fin)) {
+    ungetc(c, fin);
+    writer.Add(TranslateIntoAS219(Sequence<AA>(fin), as_lib, opts_.weight_as));
+  }
+  writer.Close();
+  fclose(fin);
+  fclose(fout);
+
+  SequenceDb<AS219> db(opts_.outfile);
+  fprintf(out_, "Wrote %zu abstract state sequences with %zu states to %s\n", db.size(),
+          db.num_residues(), opts_.outfile.c_str());
+  WriteIndex<AS219>();
+  return 0;
+}
+
+template<class Abc>
+template<class DbAbc>
+void CSFormatDbApp<Abc>::WriteIndex() const {
+  if (opts_.seed.empty()) return;
+  const string indexfile = opts_.outfile + ".csidx";
+  SequenceDb<DbAbc> db(opts_.outfile);
+  FILE* fout = fopen(indexfile.c_str(), "wb");
+  if (!fout) throw Exception("Can't write output file '%s'!", indexfile.c_str());
+  const size_t nentries = KmerIndex<DbAbc>::Build(db, opts_.seed, fout);
+  fclose(fout);
+  fprintf(out_, "Wrote k-mer index with %zu entries to %s\n", nentries, indexfile.c_str());
+}
+
+}  // namespace cs
+
+int main(int argc, char* argv[]) {
+  string alphabet(getenv("CS_ALPHABET") ? getenv("CS_ALPHABET") : "");
+  if (alphabet == "dna" || alphabet == "DNA")
+    return cs::CSFormatDbApp<cs::Dna>().main(argc, argv, stdout, "csformatdb");
+  else
+    return cs::CSFormatDbApp<cs::AA>().main(argc, argv, stdout, "csformatdb");
+}
@@ -50,8 +50,9 @@ struct CSHmcAppOptions {
     sigma_decay    = 0.9;
     sigma_bias     = 1.0;
     no_sort        = false;
+    nreplicas      = 1;
     hmc.sgd_epochs = 0;
-    sgd.eta        = 0.001;
+    sgd.eta_init   = 0.001;
     weight_center  = 1.6;
     weight_decay   = 0.85;
   }
@@ -63,6 +64,13 @@ struct CSHmcAppOptions {
     if (trainfile.empty()) throw Exception("No training set provided!");
     if (valfile.empty()) throw Exception("No validation set provided!");
     if (crffile.empty()) throw Exception("No output file for CRF provided!");
+    if (nreplicas < 1) throw Exception("Number of replicas must be at least one!");
+    if (nreplicas > 1 && outfile.empty())
+      throw Exception("Empty outfile when running parallel tempering!");
+    if (checkpoint.interval < 1)
+      throw Exception("Checkpoint interval must be at least one step!");
+    if (checkpoint.resume && checkpoint.file.empty())
+      throw Exception("No checkpoint file to resume from!");
   }
 
   // Input file with training set.
@@ -97,6 +105,10 @@ struct CSHmcAppOptions {
   double sigma_bias;
   // Use sorted parallel tempering instead of single exchange parallel tempering
   bool no_sort;
+  // Number of replicas run as threads for parallel tempering
+  int nreplicas;
+  // Periodic checkpoints of the sampler state
+  CheckpointParams checkpoint;
   // Wrapper for HMC parameters
   HmcParams hmc;
   // Parameter wrapper for SGD in basin hopping
@@ -117,6 +129,7 @@ class CSHmcApp : public Application {
   typedef LeapfrogProposal<Abc, TrainingSequence<Abc> > Leapfrog;
   typedef BasinHoppingProposal<Abc, TrainingSequence<Abc> > BasinHopping;
   typedef ParallelTempering<Abc, TrainingSequence<Abc> > PT;
+  typedef ThreadedParallelTempering<Abc, TrainingSequence<Abc> > ThreadedPT;
 #ifdef PARALLEL
   typedef SingleExchParallelTempering<Abc, TrainingSequence<Abc> > SingleExchPT;
   typedef SortedParallelTempering<Abc, TrainingSequence<Abc> > SortedPT;
@@ -138,13 +151,16 @@ class CSHmcApp : public Application {
   void InitCrf();
   // Initializes substitution matrix (specialized by alphabet type).
   void InitSubstitutionMatrix();
+  // Runs HMC sampling for replica 'rank' starting from 'crf', which is set to
+  // the best CRF on the validation set on return.
+  void RunReplica(int rank, Crf<Abc>& crf, PT* partemp, FILE* fout,
+                  const CheckpointParams& checkpoint) const;
 
   CSHmcAppOptions opts_;
   TrainingSet trainset_;
   TrainingSet valset_;
   scoped_ptr<Crf<Abc> > crf_;
   scoped_ptr<SubstitutionMatrix<Abc> > sm_;
-  scoped_ptr<Leapfrog> propose_;
   scoped_ptr<PT> partemp_;
 };  // CSHmcApp
 
@@ -178,6 +194,10 @@ void CSHmcApp<Abc>::ParseOptions(GetOpt_pp& ops) {
   ops >> Option(' ', "weight-center", opts_.weight_center, opts_.weight_center);
   ops >> Option(' ', "weight-decay", opts_.weight_decay, opts_.weight_decay);
   ops >> OptionPresent(' ', "no-sort", opts_.no_sort);
+  ops >> Option('n', "replicas", opts_.nreplicas, opts_.nreplicas);
+  ops >> Option(' ', "checkpoint", opts_.checkpoint.file, opts_.checkpoint.file);
+  ops >> Option(' ', "checkpoint-every", opts_.checkpoint.interval, opts_.checkpoint.interval);
+  ops >> OptionPresent(' ', "resume", opts_.checkpoint.resume);
 
   opts_.Validate();
 }
@@ -221,10 +241,10 @@ void CSHmcApp<Abc>::PrintOptions() const {
 
   fprintf(out_, "  %-30s %s (def=off)\n", "-g, --gauss-init [0,inf[",
           "Turn on gaussian CRF initialization using given sigma");
-#ifdef PARALLEL
+  fprintf(out_, "  %-30s %s (def=%d)\n", "-n, --replicas [1,inf[",
+          "Number of replicas for parallel tempering in threads", opts_.nreplicas);
   fprintf(out_, "  %-30s %s (def=%.3f)\n", "-t, --theta [0,1]",
           "Probability of replica exchange", opts_.theta);
-#endif
   fprintf(out_, "  %-30s %s (def=%zu)\n", "-S, --sgd-blocks [1,N]",
           "Number of training blocks in SGD", opts_.sgd.nblocks);
   fprintf(out_, "  %-30s %s (def=%zu)\n", "-P, --prior [1-2]",
@@ -248,10 +268,14 @@ void CSHmcApp<Abc>::PrintOptions() const {
           "Epsilon scale-up after Metropolis acceptance", opts_.hmc.epsilon_up);
   fprintf(out_, "  %-30s %s (def=%.2f)\n", "    --eps-down [0,1]",
           "Epsilon scale-down after Metropolis rejection", opts_.hmc.epsilon_down);
-#ifdef PARALLEL
-   fprintf(out_, "  %-30s %s\n", "    --no-sort",
+  fprintf(out_, "  %-30s %s\n", "    --no-sort",
           "Use conventional instead of strictly sorted parallel tempering");
-#endif
+  fprintf(out_, "  %-30s %s (def=off)\n", "    --checkpoint <file>",
+          "Write sampler state to checkpoint file after each interval");
+  fprintf(out_, "  %-30s %s (def=%zu)\n", "    --checkpoint-every [1,inf[",
+          "Number of HMC steps between checkpoints", opts_.checkpoint.interval);
+  fprintf(out_, "  %-30s %s\n", "    --resume",
+          "Continue from checkpoint file if it exists (def=off)");
   fprintf(out_, "  %-30s %s (def=%-.2f)\n", "    --weight-center [0,inf[",
          "Weight of central profile column in CRF initialization", opts_.weight_center);
   fprintf(out_, "  %-30s %s (def=%-.2f)\n", "    --weight-decay [0,inf[",
@@ -329,15 +353,54 @@ void CSHmcApp<Abc>::InitCrf() {
   }
 }
 
+template<class Abc>
+void CSHmcApp<Abc>::RunReplica(int rank, Crf<Abc>& crf, PT* partemp,
+                               FILE* fout,
+                               const CheckpointParams& checkpoint) const {
+  // Setup function objects on training set and validation set
+  scoped_ptr<DerivCrfFuncPrior<Abc> > prior;
+  if (opts_.prior == 1)
+      prior.reset(new GaussianDerivCrfFuncPrior<Abc>(
+          opts_.sigma_context, 
+          opts_.sigma_decay, 
+          opts_.sigma_bias));
+  else
+      prior.reset(new LassoDerivCrfFuncPrior<Abc>(
+          opts_.sigma_context, 
+          opts_.sigma_decay, 
+          opts_.sigma_bias));
+  Likelihood loglike(valset_, *sm_);
+  Gradient gradient(trainset_, *sm_, *prior);
+  HmcState<Abc> state(crf);
+
+  // Setup leapfrog proposal functor
+  scoped_ptr<Leapfrog> propose;
+  if (opts_.hmc.sgd_epochs > 0)
+    propose.reset(new BasinHopping(gradient, opts_.hmc, opts_.sgd, rank));
+  else
+    propose.reset(new Leapfrog(gradient, opts_.hmc, rank));
+
+  // Run 'nsteps' HMC sampling steps
+  HmcStep(opts_.nsteps,    // number of HMC steps
+          state,           // current sampling state
+          *propose,        // proposal functor
+          loglike,         // likelihood functor on validation set
+          opts_.hmc.seed,  // seed for Metropolis decision
+          partemp,         // parallel tempering encapsulation
+          fout,            // output stream for progress table
+          &checkpoint);    // checkpoint settings
+
+  crf = state.crf;
+}
+
 template<class Abc>
 int CSHmcApp<Abc>::Run() {
-  int myrank = 0;
   InitSubstitutionMatrix();
   ReadTrainingData();
   InitCrf();
 
 #ifdef PARALLEL
-  int nreplicas;
+  int myrank, nreplicas;
   MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
   MPI_Comm_size(MPI_COMM_WORLD, &nreplicas);
 
@@ -347,6 +410,7 @@ int CSHmcApp<Abc>::Run() {
       string replica = strprintf(".r%d", myrank + 1);
       opts_.outfile.append(replica);
       opts_.crffile.append(replica);
+      if (!opts_.checkpoint.file.empty()) opts_.checkpoint.file.append(replica);
       LOG(ERROR) << opts_.outfile;
       LOG(ERROR) << opts_.crffile;
 
@@ -363,50 +427,97 @@ int CSHmcApp<Abc>::Run() {
       partemp_.reset(new SingleExchPT(myrank, nreplicas, opts_.theta,
                                       opts_.hmc.seed));
   }
+#else
+  const int myrank = 0;
+  const int nreplicas = opts_.nreplicas;
 #endif
 
-  FILE* fout = opts_.outfile.empty() ? out_ : fopen(opts_.outfile.c_str(), "w");
-
-  // Setup function objects on training set and validation set
-  scoped_ptr<DerivCrfFuncPrior<Abc> > prior;
-  if (opts_.prior == 1)
-      prior.reset(new GaussianDerivCrfFuncPrior<Abc>(
-          opts_.sigma_context, 
-          opts_.sigma_decay, 
-          opts_.sigma_bias));
-  else
-      prior.reset(new LassoDerivCrfFuncPrior<Abc>(
-          opts_.sigma_context, 
-          opts_.sigma_decay, 
-          opts_.sigma_bias));
-  Likelihood loglike(valset_, *sm_);
-  Gradient gradient(trainset_, *sm_, *prior);
-  HmcState<Abc> state(*crf_);
-
-  // Setup leapfrog proposal functor
-  if (opts_.hmc.sgd_epochs > 0)
-    propose_.reset(new BasinHopping(gradient, opts_.hmc, opts_.sgd, myrank));
-  else
-    propose_.reset(new Leapfrog(gradient, opts_.hmc, myrank));
+  if (partemp_ || nreplicas == 1) {
+    FILE* fout = opts_.outfile.empty() ? out_ : fopen(opts_.outfile.c_str(), "w");
+    if (!fout) throw Exception("Can't write to file '%s'!", opts_.outfile.c_str());
+    RunReplica(myrank, *crf_, partemp_.get(), fout, opts_.checkpoint);
+    if (!opts_.outfile.empty()) fclose(fout);
+
+    fout = fopen(opts_.crffile.c_str(), "w");
+    if (!fout) throw Exception("Can't write to file '%s'!", opts_.crffile.c_str());
+    crf_->Write(fout);
+    fclose(fout);
+    fprintf(out_, "\nWrote best validation set CRF to %s\n", opts_.crffile.c_str());
+    return 0;
+  }
 
-  // Run 'nsteps' HMC sampling steps
-  HmcStep(opts_.nsteps,    // number of HMC steps
-          state,           // current sampling state
-          *propose_,       // proposal functor
-          loglike,         // likelihood functor on validation set
-          opts_.hmc.seed,  // seed for Metropolis decision
-          partemp_.get(),  // parallel tempering encapsulation
-          fout);           // output stream for progress table
+#ifndef OPENMP
+  throw Exception("Parallel tempering with %d replicas requires OpenMP!", nreplicas);
+#else
+  // Run replicas as threads that share training and validation set. Files are
+  // opened and written outside of the parallel region.
+  std::vector<FILE*> fouts(nreplicas);
+  std::vector<string> crffiles(nreplicas);
+  std::vector<Crf<Abc> > crfs(nreplicas, *crf_);
+  std::vector<CheckpointParams> checkpoints(nreplicas, opts_.checkpoint);
+  for (int r = 0; r < nreplicas; ++r) {
+    crffiles[r] = opts_.crffile + strprintf(".r%d", r + 1);
+    if (!opts_.checkpoint.file.empty())
+      checkpoints[r].file += strprintf(".r%d", r + 1);
+  }
 
-  if (!opts_.outfile.empty()) fclose(fout);
+  // Replicas exchange after every step, so they can only resume together from
+  // checkpoints of the same step
+  if (opts_.checkpoint.resume) {
+    const size_t step = CheckpointStep(checkpoints[0].file);
+    for (int r = 1; r < nreplicas; ++r)
+      if (CheckpointStep(checkpoints[r].file) != step)
+        throw Exception("Checkpoints '%s' and '%s' are not of the same step!",
+                        checkpoints[0].file.c_str(), checkpoints[r].file.c_str());
+  }
 
-  fout = fopen(opts_.crffile.c_str(), "w");
-  if (!fout) throw Exception("Can't write to file '%s'!", opts_.crffile.c_str());
-  state.crf.Write(fout);
-  fclose(fout);
-  fprintf(out_, "\nWrote best validation set CRF to %s\n", opts_.crffile.c_str());
+  for (int r = 0; r < nreplicas; ++r) {
+    string outfile = opts_.outfile + strprintf(".r%d", r + 1);
+    fouts[r] = fopen(outfile.c_str(), "w");
+    if (!fouts[r]) throw Exception("Can't write to file '%s'!", outfile.c_str());
+    fprintf(out_, "Starting replica %d out of %d writing to %s ...\n",
+            r + 1, nreplicas, outfile.c_str());
+  }
+  fputs("\n", out_);
+
+  // Exceptions must not leave the parallel region; a failed replica releases
+  // the others from the exchange and its error is rethrown afterwards.
+  ReplicaBoard board(nreplicas, opts_.theta, opts_.hmc.seed);
+  std::vector<string> errors(nreplicas);
+  int nthreads = 0;
+  omp_set_dynamic(0);
+#pragma omp parallel num_threads(nreplicas)
+  {
+#pragma omp single
+    nthreads = omp_get_num_threads();
+    if (nthreads == nreplicas) {
+      const int r = omp_get_thread_num();
+      try {
+        ThreadedPT partemp(r, nreplicas, board, !opts_.no_sort);
+        RunReplica(r, crfs[r], &partemp, fouts[r], checkpoints[r]);
+      } catch (const std::exception& e) {
+        errors[r] = e.what();
+        board.Fail(r);
+      }
+    }
+  }
 
+  for (int r = 0; r < nreplicas; ++r) fclose(fouts[r]);
+  if (nthreads != nreplicas)
+    throw Exception("Only %d threads available for %d replicas!", nthreads, nreplicas);
+  if (board.failed >= 0)
+    throw Exception("Replica %d failed: %s", board.failed + 1, errors[board.failed].c_str());
+
+  for (int r = 0; r < nreplicas; ++r) {
+    FILE* fout = fopen(crffiles[r].c_str(), "w");
+    if (!fout) throw Exception("Can't write to file '%s'!", crffiles[r].c_str());
+    crfs[r].Write(fout);
+    fclose(fout);
+    fprintf(out_, "Wrote best validation set CRF of replica %d to %s\n", r + 1,
+            crffiles[r].c_str());
+  }
   return 0;
+#endif
 }
 
 }  // namespace cs
@@ -36,7 +36,12 @@ const char* CSLast::kIgnoreOptions = "";
 CSLast::CSLast(const string& dbfile,
                const LastPssm* pssm,
                const CSLastOptions& opts)
-        : dbfile_(dbfile), pssm_(pssm), opts_(opts), exec_path_() {}
+        : dbfile_(dbfile), pssms_(1, pssm), opts_(opts), exec_path_() {}
+
+CSLast::CSLast(const string& dbfile,
+               const std::vector<const LastPssm*>& pssms,
+               const CSLastOptions& opts)
+        : dbfile_(dbfile), pssms_(pssms), opts_(opts), exec_path_() {}
 
 int CSLast::Run(FILE* fout) {
     int status = 0;
@@ -90,8 +95,9 @@ int CSLast::Run(FILE* fout) {
 void CSLast::WritePssm(string filepath) const {
     FILE* fout = fopen(filepath.c_str(), "w");
     if (!fout) throw Exception("Unable to write to file '%s'!", filepath.c_str());
-    pssm_->Write(fout);
-    // pssm_->Write(stdout);
+    // Each PSSM starts with its query name, so that lastal can report
+    // consecutive PSSMs as separate queries
+    for (size_t i = 0; i < pssms_.size(); ++i) pssms_[i]->Write(fout);
     fclose(fout);
 }
 
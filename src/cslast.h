@@ -21,6 +21,7 @@
 #define CS_CSLAST_H_
 
 #include <map>
+#include <vector>
 
 #include "last_pssm.h"
 #include "sequence-inl.h"
@@ -37,6 +38,12 @@ class CSLast {
            const LastPssm* pssm,
            const CSLastOptions& opts);
 
+    // Constructor for running LAST with a batch of context-specific PSSMs in a
+    // single lastal invocation, so that the database is only loaded once.
+    CSLast(const std::string& dbfile,
+           const std::vector<const LastPssm*>& pssms,
+           const CSLastOptions& opts);
+
     // Runs one iteration of CS-LAST
     int Run(FILE* fout);
 
@@ -50,7 +57,10 @@ class CSLast {
     std::string exec_path() const { return exec_path_; }
 
     // Sets position specific scoring matrix
-    void set_pssm(const LastPssm* pssm) { pssm_ = pssm; }
+    void set_pssm(const LastPssm* pssm) { pssms_.assign(1, pssm); }
+
+    // Sets batch of position specific scoring matrices
+    void set_pssms(const std::vector<const LastPssm*>& pssms) { pssms_ = pssms; }
 
     // Sets command line options for PSI-LAST
     void set_options(const CSLastOptions& opts) { opts_ = opts; }
@@ -67,8 +77,8 @@ class CSLast {
 
     // The database file
     std::string dbfile_;
-    // LAST position-specific scoring matrix
-    const LastPssm* pssm_;
+    // LAST position-specific scoring matrices, one per query
+    std::vector<const LastPssm*> pssms_;
     // Options map with LAST specific command-line arguments
     CSLastOptions opts_;
     // Path to LAST executable
@@ -38,6 +38,7 @@ using std::vector;
 namespace cs {
 
 typedef vector<Sequence<Dna> > SeqVec;
+typedef vector<shared_ptr<LastPssm> > PssmVec;
 
 struct CSLastAppOptions {
 
@@ -47,6 +48,8 @@ struct CSLastAppOptions {
         pc_admix        = 0.90;
         pc_ali          = 12.0;
         pc_engine       = "auto";
+        batch_size      = 1000;
+        chunk_size      = 5000;
         weight_center   = 1.6;
         weight_decay    = 0.85;
     }
@@ -55,6 +58,8 @@ struct CSLastAppOptions {
     void Validate() {
         if (infile.empty()) throw Exception("No input file provided!");
         if (modelfile.empty()) throw Exception("No context data provided!");
+        if (batch_size < 0) throw Exception("Batch size must not be negative!");
+        if (chunk_size < 0) throw Exception("Chunk size must not be negative!");
     }
 
     // The input query sequence.
@@ -77,6 +82,10 @@ struct CSLastAppOptions {
     double weight_center;
     // Exponential decay of window weights
     double weight_decay;
+    // Number of queries searched per lastal invocation (0 = all at once)
+    int batch_size;
+    // Queries longer than this are processed in chunks of this size (0 = never)
+    int chunk_size;
     // LAST options map
     CSLastOptions cslast;
 };  // struct CSLastAppOptions
@@ -98,13 +107,12 @@ class CSLastApp : public Application {
     void Init();
     // Writes current PSSM in LAST format
     void SavePssm() const;
-    // Add pseudocounts and prepares CS-BLAST engine for run with given query
-    void PrepareForRun(const Sequence<Dna>& query);
+    // Adds pseudocounts to queries in [begin,end) in parallel and prepares
+    // CS-LAST engine for a single lastal run over all of them.
+    void PrepareForRun(SeqVec::const_iterator begin, SeqVec::const_iterator end);
 
     // Parameter wrapper
     CSLastAppOptions opts_;
-    // Query sequence
-    scoped_ptr<Sequence<Dna> > query_;
     // Profile library for pseudocounts
     scoped_ptr<ContextLibrary<Dna> > lib_;
     // CRF for pseudocounts
@@ -113,8 +121,10 @@ class CSLastApp : public Application {
     scoped_ptr<Pseudocounts<Dna> > pc_;
     // CS-BLAST engine
     scoped_ptr<CSLast> cslast_;
-    // PSSM for LAST jumpstarting
-    scoped_ptr<LastPssm> pssm_;
+    // PSSMs of current query batch for LAST jumpstarting
+    PssmVec pssms_;
+    // Constant admixture for chunked PSSMs
+    scoped_ptr<ConstantAdmix> admix_;
     // Substitution matrix for background frequencies
     scoped_ptr<SubstitutionMatrix<Dna> > mat_;
     // Vector with pointers to query sequences
@@ -130,6 +140,8 @@ void CSLastApp::ParseOptions(GetOpt_pp& ops) {
     ops >> Option(' ', "pc-engine", opts_.pc_engine, opts_.pc_engine);
     ops >> Option(' ', "weight-center", opts_.weight_center, opts_.weight_center);
     ops >> Option(' ', "weight-decay", opts_.weight_decay, opts_.weight_decay);
+    ops >> Option(' ', "batch-size", opts_.batch_size, opts_.batch_size);
+    ops >> Option(' ', "chunk-size", opts_.chunk_size, opts_.chunk_size);
     ops >> Option(' ', "last-path", opts_.last_path, opts_.last_path);
     ops >> Option(' ', "LAST_PATH", opts_.last_path, opts_.last_path);
 
@@ -171,6 +183,10 @@ void CSLastApp::PrintOptions() const {
             "Weight of central profile column", opts_.weight_center);
     fprintf(out_, "  %-30s %s (def=%-.2f)\n", "    --weight-decay [0,inf[",
             "Parameter for exponential decay of window weights", opts_.weight_decay);
+    fprintf(out_, "  %-30s %s (def=%d)\n", "    --batch-size <int>",
+            "Queries per lastal run, 0 searches all at once", opts_.batch_size);
+    fprintf(out_, "  %-30s %s (def=%d)\n", "    --chunk-size <int>",
+            "Stream PSSMs of longer queries in chunks, 0 disables", opts_.chunk_size);
     fprintf(out_, "  %-30s %s\n", "    --last-path <path>",
             "Path to directory with lastal executable (or set LAST_PATH)");
 }
@@ -179,16 +195,23 @@ int CSLastApp::Run() {
     int status = 0;
     Init();
 
-    for (SeqVec::iterator it = queries_.begin(); it != queries_.end(); ++it) {
-        PrepareForRun(*it);
+    // Each batch of queries shares one lastal process and thus one load of
+    // the database, which dominates runtime for short queries. Batches are
+    // bounded by default since the PSSMs of a batch are held in memory until
+    // lastal has read them. A failing batch fails the whole run.
+    const size_t batch = opts_.batch_size > 0 ? opts_.batch_size : queries_.size();
+    for (SeqVec::const_iterator it = queries_.begin(); it != queries_.end(); ) {
+        SeqVec::const_iterator end = it + MIN(batch, static_cast<size_t>(queries_.end() - it));
+        PrepareForRun(it, end);
 
         cslast_->set_options(opts_.cslast);
 
         // Run CS-LAST
         FILE* fout = opts_.outfile.empty() ? out_ : fopen(opts_.outfile.c_str(), it != queries_.begin() ? "a" : "w");
         if (!fout) throw Exception("Unable to write to '%s'!", opts_.outfile.c_str());
-        status = cslast_->Run(fout);
+        status |= cslast_->Run(fout);
         if (!opts_.outfile.empty()) fclose(fout);
+        it = end;
     }
 
     return status;
@@ -228,15 +251,32 @@ void CSLastApp::Init() {
     }
 
     mat_.reset(new TamuraNeiMatrix());
+    admix_.reset(new ConstantAdmix(opts_.pc_admix));
 }
 
-void CSLastApp::PrepareForRun(const Sequence<Dna>& query) {
-    // Setup PSSM of query profile with context-specific pseudocounts
-    ConstantAdmix admix(opts_.pc_admix);
-    pssm_.reset(new LastPssm(query, pc_->AddTo(query, admix), *mat_));
+void CSLastApp::PrepareForRun(SeqVec::const_iterator begin, SeqVec::const_iterator end) {
+    // Setup PSSMs of query profiles with context-specific pseudocounts
+    const int n = end - begin;
+    vector<LastPssm*> built(n, static_cast<LastPssm*>(NULL));
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < n; ++i) {
+        const Sequence<Dna>& query = *(begin + i);
+        if (opts_.chunk_size > 0 && query.length() > static_cast<size_t>(opts_.chunk_size)) {
+            // Rows are computed while the PSSM file is written
+            built[i] = new LastPssm(query, *pc_, *admix_, *mat_, opts_.chunk_size);
+        } else {
+            ConstantAdmix admix(opts_.pc_admix);
+            built[i] = new LastPssm(query, pc_->AddTo(query, admix), *mat_);
+        }
+    }
+    // Hand ownership over outside of the parallel region since shared_ptr
+    // reference counts are not thread-safe.
+    vector<const LastPssm*> pssms(built.begin(), built.end());
+    pssms_.clear();
+    for (int i = 0; i < n; ++i) pssms_.push_back(shared_ptr<LastPssm>(built[i]));
 
     // Setup CS-LAST engine
-    cslast_.reset(new CSLast(opts_.dbfile, pssm_.get(), opts_.cslast));
+    cslast_.reset(new CSLast(opts_.dbfile, pssms, opts_.cslast));
 
     // Set path to PSI-BLAST executable
     if (!opts_.last_path.empty())
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include <sys/stat.h>
+
+#include "cs.h"
+#include "cslast.h"
+#include "tamura_nei_matrix.h"
+
+namespace cs {
+
+// Reads all lines of file 'path'.
+static std::vector<std::string> ReadLines(const std::string& path) {
+  std::vector<std::string> lines;
+  FILE* fin = fopen(path.c_str(), "r");
+  if (!fin) return lines;
+  char buffer[KB];
+  while (fgetline(buffer, KB, fin)) lines.push_back(buffer);
+  fclose(fin);
+  return lines;
+}
+
+TEST(CSLastTest, BatchRunsOneLastalOnAllPssms) {
+  // Stand-in for lastal that logs its calls and keeps a copy of its query file
+  char dir[] = "/tmp/cslast_testXXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+  const std::string bin(dir);
+  const std::string exec = bin + "/lastal";
+  FILE* fp = fopen(exec.c_str(), "w");
+  ASSERT_TRUE(fp != NULL);
+  fprintf(fp, "#!/bin/sh\necho call >> %s/calls\nfor f; do q=$f; done\n"
+          "cp \"$q\" %s/queries\necho \"# lastal $*\"\n", dir, dir);
+  fclose(fp);
+  chmod(exec.c_str(), 0755);
+
+  TamuraNeiMatrix mat;
+  const Sequence<Dna> seq1("ACGTACGTAA", "first query");
+  const Sequence<Dna> seq2("GGGCCCTTTAAAG", "second");
+  const LastPssm pssm1(seq1, Profile<Dna>(seq1.length(), 0.25), mat);
+  const LastPssm pssm2(seq2, Profile<Dna>(seq2.length(), 0.25), mat);
+  std::vector<const LastPssm*> pssms;
+  pssms.push_back(&pssm1);
+  pssms.push_back(&pssm2);
+
+  CSLast cslast("db", pssms, CSLastOptions());
+  cslast.set_exec_path(bin);
+  FILE* fout = tmpfile();
+  EXPECT_EQ(0, cslast.Run(fout));
+  fclose(fout);
+
+  // One lastal process reads both PSSMs back to back, each starting with its
+  // name and alphabet line followed by rows numbered from 1
+  EXPECT_EQ(1u, ReadLines(bin + "/calls").size());
+  const std::vector<std::string> lines(ReadLines(bin + "/queries"));
+  ASSERT_EQ(2u + seq1.length() + 2u + seq2.length(), lines.size());
+  EXPECT_EQ("first", lines[0]);
+  EXPECT_EQ("\tA\tC\tG\tT", lines[1]);
+  EXPECT_EQ(0u, lines[2].find("1 A\t"));
+  EXPECT_EQ(0u, lines[11].find("10 A\t"));
+  EXPECT_EQ("second", lines[12]);
+  EXPECT_EQ(0u, lines[14].find("1 G\t"));
+  EXPECT_EQ(0u, lines.back().find("13 G\t"));
+
+  remove((bin + "/calls").c_str());
+  remove((bin + "/queries").c_str());
+  remove(exec.c_str());
+  rmdir(dir);
+}
+
+}  // namespace cs
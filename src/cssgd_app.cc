@@ -51,6 +51,7 @@ struct CSSgdAppOptions {
         neff_ext       = "seq";
         neff_nsamples  = 100;
         neff_pc        = 1.0;
+        float_check    = false;
     }
 
     // Validates the parameter settings and throws exception if needed.
@@ -63,6 +64,8 @@ struct CSSgdAppOptions {
         if (neff_pc <= 0 || neff_pc > 1.0) throw Exception("Pseudocounts admix for computing the Neff invalid!");
         if (sgd.eta_mode < 1 || sgd.eta_mode > 2) throw Exception("Invalid mode for updating the learning rate eta!");
         if (sgd.eta_decay < 1) throw Exception("Eta decay must greater/equal one!");
+        if (checkpoint.interval < 1) throw Exception("Checkpoint interval must be at least one epoch!");
+        if (checkpoint.resume && checkpoint.file.empty()) throw Exception("No checkpoint file to resume from!");
     }
 
     void PrintOptions(FILE* out) const {
@@ -111,6 +114,12 @@ struct CSSgdAppOptions {
         fprintf(out, "  %3s %-25s: %s\n", "", "--neff-ext", neff_ext.c_str()); 
         fprintf(out, "  %3s %-25s: %zu\n", "", "--neff-nsamples", neff_nsamples); 
         fprintf(out, "  %3s %-25s: %.2f\n", "", "--neff-pc", neff_pc); 
+        fprintf(out, "  %3s %-25s: %s\n", "", "--float-check", float_check ? "on" : "off"); 
+        fprintf(out, "\n");
+
+        fprintf(out, "  %3s %-25s: %s\n", "", "--checkpoint", checkpoint.file.c_str()); 
+        fprintf(out, "  %3s %-25s: %zu\n", "", "--checkpoint-every", checkpoint.interval); 
+        fprintf(out, "  %3s %-25s: %s\n", "", "--resume", checkpoint.resume ? "on" : "off"); 
     }
 
 
@@ -150,6 +159,10 @@ struct CSSgdAppOptions {
     size_t neff_nsamples;
     // PC admixture for calculating the Neff
     double neff_pc;
+    // Report deviation of single precision CRF predictions on the validation set
+    bool float_check;
+    // Periodic checkpoints of the optimizer state
+    CheckpointParams checkpoint;
 
 };  // CSSgdAppOptions
 
@@ -331,6 +344,7 @@ struct CSSgdRunner {
             opts_.sgd, neff_samples_, opts_.neff_pc, crf_init_.get());
         sgd.crffile_tset = opts_.crffile_tset;
         sgd.crffile_vset = opts_.crffile_vset;
+        sgd.checkpoint = opts_.checkpoint;
         sgd.Optimize(*crf_, fout);
 
         if (!opts_.outfile.empty()) fclose(fout);
@@ -339,6 +353,14 @@ struct CSSgdRunner {
         if (!opts_.crffile_tset.empty())
           fprintf(out_, "Wrote last CRF on training set to %s!\n", opts_.crffile_tset.c_str());
 
+        if (opts_.float_check) {
+            PrecisionReport r = ComparePrecision<float>(*crf_, valset_, *sm_);
+            fprintf(out_, "\nSingle precision check on %zu validation samples:\n", r.nsamples);
+            fprintf(out_, "  max. pseudocount deviation      : %.3g\n", r.max_pc);
+            fprintf(out_, "  max. log-likelihood deviation   : %.3g\n", r.max_loglike);
+            fprintf(out_, "  avg. log-likelihood float/double: %.6f / %.6f\n", r.loglike, r.loglike_ref);
+        }
+
         return 0;
     }
 
@@ -428,6 +450,10 @@ void CSSgdApp<Abc>::ParseOptions(GetOpt_pp& ops) {
     ops >> Option(' ', "neff-ext", opts_.neff_ext, opts_.neff_ext);
     ops >> Option(' ', "neff-nsamples", opts_.neff_nsamples, opts_.neff_nsamples);
     ops >> Option(' ', "neff-pc", opts_.neff_pc, opts_.neff_pc);
+    ops >> OptionPresent(' ', "float-check", opts_.float_check);
+    ops >> Option(' ', "checkpoint", opts_.checkpoint.file, opts_.checkpoint.file);
+    ops >> Option(' ', "checkpoint-every", opts_.checkpoint.interval, opts_.checkpoint.interval);
+    ops >> OptionPresent(' ', "resume", opts_.checkpoint.resume);
 
     opts_.Validate();
 }
@@ -539,6 +565,16 @@ void CSSgdApp<Abc>::PrintOptions() const {
            "Number of samples to be used for calculating the Neff", opts_.neff_nsamples);
     fprintf(out_, "  %-35s %s (def=%.2f)\n", "    --neff-pc ]0,1]",
            "Pseudocounts admix for calculating the Neff", opts_.neff_pc);
+    fprintf(out_, "  %-35s %s\n", "    --float-check",
+           "Report accuracy of single precision CRF on validation set (def=off)");
+    fprintf(out_, "\n");
+
+    fprintf(out_, "  %-35s %s (def=off)\n", "    --checkpoint <file>",
+           "Write optimizer state to checkpoint file after each interval");
+    fprintf(out_, "  %-35s %s (def=%zu)\n", "    --checkpoint-every [1,inf[",
+           "Number of epochs between checkpoints", opts_.checkpoint.interval);
+    fprintf(out_, "  %-35s %s\n", "    --resume",
+           "Continue from checkpoint file if it exists (def=off)");
 }
 
 template<class Abc>
@@ -136,8 +136,8 @@ struct CSTrainSetAppOptions {
   unsigned int seed;    // seed
   double singletons;    // fraction of singletons in training profiles
 
-  static const double kNeffMin = 1.0;
-  static const double kNeffMax = 20.0;
+  static constexpr double kNeffMin = 1.0;
+  static constexpr double kNeffMax = 20.0;
 };  // CSTrainSetAppOptions
 
 
@@ -494,7 +494,7 @@ void CSTrainSetApp<Abc>::ReadProfiles(ProgressBar& progress) {
         // No specific profiles for pseudocounts column
         if (neff >= opts_.neff_x_min && neff <= opts_.neff_x_max &&
             neff >= opts_.neff_y_min && neff <= opts_.neff_y_max) {
-          profiles_x.push_back(cp);
+          profiles_x.push_back(std::move(cp));
           files_x.push_back(filename);
           if (opts_.use_min_round) break;
         }
@@ -510,7 +510,7 @@ void CSTrainSetApp<Abc>::ReadProfiles(ProgressBar& progress) {
         } 
         if (neff >= opts_.neff_y_min && neff <= opts_.neff_y_max &&
             (!opts_.use_min_round || profiles_y.size() == 0)) {
-          profiles_y.push_back(cp);
+          profiles_y.push_back(std::move(cp));
           profiles_y_neff.push_back(neff);
         }
         if (opts_.use_min_round && profiles_x.size() > 0 && profiles_y.size() > 0) break;
@@ -522,7 +522,7 @@ void CSTrainSetApp<Abc>::ReadProfiles(ProgressBar& progress) {
     if (!profiles_xy_) {
       // Sample profile from profiles_x
       size_t ix = ran(profiles_x.size());
-      profiles_x_.push_back(profiles_x[ix]);
+      profiles_x_.push_back(std::move(profiles_x[ix]));
       files_x_.push_back(files_x[ix]);
     } else {
       // Filter profiles_y to meet the distance condition neff_d_(min|max)
@@ -533,14 +533,14 @@ void CSTrainSetApp<Abc>::ReadProfiles(ProgressBar& progress) {
       vector<double> profiles_tmp_neff;
       for (size_t i = 0; i < profiles_y.size(); ++i) {
         if (profiles_y_neff[i] >= neff_y_min && profiles_y_neff[i] <= neff_y_max) {
-          profiles_tmp.push_back(profiles_y[i]);
+          profiles_tmp.push_back(std::move(profiles_y[i]));
           profiles_tmp_neff.push_back(profiles_y_neff[i]);
         }
       }
       if (profiles_tmp.size() == 0) continue;
       // Sample profile y the for pseudocounts column
-      profiles_y = profiles_tmp;
-      profiles_y_neff = profiles_tmp_neff;
+      profiles_y.swap(profiles_tmp);
+      profiles_y_neff.swap(profiles_tmp_neff);
       size_t iy = ran(profiles_y.size());
       CountProfile<Abc>& profile_y = profiles_y[iy];
 
@@ -552,15 +552,15 @@ void CSTrainSetApp<Abc>::ReadProfiles(ProgressBar& progress) {
       profiles_tmp_neff.clear();
       for (size_t i = 0; i < profiles_x.size(); ++i) {
         if (profiles_x_neff[i] >= neff_x_min && profiles_x_neff[i] <= neff_x_max) {
-          profiles_tmp.push_back(profiles_x[i]);
+          profiles_tmp.push_back(std::move(profiles_x[i]));
           profiles_tmp_neff.push_back(profiles_x_neff[i]);
           files_tmp.push_back(files_x[i]);
         }
       }
       if (profiles_tmp.size() == 0) continue;
-      profiles_x = profiles_tmp;
-      profiles_x_neff = profiles_tmp_neff;
-      files_x = files_tmp;
+      profiles_x.swap(profiles_tmp);
+      profiles_x_neff.swap(profiles_tmp_neff);
+      files_x.swap(files_tmp);
       // Sample profile x
       size_t ix = ran(profiles_x.size());
       CountProfile<Abc>& profile_x = profiles_x[ix];
@@ -572,8 +572,8 @@ void CSTrainSetApp<Abc>::ReadProfiles(ProgressBar& progress) {
       assert(Neff(profile_y) - Neff(profile_x) >= opts_.neff_d_min && 
            Neff(profile_y) - Neff(profile_x) <= opts_.neff_d_max);
 
-      profiles_x_.push_back(profile_x);
-      profiles_y_->push_back(profile_y);
+      profiles_x_.push_back(std::move(profile_x));
+      profiles_y_->push_back(std::move(profile_y));
       files_x_.push_back(files_x[ix]);
     }
   }
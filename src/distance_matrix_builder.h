@@ -20,37 +20,108 @@
 #ifndef CS_DISTANCE_MATRIX_BUILDER_H_
 #define CS_DISTANCE_MATRIX_BUILDER_H_
 
+#include <algorithm>
+#include <map>
+
+#include "alignment-inl.h"
 #include "sequence-inl.h"
 #include "progress_bar.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace cs {
 
+// Entity at given distance in a nearest neighbour list.
+struct Neighbor {
+    Neighbor(size_t i = 0, float d = 0.0f) : index(i), distance(d) {}
+
+    // Orders by distance and then by index
+    bool operator< (const Neighbor& other) const {
+        return distance < other.distance ||
+            (distance == other.distance && index < other.index);
+    }
+
+    size_t index;    // index of neighbour
+    float distance;  // distance to neighbour
+};
+
 // Abstract builder for pairwise distance matrices.
 class DistanceMatrixBuilder {
   public:
+    // Side length of the square tiles of the matrix processed by one thread
+    static const size_t kTileSize = 64;
+
     // Derived classes need to
     DistanceMatrixBuilder(size_t dim, bool verbose) : dim_(dim), verbose_(verbose) {}
     virtual ~DistanceMatrixBuilder() {}
 
-    // Constructs the distance matrix and optionally track the progress
+    // Constructs the distance matrix on all cores. The upper triangle is cut
+    // into square tiles that are handed out to threads, which write disjoint
+    // cells of the matrix without locking.
     Matrix<float> Build() {
         if (verbose_) puts("Computing distance matrix ...");
+        Prepare();
         Matrix<float> dist(dim_, dim_, 0.0);
 
-        // Compute all pairwise distances
-        for (size_t i = 0; i < dim_ - 1; ++i) {
-            for (size_t j = i + 1; j < dim_; ++j) {
-                dist[i][j] = dist[j][i] = ComputeDistance(i,j);
-                if (verbose_) printf("  distance betwenn sequence %zu and %zu: %.4f\n", i, j, dist[i][j]);
-            }
+        std::vector< std::pair<size_t, size_t> > tiles;
+        for (size_t bi = 0; bi * kTileSize < dim_; ++bi)
+            for (size_t bj = bi; bj * kTileSize < dim_; ++bj)
+                tiles.push_back(std::make_pair(bi * kTileSize, bj * kTileSize));
+        const int ntiles = tiles.size();
+#pragma omp parallel for schedule(dynamic, 1)
+        for (int t = 0; t < ntiles; ++t) {
+            const size_t i0 = tiles[t].first, j0 = tiles[t].second;
+            for (size_t i = i0; i < MIN(dim_, i0 + kTileSize); ++i)
+                for (size_t j = MAX(j0, i + 1); j < MIN(dim_, j0 + kTileSize); ++j)
+                    dist[i][j] = dist[j][i] = ComputeDistance(i, j);
         }
+
+        if (verbose_)
+            for (size_t i = 0; i < dim_; ++i)
+                for (size_t j = i + 1; j < dim_; ++j)
+                    printf("  distance betwenn sequence %zu and %zu: %.4f\n", i, j, dist[i][j]);
         return dist;
     }
 
+    // Returns for each entity its 'k' nearest neighbours by increasing distance
+    // without storing the full matrix. Rows are filled independently on all
+    // cores, so each distance is computed from both sides.
+    std::vector< std::vector<Neighbor> > BuildNeighbors(size_t k) {
+        if (verbose_) printf("Computing %zu nearest neighbours ...\n", k);
+        Prepare();
+        std::vector< std::vector<Neighbor> > nbrs(dim_);
+        const int n = dim_;
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int i = 0; i < n; ++i) {
+            // Max-heap of the k nearest neighbours seen so far
+            std::vector<Neighbor>& heap = nbrs[i];
+            heap.reserve(k + 1);
+            for (int j = 0; j < n && k > 0; ++j) {
+                if (j == i) continue;
+                const Neighbor nb(j, ComputeDistance(i, j));
+                if (heap.size() < k) {
+                    heap.push_back(nb);
+                    std::push_heap(heap.begin(), heap.end());
+                } else if (nb < heap.front()) {
+                    std::pop_heap(heap.begin(), heap.end());
+                    heap.back() = nb;
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+            std::sort_heap(heap.begin(), heap.end());
+        }
+        return nbrs;
+    }
+
   protected:
+    // Precomputes per-entity data before distances are computed in parallel.
+    virtual void Prepare() {}
+
     // Virtual function for calculating pairwise distance between entity i and j.
-    // To be implemented by derived classes.
-    virtual float ComputeDistance(size_t i, size_t j) = 0;
+    // To be implemented by derived classes; must be safe to call concurrently.
+    virtual float ComputeDistance(size_t i, size_t j) const = 0;
 
     size_t dim_;    // dimension of matrix
     bool verbose_;  // print detailed distance info
@@ -103,23 +174,27 @@ class KmerDistanceMatrixBuilder : public DistanceMatrixBuilder {
     virtual ~KmerDistanceMatrixBuilder() {}
 
   private:
+    // Counts k-mers of all sequences not counted yet.
+    virtual void Prepare() {
+        const int nseqs = seqs_->size();
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int i = 0; i < nseqs; ++i)
+            if (counts_[i].empty()) CountKmers(seqs_->at(i), &counts_[i]);
+    }
+
     // Calculates distanace from fractional identiy between seq i and j based on
     // k-mer counts.
-    virtual float ComputeDistance(size_t i, size_t j) {
-        // Compute k-mer counts if not already cached
-      if (counts_[i].empty()) CountKmers(seqs_->at(i), &counts_[i]);
-      if (counts_[j].empty()) CountKmers(seqs_->at(j), &counts_[j]);
-
+    virtual float ComputeDistance(size_t i, size_t j) const {
         // Count common k-mers
         size_t count = 0;
         if (counts_[i].size() < counts_[j].size()) {
-            for (KmerTable::iterator it = counts_[i].begin(); it != counts_[i].end(); ++it) {
-                KmerTable::iterator it2 = counts_[j].find(it->first);
+            for (KmerTable::const_iterator it = counts_[i].begin(); it != counts_[i].end(); ++it) {
+                KmerTable::const_iterator it2 = counts_[j].find(it->first);
                 if (it2 != counts_[j].end()) count += MIN(it->second, it2->second);
             }
         } else {
-            for (KmerTable::iterator it = counts_[j].begin(); it != counts_[j].end(); ++it) {
-                KmerTable::iterator it2 = counts_[i].find(it->first);
+            for (KmerTable::const_iterator it = counts_[j].begin(); it != counts_[j].end(); ++it) {
+                KmerTable::const_iterator it2 = counts_[i].find(it->first);
                 if (it2 != counts_[i].end()) count += MIN(it->second, it2->second);
             }
         }
@@ -129,7 +204,7 @@ class KmerDistanceMatrixBuilder : public DistanceMatrixBuilder {
     }
 
     // Counts k-mers in sequence i and stores them in counts_ matrix.
-    void CountKmers(const Sequence<Abc>& seq, KmerTable* counts) {
+    void CountKmers(const Sequence<Abc>& seq, KmerTable* counts) const {
         for (size_t i = 0; i < seq.length() - kmer_length_; ++i) {
             // TODO: we can do this more efficiently by computing k-mer as
             // function of previous k-mer
@@ -156,23 +231,51 @@ class KimuraDistanceMatrixBuilder : public DistanceMatrixBuilder {
     // Constructs a distance functor over given alignment.
     KimuraDistanceMatrixBuilder(const Alignment<Abc>* ali, bool verbose = false)
             : DistanceMatrixBuilder(ali->nseqs(), verbose),
-              ali_(ali)
+              ali_(ali),
+              stride_(0)
     { }
 
     virtual ~KimuraDistanceMatrixBuilder() {}
 
   private:
-    // Calculates distanace from fractional identiy in alignment of seq i and j
-    virtual float ComputeDistance(size_t i, size_t j) {
+    // Copies match columns of each sequence into a contiguous row padded with
+    // gaps to a multiple of 16 residues.
+    virtual void Prepare() {
         const Alignment<Abc>& ali = *ali_;
+        stride_ = (ali.nmatch() + 15) / 16 * 16;
+        rows_.assign(ali.nseqs() * stride_, Abc::kGap);
+        for (size_t k = 0; k < ali.nmatch(); ++k)
+            for (size_t i = 0; i < ali.nseqs(); ++i)
+                rows_[i * stride_ + k] = ali[k][i];
+    }
+
+    // Calculates distanace from fractional identiy in alignment of seq i and j
+    virtual float ComputeDistance(size_t i, size_t j) const {
+        const uint8_t* a = &rows_[i * stride_];
+        const uint8_t* b = &rows_[j * stride_];
         size_t idents = 0, matches = 0;
 
-        for (size_t k = 0; k < ali.nmatch(); ++k) {
-            if (ali[k][i] < Abc::kGap && ali[k][j] < Abc::kGap) {
+#ifdef __SSE2__
+        // Compare 16 columns at once and count lanes with residues in both
+        // sequences and identical residues by popcount of the lane masks
+        const __m128i vlast = _mm_set1_epi8(Abc::kGap - 1);  // last residue code
+        for (size_t k = 0; k < stride_; k += 16) {
+            const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k));
+            const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k));
+            const __m128i res = _mm_and_si128(_mm_cmpeq_epi8(_mm_min_epu8(va, vlast), va),
+                                              _mm_cmpeq_epi8(_mm_min_epu8(vb, vlast), vb));
+            const __m128i eq = _mm_and_si128(res, _mm_cmpeq_epi8(va, vb));
+            matches += __builtin_popcount(_mm_movemask_epi8(res));
+            idents += __builtin_popcount(_mm_movemask_epi8(eq));
+        }
+#else
+        for (size_t k = 0; k < stride_; ++k) {
+            if (a[k] < Abc::kGap && b[k] < Abc::kGap) {
                 matches++;
-                if (ali[k][i] == ali[k][j]) idents++;
+                if (a[k] == b[k]) idents++;
             }
         }
+#endif
         // Assume the worst if no residues were aligned
         if (matches == 0) return 10.0;
         double p = 1.0 - static_cast<float>(idents) / static_cast<float>(matches);
@@ -201,6 +304,8 @@ class KimuraDistanceMatrixBuilder : public DistanceMatrixBuilder {
     static const int kNumEntries = 181;
 
     const Alignment<Abc>* ali_;  // aligned sequences to be compared
+    size_t stride_;              // padded length of rows
+    std::vector<uint8_t> rows_;  // match columns of each sequence, row by row
 };
 
 
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "cs.h"
+#include "distance_matrix_builder.h"
+
+namespace cs {
+
+using std::vector;
+
+TEST(DistanceMatrixBuilderTest, KimuraMatrixAndNeighbors) {
+  FILE* fin = fopen("../data/test/101mA.a3m", "r");
+  ASSERT_TRUE(fin != NULL);
+  Alignment<AA> ali(fin, A3M_ALIGNMENT);
+  fclose(fin);
+  const size_t n = ali.nseqs();
+
+  KimuraDistanceMatrixBuilder<AA> builder(&ali);
+  const Matrix<float> dist(builder.Build());
+  ASSERT_EQ(n, dist.nrows());
+
+  // Compare with identities counted column by column
+  for (size_t i = 0; i < n; i += 37) {
+    EXPECT_EQ(0.0f, dist[i][i]);
+    for (size_t j = i + 1; j < n; j += 11) {
+      EXPECT_EQ(dist[i][j], dist[j][i]);
+      size_t idents = 0, matches = 0;
+      for (size_t k = 0; k < ali.nmatch(); ++k) {
+        if (ali[k][i] < AA::kGap && ali[k][j] < AA::kGap) {
+          ++matches;
+          if (ali[k][i] == ali[k][j]) ++idents;
+        }
+      }
+      const double p = matches > 0 ? 1.0 - static_cast<double>(idents) / matches : 1.0;
+      if (matches > 0 && p < 0.75) {
+        EXPECT_NEAR(-log(1 - p - p * p / 5), dist[i][j], 1e-5);
+      } else if (matches == 0 || p > 0.93) {
+        EXPECT_EQ(10.0f, dist[i][j]);
+      }
+    }
+  }
+
+  // Streaming mode keeps the nearest entries of each matrix row
+  const vector< vector<Neighbor> > nbrs(builder.BuildNeighbors(5));
+  ASSERT_EQ(n, nbrs.size());
+  for (size_t i = 0; i < n; i += 53) {
+    vector<Neighbor> row;
+    for (size_t j = 0; j < n; ++j)
+      if (j != i) row.push_back(Neighbor(j, dist[i][j]));
+    std::sort(row.begin(), row.end());
+    ASSERT_EQ(5u, nbrs[i].size());
+    for (size_t r = 0; r < 5; ++r) {
+      EXPECT_EQ(row[r].index, nbrs[i][r].index);
+      EXPECT_EQ(row[r].distance, nbrs[i][r].distance);
+    }
+  }
+}
+
+TEST(DistanceMatrixBuilderTest, KmerMatrix) {
+  vector< Sequence<AA> > seqs;
+  seqs.push_back(Sequence<AA>("MKVLAAGIVGLLLAQACDEFGHIK"));
+  seqs.push_back(Sequence<AA>("MKVLAAGIVGLLLAQACDEFGHIK"));
+  seqs.push_back(Sequence<AA>("WWYYTTSSRRQQPPNNMMLLKKII"));
+  seqs.push_back(Sequence<AA>("MKVLAAGIVGLLWWYYTTSSRRQQ"));
+
+  KmerDistanceMatrixBuilder<AA> builder(&seqs, 3);
+  const Matrix<float> dist(builder.Build());
+  EXPECT_LT(dist[0][1], dist[0][3]);
+  EXPECT_GT(dist[0][2], dist[0][3]);
+  EXPECT_EQ(dist[2][3], dist[3][2]);
+
+  const vector< vector<Neighbor> > nbrs(builder.BuildNeighbors(2));
+  EXPECT_EQ(1u, nbrs[0][0].index);
+  EXPECT_EQ(3u, nbrs[0][1].index);
+  EXPECT_EQ(0u, builder.BuildNeighbors(0)[0].size());
+}
+
+}  // namespace cs
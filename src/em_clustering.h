@@ -75,7 +75,9 @@ struct EMClustering {
 
   double EStep(ProgressBar* prog_bar = NULL) {
     const int ntrain = trainset.size();
-    const size_t cidx = lib.center();
+    const int nbatches = (ntrain + kBatchSize - 1) / kBatchSize;
+    const size_t nstates = lib.size();
+    const size_t ncols = lib.wlen() * Abc::kSize;
     Emission<Abc> emission(lib.wlen(), weight_center, weight_decay, &sm);
     double oldloglike = loglike;
     loglike = 0.0;
@@ -91,34 +93,50 @@ struct EMClustering {
         probs[k][j][Abc::kAny] = 0.0;
       }
     }
-    TransformToLog(lib);  // emission scores will be calculated in log-space
-
-#pragma omp parallel for schedule(static)
-    for (int n = 0; n < ntrain; ++n) {
-      Vector<double> pp(lib.size(), 0.0);  // posterior P(z_n=k|c_n)
-      double tmp = 0.0;
-
-      // Compute posterior probs pp[k] of profile k for counts n
-      tmp = CalculatePosteriorProbs(lib, emission, trainset[n], cidx, &pp[0]);
-#pragma omp atomic
-      loglike += tmp;
-
-      // Update sufficient stasticics
-      for (size_t k = 0; k < lib.size(); ++k) {
-#pragma omp atomic
-        priors[k] += pp[k];
-        for (size_t j = 0; j < lib.wlen(); ++j) {
-          for (size_t a = 0; a < Abc::kSize; ++a) {
-#pragma omp atomic
-            probs[k][j][a] += trainset[n].counts[j][a] * pp[k];
+    InitEmissionTable(emission);
+
+#pragma omp parallel
+    {
+      Matrix<double> x(kBatchSize, ncols);        // packed count windows
+      Matrix<double> pp(kBatchSize, nstates);     // posterior P(z_n=k|c_n)
+      Matrix<double> suff(nstates, ncols, 0.0);   // thread-local statistics
+      Vector<double> suff_priors(nstates, 0.0);
+      double ll = 0.0;
+
+#pragma omp for schedule(dynamic)
+      for (int b = 0; b < nbatches; ++b) {
+        const int beg = b * kBatchSize;
+        const int nb = MIN(kBatchSize, ntrain - beg);
+        for (int i = 0; i < nb; ++i) PackWindow(trainset[beg + i], x[i]);
+        ll += CalculatePosteriors(x, nb, pp);
+
+        // Update sufficient statistics with outer product of posteriors and counts
+        for (size_t k = 0; k < nstates; ++k) {
+          double* sk = suff[k];
+          for (int i = 0; i < nb; ++i) {
+            const double ppk = pp[i][k];
+            const double* xi = x[i];
+            suff_priors[k] += ppk;
+            for (size_t o = 0; o < ncols; ++o) sk[o] += ppk * xi[o];
           }
         }
-      }
 
-      // Advance progress bar
-      if (prog_bar) {
+        // Advance progress bar
+        if (prog_bar) {
 #pragma omp critical (advance_progress)
-        prog_bar->Advance(1);
+          prog_bar->Advance(nb);
+        }
+      }
+
+#pragma omp critical (em_sufficient_statistics)
+      {
+        loglike += ll;
+        for (size_t k = 0; k < nstates; ++k) {
+          priors[k] += suff_priors[k];
+          for (size_t j = 0, o = 0; j < lib.wlen(); ++j)
+            for (size_t a = 0; a < Abc::kSize; ++a, ++o)
+              probs[k][j][a] += suff[k][o];
+        }
       }
     }
     loglike /= trainset.size() * emission.GetSumWeights();
@@ -126,6 +144,73 @@ struct EMClustering {
     return loglike - oldloglike;
   }
 
+  // Precomputes log priors and weighted log-odds w_j * (log p_k(j,a) - log p(a))
+  // of all profiles in a contiguous K x (W*kSize) table.
+  void InitEmissionTable(const Emission<Abc>& emission) {
+    const size_t ncols = lib.wlen() * Abc::kSize;
+    table.Resize(lib.size(), ncols);
+    logpriors.Resize(lib.size());
+    for (size_t k = 0; k < lib.size(); ++k) {
+      const ContextProfile<Abc>& p = lib[k];
+      logpriors[k] = p.is_log ? p.prior : log(p.prior);
+      for (size_t j = 0, o = 0; j < lib.wlen(); ++j) {
+        for (size_t a = 0; a < Abc::kSize; ++a, ++o) {
+          const double logp = p.is_log ? p.probs[j][a] : log(p.probs[j][a]);
+          table[k][o] = emission.weight(j) * (logp - log(sm.p(a)));
+        }
+      }
+    }
+  }
+
+  // Copies counts of training window 'cp' into row 'x' with zeros for window
+  // columns beyond the end of 'cp'.
+  void PackWindow(const CountProfile<Abc>& cp, double* x) const {
+    const size_t wlen = lib.wlen();
+    const size_t len = cp.counts.length();
+    for (size_t j = 0; j < wlen; ++j) {
+      double* xj = x + j * Abc::kSize;
+      if (j < len) {
+        for (size_t a = 0; a < Abc::kSize; ++a) xj[a] = cp.counts[j][a];
+      } else {
+        for (size_t a = 0; a < Abc::kSize; ++a) xj[a] = 0.0;
+      }
+    }
+  }
+
+  // Calculates posteriors pp[i][k] for the first 'nb' packed windows in 'x' as
+  // blocked matrix product with the emission table and returns the sum of
+  // their log-likelihoods.
+  double CalculatePosteriors(const Matrix<double>& x, int nb, Matrix<double>& pp) const {
+    const size_t nstates = lib.size();
+    const size_t ncols = table.ncols();
+    for (size_t k0 = 0; k0 < nstates; k0 += kStateBlockSize) {
+      const size_t k1 = MIN(nstates, k0 + kStateBlockSize);
+      for (int i = 0; i < nb; ++i) {
+        const double* xi = x[i];
+        for (size_t k = k0; k < k1; ++k) {
+          const double* tk = table[k];
+          double score = 0.0;
+          for (size_t o = 0; o < ncols; ++o) score += tk[o] * xi[o];
+          pp[i][k] = logpriors[k] + score;
+        }
+      }
+    }
+
+    // Log-sum-exp normalization of each row
+    double ll = 0.0;
+    for (int i = 0; i < nb; ++i) {
+      double* ppi = pp[i];
+      double max = -FLT_MAX;
+      for (size_t k = 0; k < nstates; ++k) max = MAX(max, ppi[k]);
+      double sum = 0.0;
+      for (size_t k = 0; k < nstates; ++k) sum += exp(ppi[k] - max);
+      const double tmp = max + log(sum);
+      for (size_t k = 0; k < nstates; ++k) ppi[k] = exp(ppi[k] - tmp);
+      ll += tmp;
+    }
+    return ll;
+  }
+
   void MStep() {
     LOG(DEBUG) << StringifyRange(&priors[0], &priors[0] + priors.size());
     Normalize(&priors[0], priors.size());
@@ -152,6 +237,11 @@ struct EMClustering {
   double weight_decay;               // exponential decay of window weights
   double pca;                        // pseudocount admix for profile probs
   double loglike;                    // current log-likelihood
+  Matrix<double> table;              // weighted log-odds of profiles in E-step
+  Vector<double> logpriors;          // log priors of profiles in E-step
+
+  static const int kBatchSize = 64;         // training windows per batch in E-step
+  static const size_t kStateBlockSize = 64; // profiles per block in E-step
 };
 
 
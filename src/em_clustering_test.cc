@@ -54,4 +54,41 @@ TEST_F(EMClusteringTestGCN4, InitByGaussian) {
   EXPECT_EQ(22, iters);
 }
 
+TEST(EMClusteringTest, EStepEqualsPerWindowPosteriors) {
+  BlosumMatrix m;
+  GaussianLibraryInit<AA> init(0.3, m, 123);
+  ContextLibrary<AA> lib(100, 13, init);
+
+  // Random count windows, one shorter than the library window
+  Ran ran(0);
+  std::vector<CountProfile<AA> > tset;
+  for (size_t n = 0; n < 150; ++n) {
+    CountProfile<AA> cp(n == 0 ? 10 : 13);
+    for (size_t i = 0; i < cp.counts.length(); ++i) {
+      for (size_t a = 0; a < AA::kSize; ++a) cp.counts[i][a] = ran.doub();
+      Normalize(cp.counts[i], 1.0);
+    }
+    tset.push_back(cp);
+  }
+
+  EMClustering<AA> em(tset, lib, m, 1.6, 0.85, 1e-5);
+  em.EStep();
+
+  ContextLibrary<AA> log_lib(lib);
+  TransformToLog(log_lib);
+  Emission<AA> emission(13, 1.6, 0.85, &m);
+  Vector<double> pp(lib.size());
+  Vector<double> priors(lib.size(), 0.0);
+  double loglike = 0.0;
+  for (size_t n = 0; n < tset.size(); ++n) {
+    loglike += CalculatePosteriorProbs(log_lib, emission, tset[n], lib.center(), &pp[0]);
+    for (size_t k = 0; k < lib.size(); ++k) priors[k] += pp[k];
+  }
+  loglike /= tset.size() * emission.GetSumWeights();
+
+  EXPECT_NEAR(loglike, em.loglike, 1e-8);
+  for (size_t k = 0; k < lib.size(); ++k)
+    EXPECT_NEAR(priors[k], em.priors[k], 1e-8);
+}
+
 }  // namespace cs
@@ -21,6 +21,7 @@
 #define CS_EMISSION_H_
 
 #include "count_profile-inl.h"
+#include "kernel_shape.h"
 #include "profile-inl.h"
 #include "profile_column.h"
 #include "substitution_matrix-inl.h"
@@ -38,7 +39,8 @@ class Emission {
 	     double w_center = 1.6,
 	     double w_decay = 0.85,
 	     const SubstitutionMatrix<Abc>* sm = NULL)
-	    : center_((wlen - 1) / 2), weights_(wlen), logp_(0.0) {
+	    : center_((wlen - 1) / 2), weights_(wlen), logp_(1, 0.0),
+	      fixed_(HasFixedKernel<Abc>(wlen)) {
 	assert(wlen & 1);
 
 	weights_[center_] = w_center;
@@ -50,7 +52,7 @@ class Emission {
 
 	if (sm) {
 	    for (size_t a = 0; a < Abc::kSize; ++a)
-		logp_[a] = log(sm->p(a));
+		logp_[0][a] = log(sm->p(a));
 	}
     }
 
@@ -61,6 +63,9 @@ class Emission {
 	return sum;
     }
 
+    // Returns the weight of window column 'j'.
+    double weight(size_t j) const { return weights_[j]; }
+
     // Calculates the log of the probability that profile 'p' emits the sequence
     // window centered at index 'idx' in 'seq'. Note that the normalization factor
     // that is usualy used in multinomial distributions is left out since it
@@ -71,11 +76,14 @@ class Emission {
 	assert(p.length() & 1);
 	assert_eq(weights_.size(), p.length());
 
+	if (fixed_ && IsFullWindow(idx, seq.length(), weights_.size()))
+	    return FixedScore<KernelShape<Abc>::kWlen>(p, seq, idx);
+
 	const size_t beg = MAX(0, static_cast<int>(idx - center_));
 	const size_t end = MIN(seq.length(), idx + center_ + 1);
 	double rv = 0.0;
 	for(size_t i = beg, j = beg - idx + center_; i < end; ++i, ++j) {
-	    rv += weights_[j] * (p[j][seq[i]] - logp_[seq[i]]);
+	    rv += weights_[j] * (p[j][seq[i]] - logp_[0][seq[i]]);
 	}
 	return rv;
     }
@@ -90,22 +98,51 @@ class Emission {
 	assert(p.length() & 1);
 	assert_eq(weights_.size(), p.length());
 
+	if (fixed_ && IsFullWindow(idx, cp.counts.length(), weights_.size()))
+	    return FixedScore<KernelShape<Abc>::kWlen, KernelShape<Abc>::kSize>(p, cp, idx);
+
 	const size_t beg = MAX(0, static_cast<int>(idx - center_));
 	const size_t end = MIN(cp.counts.length(), idx + center_ + 1);
-	double sum, rv = 0.0;
+	double rv = 0.0;
 	for(size_t i = beg, j = beg - idx + center_; i < end; ++i, ++j) {
-	    sum = 0.0;
-	    for (size_t a = 0; a < Abc::kSize; ++a)
-		sum += cp.counts[i][a] * (p[j][a] - logp_[a]);
-	    rv += weights_[j] * sum;
+	    const double* c = cp.counts[i];
+	    rv += weights_[j] * (RowDot(c, p[j], Abc::kSize) - RowDot(c, logp_[0], Abc::kSize));
 	}
 	return rv;
     }
 
   private:
+    // Emission kernel for sequence windows of W columns without bounds checks.
+    template<size_t W>
+    double FixedScore(const Profile<Abc>& p,
+		      const Sequence<Abc>& seq,
+		      size_t idx) const {
+	const typename Sequence<Abc>::value_type* x = &seq[idx - (W - 1) / 2];
+	double rv = 0.0;
+	for (size_t j = 0; j < W; ++j)
+	    rv += weights_[j] * (p[j][x[j]] - logp_[0][x[j]]);
+	return rv;
+    }
+
+    // Emission kernel for count profile windows of W columns over an alphabet
+    // of size A without bounds checks.
+    template<size_t W, size_t A>
+    double FixedScore(const Profile<Abc>& p,
+		      const CountProfile<Abc>& cp,
+		      size_t idx) const {
+	const size_t beg = idx - (W - 1) / 2;
+	double rv = 0.0;
+	for (size_t j = 0; j < W; ++j) {
+	    const double* c = cp.counts[beg + j];
+	    rv += weights_[j] * (RowDot(c, p[j], A) - RowDot(c, logp_[0], A));
+	}
+	return rv;
+    }
+
     size_t center_;            // index of central column in context window
     Vector<double> weights_;   // positional window weights
-    ProfileColumn<Abc> logp_;  // log of background frequencies
+    Profile<Abc> logp_;        // log of background frequencies in one aligned row
+    bool fixed_;               // use kernels for fixed window shape
 };  // class Emission
 
 }  // namespace cs
@@ -22,6 +22,7 @@
 
 #include "context_library-inl.h"
 #include "crf-inl.h"
+#include "crf_kernels.h"
 #include "emission.h"
 #include "progress_bar.h"
 #include "substitution_matrix-inl.h"
@@ -43,6 +44,25 @@ struct TrainingBlock {
 };
 
 
+// Sparsity pattern of the likelihood gradient within a training block. For
+// one-hot inputs only context weights of residues occuring in some window of the
+// block receive a non-zero gradient. Since the pattern is the same for all CRF
+// states, it is stored as sorted offsets relative to the first weight of a state.
+// Being a union over all windows of the block, the pattern is only sparse for
+// blocks of a few dozen windows: with amino acid background frequencies it
+// covers about 45% of the context weights for 10 windows, 90% for 50 and all of
+// them for the default blocks of thousands of windows.
+struct GradientPattern {
+    GradientPattern() {}
+
+    // Returns number of touched weights per CRF state.
+    size_t size() const { return offsets.size(); }
+
+    std::vector<size_t> offsets;  // offsets of touched weights within a state
+    std::vector<bool> mask;       // flags of touched context weights (wlen x alphabet)
+};
+
+
 template<class Abc, class TrainingPair>
 struct ContextLibFunc {
     typedef std::vector<TrainingPair> TrainingSet;
@@ -196,6 +216,27 @@ struct DerivCrfFuncPrior {
             Vector<double>& grad,
             const TrainingBlock& block) const = 0;
 
+    // Calculates the gradient only for the weights in the given pattern. Entries
+    // outside of the pattern may be left undefined. The default implementation
+    // falls back to the dense gradient.
+    virtual void CalculateGradient (
+            const Crf<Abc>& crf,
+            Vector<double>& grad,
+            const TrainingBlock& block,
+            const GradientPattern& pattern) const {
+        CalculateGradient(crf, grad, block);
+    }
+
+    // Returns true if the prior gradient of each context weight is a column-specific
+    // multiple of the weight itself, i.e. dprior/dw[j][a] = fac[j] * w[j][a]. In this
+    // case the prior of weights outside of a gradient pattern can be applied lazily.
+    virtual bool ContextDecay(
+            const Crf<Abc>& crf,
+            const TrainingBlock& block,
+            Vector<double>& fac) const {
+        return false;
+    }
+
     virtual ~DerivCrfFuncPrior() {}
 
     double sigma_bias;
@@ -296,6 +337,52 @@ struct GaussianDerivCrfFuncPrior : public DerivCrfFuncPrior<Abc> {
         }
     }
 
+    void CalculateGradient(
+            const Crf<Abc>& crf,
+            Vector<double>& grad,
+            const TrainingBlock& block,
+            const GradientPattern& pattern) const {
+        Vector<double> fac_context(crf.wlen());
+        if (!ContextDecay(crf, block, fac_context)) {
+            CalculateGradient(crf, grad, block);
+            return;
+        }
+        const double fac_bias = -block.frac / SQR(sigma_bias);
+        const double fac_pc = -block.frac / SQR(sigma_pc);
+        const size_t nctx = crf.wlen() * Abc::kSize;
+        const size_t stride = 1 + nctx + Abc::kSize;
+        const int c = crf.center();
+
+        for (size_t k = 0; k < crf.size(); ++k) {
+            const double* cw = crf[k].context_weights[c];
+            double* g = &grad[k * stride];
+            for (size_t i = 0; i < pattern.size(); ++i) {
+                const size_t o = pattern.offsets[i];
+                if (o == 0) {
+                    g[o] = fac_bias * crf[k].bias_weight;
+                } else if (o <= nctx) {
+                    const size_t j = (o - 1) / Abc::kSize;
+                    const size_t a = (o - 1) % Abc::kSize;
+                    g[o] = fac_context[j] * crf[k].context_weights[j][a];
+                } else {
+                    const size_t a = o - 1 - nctx;
+                    g[o] = fac_pc * (crf[k].pc_weights[a] - cw[a] / sigma_context);
+                }
+            }
+        }
+    }
+
+    bool ContextDecay(
+            const Crf<Abc>& crf,
+            const TrainingBlock& block,
+            Vector<double>& fac) const {
+        if (context_penalty != 0.0) return false;
+        const int c = crf.center();
+        for (size_t j = 0; j < crf.wlen(); ++j)
+            fac[j] = -block.frac / SQR(sigma_context * pow(sigma_decay, fabs(static_cast<int>(j) - c)));
+        return true;
+    }
+
     using DerivCrfFuncPrior<Abc>::sigma_bias;
     using DerivCrfFuncPrior<Abc>::sigma_context;
     using DerivCrfFuncPrior<Abc>::sigma_decay;
@@ -543,11 +630,46 @@ struct DerivCrfFunc : public CrfFunc<Abc, TrainingPair> {
             ProgressBar* prog_bar = NULL) const {
         assert(b < nblocks);
         const TrainingBlock block(GetBlock(b, nblocks));
-        const int n_beg = block.beg;
-        const int n_end = block.end;
-        const size_t center = s.crf.center();
         Matrix<double> mpp(block.size, s.crf.size(), 0.0);  // posterior P(k|c_n)
         Matrix<double> mpa(block.size, Abc::kSize, 0.0);    // pseudocounts P(a|c_n)
+
+        s.loglike += CalculatePosteriors(s.crf, block, mpp, mpa);
+        s.prior   += block.frac * prior(s.crf);
+
+        CalculateLikelihoodGradient(trainset, block, s.crf, mpp, mpa, s.grad_loglike, prog_bar);
+        prior.CalculateGradient(s.crf, s.grad_prior, block);
+    }
+
+    // Sparse version of 'df' that calculates gradients only for the weights in
+    // 'pattern' and leaves all other entries untouched. In contrast to 'df' the
+    // prior is not added to the likelihood since this would require a sweep over
+    // all weights.
+    void df(DerivCrfFuncIO<Abc>& s,
+            size_t b,
+            size_t nblocks,
+            const GradientPattern& pattern,
+            ProgressBar* prog_bar = NULL) const {
+        assert(b < nblocks);
+        const TrainingBlock block(GetBlock(b, nblocks));
+        Matrix<double> mpp(block.size, s.crf.size(), 0.0);  // posterior P(k|c_n)
+        Matrix<double> mpa(block.size, Abc::kSize, 0.0);    // pseudocounts P(a|c_n)
+
+        s.loglike += CalculatePosteriors(s.crf, block, mpp, mpa);
+
+        CalculateLikelihoodGradient(trainset, block, s.crf, mpp, mpa, s.grad_loglike,
+                                    pattern, prog_bar);
+        prior.CalculateGradient(s.crf, s.grad_prior, block, pattern);
+    }
+
+    // Calculates posterior probabilities 'mpp' and predicted pseudocounts 'mpa' for
+    // all training points in 'block' and returns their log-likelihood.
+    double CalculatePosteriors(const Crf<Abc>& crf,
+                               const TrainingBlock& block,
+                               Matrix<double>& mpp,
+                               Matrix<double>& mpa) const {
+        const int n_beg = block.beg;
+        const int n_end = block.end;
+        const size_t center = crf.center();
         double loglike = 0.0;
 
 #pragma omp parallel for schedule(static)
@@ -559,23 +681,23 @@ struct DerivCrfFunc : public CrfFunc<Abc, TrainingPair> {
 
             // Calculate posterior probability pp[k] of state k given count profile n
             double max = -DBL_MAX;
-            for (size_t k = 0; k < s.crf.size(); ++k) {
-                pp[k] = s.crf[k].bias_weight +
-                    ContextScore(s.crf[k].context_weights, tpair.x, center, center);
+            for (size_t k = 0; k < crf.size(); ++k) {
+                pp[k] = crf[k].bias_weight +
+                    ContextScore(crf[k].context_weights, tpair.x, center, center);
                 if (pp[k] > max) max = pp[k];  // needed for log-sum-exp trick
             }
 
             // Log-sum-exp trick begins here
             double sum = 0.0;
-            for (size_t k = 0; k < s.crf.size(); ++k)
+            for (size_t k = 0; k < crf.size(); ++k)
                 sum += exp(pp[k] - max);
             double tmp = max + log(sum);
 
-            for (size_t k = 0; k < s.crf.size(); ++k) {
+            for (size_t k = 0; k < crf.size(); ++k) {
                 pp[k] = DBL_MIN + exp(pp[k] - tmp);
                 // Calculate pseudocounts p(a|c_n)
                 for (size_t a = 0; a < Abc::kSize; ++a)
-                    pa[a] += s.crf[k].pc[a] * pp[k];
+                    pa[a] += crf[k].pc[a] * pp[k];
             }
 
             long double loglike_n = 0.0;
@@ -586,12 +708,44 @@ struct DerivCrfFunc : public CrfFunc<Abc, TrainingPair> {
 #pragma omp atomic
             loglike += loglike_n;
         }
+        return loglike;
+    }
 
-        s.loglike += loglike;
-        s.prior   += block.frac * prior(s.crf);
+    // Computes the gradient pattern of one-hot training sequences in 'block'.
+    // Returns false if the gradient has no such pattern. A pattern covering all
+    // weights is still returned, since a sparse step saves the prior sweep of a
+    // dense step regardless of the pattern size.
+    bool GetGradientPattern(const std::vector<TrainingSequence<Abc> >& tset,
+                            const TrainingBlock& block,
+                            size_t wlen,
+                            GradientPattern& pattern) const {
+        const size_t center = (wlen - 1) / 2;
+        pattern.mask.assign(wlen * Abc::kSize, false);
+        for (size_t n = block.beg; n < block.end; ++n) {
+            const Sequence<Abc>& x = tset[shuffle[n]].x;
+            for (size_t j = 0; j < wlen; ++j)
+                if (x[j] != Abc::kAny) pattern.mask[j * Abc::kSize + x[j]] = true;
+        }
+        // The central column is always included since the pseudocount prior
+        // depends on it.
+        for (size_t a = 0; a < Abc::kSize; ++a)
+            pattern.mask[center * Abc::kSize + a] = true;
+
+        pattern.offsets.clear();
+        pattern.offsets.push_back(0);
+        for (size_t i = 0; i < pattern.mask.size(); ++i)
+            if (pattern.mask[i]) pattern.offsets.push_back(1 + i);
+        for (size_t a = 0; a < Abc::kSize; ++a)
+            pattern.offsets.push_back(1 + pattern.mask.size() + a);
+        return true;
+    }
 
-        CalculateLikelihoodGradient(trainset, block, s.crf, mpp, mpa, s.grad_loglike, prog_bar);
-        prior.CalculateGradient(s.crf, s.grad_prior, block);
+    // Gradients of training profiles are dense.
+    bool GetGradientPattern(const std::vector<TrainingProfile<Abc> >& tset,
+                            const TrainingBlock& block,
+                            size_t wlen,
+                            GradientPattern& pattern) const {
+        return false;
     }
 
     // This is the performance critical method in HMC sampling. It accounts for about
@@ -725,6 +879,72 @@ struct DerivCrfFunc : public CrfFunc<Abc, TrainingPair> {
 
     }
 
+    // Sparse version of the likelihood gradient for training sequences. Only the
+    // weights in 'pattern' are reset and updated, which makes the cost of a block
+    // proportional to the number of non-zeros rather than to the number of weights.
+    void CalculateLikelihoodGradient(const std::vector<TrainingSequence<Abc> >& tset,
+                                     const TrainingBlock& block,
+                                     const Crf<Abc>& crf,
+                                     const Matrix<double>& mpp,
+                                     const Matrix<double>& mpa,
+                                     Vector<double>& grad,
+                                     const GradientPattern& pattern,
+                                     ProgressBar* prog_bar) const {
+        const size_t wlen = crf.wlen();
+        const int nstates = crf.size();
+
+#pragma omp parallel for schedule(static)
+        for (int k = 0; k < nstates; ++k) {
+            const double* pc = &(crf[k].pc[0]);
+            double fit, sum = 0.0;
+            double* g = &grad[k * (1 + (wlen + 1) * Abc::kSize)];
+            for (size_t i = 0; i < pattern.size(); ++i)
+                g[pattern.offsets[i]] = 0.0;
+
+            for (size_t n = block.beg; n < block.end; ++n) {
+                const size_t m = n - block.beg;
+                const double* pa = &mpa[m][0];
+                const TrainingSequence<Abc>& tseq = tset[shuffle[n]];
+
+                fit = 0.0;
+                sum = 0.0;
+                for (size_t a = 0; a < Abc::kSize; ++a) {
+                    fit += tseq.y[a] * (pc[a] / pa[a] - 1.0);
+                    sum += pc[a] * tseq.y[a] / pa[a];
+                }
+                double mpp_fit = MIN(DBL_MAX, mpp[m][k] * fit);
+                sum = MIN(DBL_MAX, sum);
+
+                g[0] += mpp_fit;
+                for(size_t j = 0, i = 1; j < wlen; ++j, i += Abc::kSize)
+                    if (tseq.x[j] != Abc::kAny)
+                        g[i + tseq.x[j]] += mpp_fit;
+
+                double* gpc = g + 1 + wlen * Abc::kSize;
+                for (size_t a = 0; a < Abc::kSize; ++a) {
+                    double d = MIN(DBL_MAX, tseq.y[a] / pa[a]);
+                    gpc[a] += mpp[m][k] * pc[a] * (d - sum);
+                }
+            }
+            if (prog_bar) {
+#pragma omp critical (advance_progress)
+                prog_bar->Advance(block.end - block.beg);
+            }
+        }
+    }
+
+    // Gradients of training profiles are dense.
+    void CalculateLikelihoodGradient(const std::vector<TrainingProfile<Abc> >& tset,
+                                     const TrainingBlock& block,
+                                     const Crf<Abc>& crf,
+                                     const Matrix<double>& mpp,
+                                     const Matrix<double>& mpa,
+                                     Vector<double>& grad,
+                                     const GradientPattern& pattern,
+                                     ProgressBar* prog_bar) const {
+        CalculateLikelihoodGradient(tset, block, crf, mpp, mpa, grad, prog_bar);
+    }
+
     using CrfFunc<Abc, TrainingPair>::trainset;
     using CrfFunc<Abc, TrainingPair>::sm;
     std::vector<int> shuffle;
@@ -60,6 +60,26 @@ struct HmcState : public DerivCrfFuncIO<Abc> {
   size_t steps;  // number of leapfrog steps already performed
 };
 
+template<class Abc>
+void WriteBinary(FILE* fout, const HmcState<Abc>& s) {
+  WriteBinary(fout, s.crf);
+  WriteBinary(fout, s.grad_loglike);
+  WriteBinary(fout, s.grad_prior);
+  WriteBinary(fout, s.loglike);
+  WriteBinary(fout, s.prior);
+  WriteBinary(fout, s.steps);
+}
+
+template<class Abc>
+void ReadBinary(FILE* fin, HmcState<Abc>& s) {
+  ReadBinary(fin, s.crf);
+  ReadBinary(fin, s.grad_loglike);
+  ReadBinary(fin, s.grad_prior);
+  ReadBinary(fin, s.loglike);
+  ReadBinary(fin, s.prior);
+  ReadBinary(fin, s.steps);
+}
+
 
 template<class Abc, class TrainingPair>
 struct LeapfrogProposal {
@@ -189,6 +209,20 @@ struct LeapfrogProposal {
     return 0.5 * rv;
   }
 
+  // Writes step size, temperature and momentum RNG state to checkpoint stream.
+  virtual void WriteCheckpoint(FILE* fout) const {
+    WriteBinary(fout, epsilon);
+    WriteBinary(fout, temp);
+    WriteBinary(fout, static_cast<const Ran&>(gauss));
+  }
+
+  // Restores state written by WriteCheckpoint().
+  virtual void ReadCheckpoint(FILE* fin) {
+    ReadBinary(fin, epsilon);
+    ReadBinary(fin, temp);
+    ReadBinary(fin, static_cast<Ran&>(gauss));
+  }
+
   DerivCrfFunc<Abc, TrainingPair> func;  // functor for gradient calculation
   size_t nsteps;           // number of leapfrog steps
   double epsilon;          // time step epsilon
@@ -260,6 +294,19 @@ struct BasinHoppingProposal : public LeapfrogProposal<Abc, TrainingPair> {
     return MIN(1.0, exp(epot1 - epot2));;
   }
 
+  virtual void WriteCheckpoint(FILE* fout) const {
+    LeapfrogProposal<Abc, TrainingPair>::WriteCheckpoint(fout);
+    sgd.WriteCheckpoint(fout);
+  }
+
+  virtual void ReadCheckpoint(FILE* fin) {
+    LeapfrogProposal<Abc, TrainingPair>::ReadCheckpoint(fin);
+    sgd.ReadCheckpoint(fin);
+  }
+
+  using LeapfrogProposal<Abc, TrainingPair>::GetPotentialEnergy;
+  using LeapfrogProposal<Abc, TrainingPair>::InitGradient;
+  using LeapfrogProposal<Abc, TrainingPair>::LeapfrogIntegration;
   using LeapfrogProposal<Abc, TrainingPair>::func;
   using LeapfrogProposal<Abc, TrainingPair>::nsteps;
   using LeapfrogProposal<Abc, TrainingPair>::nblocks;
@@ -271,6 +318,22 @@ struct BasinHoppingProposal : public LeapfrogProposal<Abc, TrainingPair> {
 };
 
 
+// Returns the number of sampling steps completed in HMC checkpoint 'path' or
+// zero if the checkpoint does not exist.
+inline size_t CheckpointStep(const std::string& path) {
+  FILE* fin = OpenCheckpoint(path, "HMC");
+  if (!fin) return 0;
+  size_t step = 0;
+  try {
+    ReadBinary(fin, step);
+  } catch (const std::exception&) {
+    fclose(fin);
+    throw;
+  }
+  fclose(fin);
+  return step;
+}
+
 // Driver function for performin 'm' steps of HMC sampling, starting at state 's'
 // and proposing new candaidate solutions with proposal functor 'propose'
 template<class Abc, class TrainingPair>
@@ -280,7 +343,8 @@ double HmcStep(size_t m,                                         // sampling ste
                const CrfFunc<Abc, TrainingPair>& loglike, // LL on valid. set
                unsigned int seed = 0,
                ParallelTempering<Abc, TrainingPair>* parallel_tempering = NULL,
-               FILE* fout = stdout) {
+               FILE* fout = stdout,
+               const CheckpointParams* checkpoint = NULL) {
   HmcState<Abc> sprop(s);     // storage for next sample
   HmcState<Abc> sbest(s);     // best solution found so far
   int accept = 0;             // number of accepted samples
@@ -297,8 +361,27 @@ double HmcStep(size_t m,                                         // sampling ste
     fprintf(fout, "%s\n", std::string(80, '-').c_str());
   }
 
-  ll_best = loglike(sprop.crf);
-  for (size_t i = 0; i < m; ++i) {
+  // Continue from checkpoint or evaluate the start point
+  size_t start = 0;
+  FILE* fin = checkpoint && checkpoint->resume ?
+    OpenCheckpoint(checkpoint->file, "HMC") : NULL;
+  if (fin) {
+    ReadBinary(fin, start);
+    ReadBinary(fin, accept);
+    ReadBinary(fin, ll_best);
+    ReadBinary(fin, s);
+    ReadBinary(fin, sbest);
+    ReadBinary(fin, ran);
+    propose.ReadCheckpoint(fin);
+    if (parallel_tempering) parallel_tempering->ReadCheckpoint(fin);
+    fclose(fin);
+    if (fout) fprintf(fout, "Resuming at step %zu from %s\n", start + 1,
+                      checkpoint->file.c_str());
+  } else {
+    ll_best = loglike(sprop.crf);
+  }
+
+  for (size_t i = start; i < m; ++i) {
     if (fout) {
       fprintf(fout, "%-4zu %5.2f  %6.1g  ", i+1, propose.temp, propose.epsilon);
       fflush(fout);
@@ -330,6 +413,21 @@ double HmcStep(size_t m,                                         // sampling ste
 
     if (parallel_tempering)
       parallel_tempering->ReplicaExchange(s.loglike, propose.temp);
+
+    // Write state after step 'i' to checkpoint file
+    if (checkpoint && !checkpoint->file.empty() &&
+        (i + 1) % checkpoint->interval == 0) {
+      FILE* chk = BeginCheckpoint(checkpoint->file, "HMC");
+      WriteBinary(chk, i + 1);
+      WriteBinary(chk, accept);
+      WriteBinary(chk, ll_best);
+      WriteBinary(chk, s);
+      WriteBinary(chk, sbest);
+      WriteBinary(chk, ran);
+      propose.WriteCheckpoint(chk);
+      if (parallel_tempering) parallel_tempering->WriteCheckpoint(chk);
+      CommitCheckpoint(chk, checkpoint->file);
+    }
   }
   s = sbest;
   return accept / static_cast<double>(m);
@@ -0,0 +1,195 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cs.h"
+#include "karlin_altschul.h"
+
+using std::vector;
+
+namespace cs {
+
+// Maximal number of terms and cutoff of the series for K, as in NCBI BLAST.
+static const int kMaxIterations = 100;
+static const double kSumLimit = 1e-4;
+
+const double KarlinAltschulCache::kResolution = 1e-5;
+
+KarlinAltschulParams Blosum62GappedParams(int gap_open, int gap_extend) {
+  // Gap open, gap extend, lambda, K, H from NCBI BLAST (blast_stat.c)
+  static const double kParams[][5] = {
+    { 11, 2, 0.297, 0.082, 0.27 },
+    { 10, 2, 0.291, 0.075, 0.23 },
+    {  9, 2, 0.279, 0.058, 0.19 },
+    {  8, 2, 0.264, 0.045, 0.15 },
+    {  7, 2, 0.239, 0.027, 0.10 },
+    {  6, 2, 0.201, 0.012, 0.061 },
+    { 13, 1, 0.292, 0.071, 0.23 },
+    { 12, 1, 0.283, 0.059, 0.19 },
+    { 11, 1, 0.267, 0.041, 0.14 },
+    { 10, 1, 0.243, 0.024, 0.10 },
+    {  9, 1, 0.206, 0.010, 0.052 }
+  };
+  for (size_t k = 0; k < sizeof(kParams) / sizeof(kParams[0]); ++k)
+    if (kParams[k][0] == gap_open && kParams[k][1] == gap_extend)
+      return KarlinAltschulParams(kParams[k][2], kParams[k][3], kParams[k][4]);
+  throw Exception("Gap costs %d/%d are not supported for BLOSUM62 statistics!",
+                  gap_open, gap_extend);
+}
+
+KarlinAltschulParams Blosum62UngappedParams() {
+  return KarlinAltschulParams(0.3176, 0.134, 0.4012);
+}
+
+// Returns sum_k p[k] * exp(lambda * (low + k)).
+static double MomentGenerating(const vector<double>& p, int low, double lambda) {
+  double sum = 0.0;
+  for (size_t k = 0; k < p.size(); ++k)
+    if (p[k] > 0.0) sum += p[k] * exp(lambda * (low + static_cast<int>(k)));
+  return sum;
+}
+
+static int Gcd(int a, int b) {
+  while (b != 0) {
+    const int t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+KarlinAltschulParams UngappedParams(const ScoreProbabilities& probs) {
+  // Strip scores with zero probability at both ends and normalize
+  size_t b = 0, e = probs.p.size();
+  while (b < e && probs.p[b] <= 0.0) ++b;
+  while (e > b && probs.p[e - 1] <= 0.0) --e;
+  if (b == e) return KarlinAltschulParams();
+  vector<double> p(probs.p.begin() + b, probs.p.begin() + e);
+  const int low = probs.low + static_cast<int>(b);
+  const int high = low + static_cast<int>(p.size()) - 1;
+  double total = 0.0, mean = 0.0;
+  for (size_t k = 0; k < p.size(); ++k) total += p[k];
+  for (size_t k = 0; k < p.size(); ++k) {
+    p[k] /= total;
+    mean += p[k] * (low + static_cast<int>(k));
+  }
+  if (mean >= 0.0 || high <= 0) return KarlinAltschulParams();
+
+  // Lambda is the positive root of sum_s p(s) exp(lambda * s) = 1
+  double lo = 0.0, hi = 0.5;
+  while (MomentGenerating(p, low, hi) <= 1.0) {
+    lo = hi;
+    hi *= 2.0;
+  }
+  for (int n = 0; n < 60; ++n) {
+    const double mid = 0.5 * (lo + hi);
+    if (MomentGenerating(p, low, mid) > 1.0) hi = mid; else lo = mid;
+  }
+  const double lambda = 0.5 * (lo + hi);
+
+  double H = 0.0;
+  for (size_t k = 0; k < p.size(); ++k) {
+    const int s = low + static_cast<int>(k);
+    H += p[k] * s * exp(lambda * s);
+  }
+  H *= lambda;
+
+  // The series for K runs over scores in units of their greatest common divisor
+  int delta = 0;
+  for (size_t k = 0; k < p.size(); ++k)
+    if (p[k] > 0.0) delta = Gcd(delta, abs(low + static_cast<int>(k)));
+  const int dlow = low / delta;
+  vector<double> step(high / delta - dlow + 1, 0.0);
+  for (size_t k = 0; k < p.size(); ++k)
+    if (p[k] > 0.0) step[(low + static_cast<int>(k)) / delta - dlow] += p[k];
+  const double dlambda = lambda * delta;
+
+  // sigma = sum_k 1/k * (E[exp(lambda * S_k); S_k < 0] + P(S_k >= 0)) for the
+  // sum S_k of k random scores, whose distribution is built by convolution
+  vector<double> dist(step), next;
+  int klow = dlow;
+  double sigma = 0.0;
+  for (int k = 1; k <= kMaxIterations; ++k) {
+    double inner = 0.0;
+    for (size_t j = 0; j < dist.size(); ++j) {
+      const int s = klow + static_cast<int>(j);
+      inner += s < 0 ? dist[j] * exp(dlambda * s) : dist[j];
+    }
+    sigma += inner / k;
+    if (inner / k < kSumLimit) break;
+
+    next.assign(dist.size() + step.size() - 1, 0.0);
+    for (size_t j = 0; j < dist.size(); ++j)
+      if (dist[j] > 0.0)
+        for (size_t l = 0; l < step.size(); ++l)
+          next[j + l] += dist[j] * step[l];
+    dist.swap(next);
+    klow += dlow;
+  }
+  const double K = dlambda * exp(-2.0 * sigma) / (H * (1.0 - exp(-dlambda)));
+
+  return KarlinAltschulParams(lambda, K, H);
+}
+
+KarlinAltschulParams ScaledGappedParams(const KarlinAltschulParams& ungapped,
+                                        int gap_open, int gap_extend) {
+  const KarlinAltschulParams gapped = Blosum62GappedParams(gap_open, gap_extend);
+  if (ungapped.lambda <= 0.0) return gapped;
+  const double scale = ungapped.lambda / Blosum62UngappedParams().lambda;
+  return KarlinAltschulParams(gapped.lambda * scale, gapped.K, gapped.H);
+}
+
+double EffectiveSearchSpace(const KarlinAltschulParams& ka, size_t qlen,
+                            size_t dblen, size_t nseqs) {
+  const double m = qlen, n = dblen;
+  if (ka.K <= 0.0 || ka.H <= 0.0) return m * n;
+  double len = 0.0;  // length adjustment
+  for (int iter = 0; iter < 20; ++iter) {
+    const double mm = MAX(m - len, 1.0), nn = MAX(n - nseqs * len, 1.0);
+    const double next = MIN(MAX(log(ka.K * mm * nn) / ka.H, 0.0), m);
+    const bool converged = fabs(next - len) < 1.0;
+    len = next;
+    if (converged) break;
+  }
+  return MAX(m - len, 1.0 / ka.K) * MAX(n - nseqs * len, 1.0);
+}
+
+KarlinAltschulParams KarlinAltschulCache::Ungapped(const ScoreProbabilities& probs) {
+  Key key(1, probs.low);
+  for (size_t k = 0; k < probs.p.size(); ++k)
+    key.push_back(lround(probs.p[k] / kResolution));
+  std::map<Key, KarlinAltschulParams>::const_iterator it = entries_.find(key);
+  if (it != entries_.end()) {
+    ++num_hits_;
+    return it->second;
+  }
+
+  ++num_misses_;
+  const KarlinAltschulParams params = UngappedParams(probs);
+  if (capacity_ > 0) {
+    if (order_.size() >= capacity_) {
+      entries_.erase(order_.front());
+      order_.pop_front();
+    }
+    entries_[key] = params;
+    order_.push_back(key);
+  }
+  return params;
+}
+
+}  // namespace cs
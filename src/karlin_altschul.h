@@ -0,0 +1,125 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_KARLIN_ALTSCHUL_H_
+#define CS_KARLIN_ALTSCHUL_H_
+
+#include <deque>
+#include <map>
+#include <vector>
+
+namespace cs {
+
+// Karlin-Altschul parameters of local alignment scores.
+struct KarlinAltschulParams {
+  KarlinAltschulParams(double l = 0.0, double k = 0.0, double h = 0.0)
+      : lambda(l), K(k), H(h) {}
+
+  double lambda;  // scale of scores in nats per score unit
+  double K;       // search space scaling constant
+  double H;       // relative entropy of target and background frequencies
+};
+
+// Probabilities of the integer scores low, low + 1, ... of a random pair of
+// aligned letters.
+struct ScoreProbabilities {
+  explicit ScoreProbabilities(int l = 0) : low(l) {}
+
+  int low;                // score of first entry in p
+  std::vector<double> p;  // probability of score low + k in p[k]
+};
+
+// Returns the probabilities of scores 'scores(i, a)' for database letters 'a'
+// drawn with frequencies 'freqs', averaged over all query positions i. Works
+// for position-specific score classes like PssmScores and StateProfileScores.
+template<class Scores>
+ScoreProbabilities PositionScoreProbabilities(const Scores& scores,
+                                              const std::vector<double>& freqs) {
+  ScoreProbabilities probs(Scores::kMinScore);
+  probs.p.assign(Scores::kMaxScore - Scores::kMinScore + 1, 0.0);
+  for (size_t i = 0; i < scores.length(); ++i)
+    for (size_t a = 0; a < freqs.size(); ++a)
+      probs.p[scores(i, a) - Scores::kMinScore] += freqs[a] / scores.length();
+  return probs;
+}
+
+// Returns the gapped Karlin-Altschul parameters of BLOSUM62 in half-bit units
+// for gap costs 'gap_open' + k * 'gap_extend', as tabulated by NCBI BLAST.
+// PSSM scores are on the same scale, so that these apply to PSSM searches too.
+KarlinAltschulParams Blosum62GappedParams(int gap_open, int gap_extend);
+
+// Returns the ungapped Karlin-Altschul parameters of BLOSUM62 in half-bit units.
+KarlinAltschulParams Blosum62UngappedParams();
+
+// Computes the ungapped Karlin-Altschul parameters of scores with probabilities
+// 'probs': lambda by bisection, H from the target frequencies and K by the
+// series of Karlin and Altschul (1990) as in NCBI BLAST. Returns all zero if
+// the expected score is not negative or no score is positive.
+KarlinAltschulParams UngappedParams(const ScoreProbabilities& probs);
+
+// Returns gapped parameters for PSSM scores with ungapped parameters 'ungapped'
+// and gap costs 'gap_open' + k * 'gap_extend'. The tabulated BLOSUM62 lambda is
+// scaled by the ratio of the ungapped lambdas, which amounts to rescaling the
+// PSSM to the BLOSUM62 scale the way blastpgp does.
+KarlinAltschulParams ScaledGappedParams(const KarlinAltschulParams& ungapped,
+                                        int gap_open, int gap_extend);
+
+// Returns the effective search space of a query with 'qlen' positions against
+// a database of 'dblen' residues in 'nseqs' sequences. As in NCBI BLAST, the
+// expected HSP length l = ln(K m n) / H is found by fixed-point iteration and
+// subtracted from the query and from every database sequence, since an HSP
+// can't start within l positions of a sequence end. Without this correction
+// E-values of short sequences are too optimistic.
+double EffectiveSearchSpace(const KarlinAltschulParams& ka, size_t qlen,
+                            size_t dblen, size_t nseqs);
+
+// Cache of ungapped parameters keyed by score probabilities rounded to
+// multiples of kResolution, so that PSSMs with nearly the same score
+// distribution share one computation. Holds at most 'capacity' entries and
+// evicts the oldest first. Not thread-safe.
+class KarlinAltschulCache {
+ public:
+  static const double kResolution;
+
+  explicit KarlinAltschulCache(size_t capacity = 1024)
+      : capacity_(capacity), num_hits_(0), num_misses_(0) {}
+
+  // Returns the ungapped parameters of 'probs', computing them on a miss.
+  KarlinAltschulParams Ungapped(const ScoreProbabilities& probs);
+
+  // Returns the number of lookups answered from the cache.
+  size_t num_hits() const { return num_hits_; }
+
+  // Returns the number of lookups that needed a computation.
+  size_t num_misses() const { return num_misses_; }
+
+ private:
+  typedef std::vector<long> Key;
+
+  size_t capacity_;
+  size_t num_hits_;
+  size_t num_misses_;
+  std::map<Key, KarlinAltschulParams> entries_;
+  std::deque<Key> order_;
+};  // class KarlinAltschulCache
+
+}  // namespace cs
+
+#endif  // CS_KARLIN_ALTSCHUL_H_
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+
+#include "cs.h"
+#include "karlin_altschul.h"
+#include "blosum_matrix.h"
+
+namespace cs {
+
+// Returns the probabilities of scores +'s' and -'s' with P(+s) = 'p'.
+static ScoreProbabilities RandomWalk(int s, double p) {
+  ScoreProbabilities probs(-s);
+  probs.p.assign(2 * s + 1, 0.0);
+  probs.p[0] = 1.0 - p;
+  probs.p[2 * s] = p;
+  return probs;
+}
+
+TEST(KarlinAltschulTest, UngappedParamsOfBlosum62) {
+  // Integer BLOSUM62 in half-bits against its own background frequencies
+  BlosumMatrix sm;
+  ScoreProbabilities probs(-10);
+  probs.p.assign(31, 0.0);
+  for (size_t a = 0; a < AA::kSize; ++a)
+    for (size_t b = 0; b < AA::kSize; ++b) {
+      const int s = iround(2.0 * log(sm.q(a, b) / (sm.p(a) * sm.p(b))) / log(2.0));
+      probs.p[s - probs.low] += sm.p(a) * sm.p(b);
+    }
+  const KarlinAltschulParams ka = UngappedParams(probs);
+  const KarlinAltschulParams ref = Blosum62UngappedParams();
+  EXPECT_NEAR(ref.lambda, ka.lambda, 0.01);
+  EXPECT_NEAR(ref.K, ka.K, 0.015);
+  EXPECT_NEAR(ref.H, ka.H, 0.04);
+}
+
+TEST(KarlinAltschulTest, RandomWalkAndScaling) {
+  // For scores +1/-1 lambda = ln(q/p) and K = (q-p)^2/q
+  const KarlinAltschulParams ka = UngappedParams(RandomWalk(1, 0.25));
+  EXPECT_NEAR(log(3.0), ka.lambda, 1e-6);
+  EXPECT_NEAR(0.25 / 0.75, ka.K, 1e-3);
+
+  // Doubling all scores halves lambda but leaves K unchanged
+  const KarlinAltschulParams ka2 = UngappedParams(RandomWalk(2, 0.25));
+  EXPECT_NEAR(0.5 * ka.lambda, ka2.lambda, 1e-6);
+  EXPECT_NEAR(ka.K, ka2.K, 1e-6);
+  EXPECT_NEAR(ka.H, ka2.H, 1e-6);
+
+  // No parameters without negative drift
+  EXPECT_EQ(0.0, UngappedParams(RandomWalk(1, 0.5)).lambda);
+  EXPECT_EQ(0.0, UngappedParams(ScoreProbabilities()).lambda);
+}
+
+TEST(KarlinAltschulTest, CacheSharesSimilarDistributions) {
+  KarlinAltschulCache cache(2);
+  const KarlinAltschulParams ka = cache.Ungapped(RandomWalk(1, 0.25));
+  EXPECT_EQ(ka.K, cache.Ungapped(RandomWalk(1, 0.25 + 1e-7)).K);
+  EXPECT_EQ(1u, cache.num_hits());
+  EXPECT_EQ(1u, cache.num_misses());
+
+  // Distinct distributions evict the oldest entry
+  cache.Ungapped(RandomWalk(1, 0.2));
+  cache.Ungapped(RandomWalk(1, 0.3));
+  cache.Ungapped(RandomWalk(1, 0.25));
+  EXPECT_EQ(1u, cache.num_hits());
+  EXPECT_EQ(4u, cache.num_misses());
+
+  // Gapped parameters scale with the ungapped lambda
+  const KarlinAltschulParams gapped = ScaledGappedParams(Blosum62UngappedParams(), 11, 1);
+  EXPECT_DOUBLE_EQ(0.267, gapped.lambda);
+  EXPECT_DOUBLE_EQ(0.041, gapped.K);
+  KarlinAltschulParams half = Blosum62UngappedParams();
+  half.lambda *= 0.5;
+  EXPECT_DOUBLE_EQ(0.1335, ScaledGappedParams(half, 11, 1).lambda);
+}
+
+TEST(KarlinAltschulTest, EffectiveSearchSpace) {
+  const KarlinAltschulParams ka = Blosum62GappedParams(11, 1);
+  const size_t m = 300, n = 1000000, nseqs = 3000;
+
+  // Length adjustment l solves l = ln(K (m - l) (n - N l)) / H
+  double len = 0.0, prev = -1.0;
+  while (fabs(len - prev) >= 1.0) {
+    prev = len;
+    len = log(ka.K * (m - len) * (n - nseqs * len)) / ka.H;
+  }
+  const double space = EffectiveSearchSpace(ka, m, n, nseqs);
+  EXPECT_LT(space, static_cast<double>(m) * n);
+  EXPECT_NEAR((m - len) * (n - nseqs * len), space, 0.01 * space);
+
+  // Short queries keep an effective length of 1/K
+  EXPECT_DOUBLE_EQ((n - 10.0) / ka.K, EffectiveSearchSpace(ka, 10, n, 1));
+}
+
+}  // namespace cs
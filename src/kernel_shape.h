@@ -0,0 +1,60 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_KERNEL_SHAPE_H_
+#define CS_KERNEL_SHAPE_H_
+
+namespace cs {
+
+// Window shape of the shipped context models of an alphabet. Context kernels
+// have an instantiation for this shape in which the number of window columns
+// and the alphabet size are compile-time constants, so that the compiler can
+// fully unroll the loops over a window. Models of any other shape fall back to
+// the generic kernels.
+template<class Abc>
+struct KernelShape { enum { kEnabled = 0, kWlen = 1, kSize = 1 }; };
+
+// Amino acid CRFs and context libraries with 13 columns, e.g. the K4000 models.
+template<>
+struct KernelShape<AA> { enum { kEnabled = 1, kWlen = 13, kSize = 20 }; };
+
+// DNA context libraries with 9 columns.
+template<>
+struct KernelShape<Dna> { enum { kEnabled = 1, kWlen = 9, kSize = 4 }; };
+
+// Returns true if the fixed-shape kernels apply to windows with 'wlen' columns.
+template<class Abc>
+inline bool HasFixedKernel(size_t wlen) {
+    return KernelShape<Abc>::kEnabled &&
+        wlen == static_cast<size_t>(KernelShape<Abc>::kWlen) &&
+        Abc::kSize == static_cast<size_t>(KernelShape<Abc>::kSize) &&
+        Abc::kSizeAny == Abc::kSize + 1;
+}
+
+// Returns true if the window with 'wlen' columns centered at 'idx' lies
+// entirely within an input of length 'len'.
+inline bool IsFullWindow(size_t idx, size_t len, size_t wlen) {
+    const size_t center = (wlen - 1) / 2;
+    return idx >= center && idx + center < len;
+}
+
+}  // namespace cs
+
+#endif  // CS_KERNEL_SHAPE_H_
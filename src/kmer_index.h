@@ -0,0 +1,316 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_KMER_INDEX_H_
+#define CS_KMER_INDEX_H_
+
+#include "sequence_db.h"
+
+namespace cs {
+
+// Read-only index of spaced seeds in a sequence database, mapped into memory
+// like SequenceDb. A seed pattern such as "11011" selects the letters of each
+// window that form a k-mer; k-mers are hashed into a power of two of buckets,
+// each listing the database sequences that contain a k-mer of the bucket once.
+// Windows with wildcard letters are skipped. Written by csformatdb -s.
+//
+// Layout (native byte order, sections aligned to 8 bytes):
+//   Header            magic, version, alphabet size, seed, counts and offsets
+//   offsets           num_buckets + 1 uint64 start positions in 'entries'
+//   entries           uint32 database sequence indices, ascending per bucket
+template<class Abc>
+class KmerIndex {
+  public:
+    // Maximal length of a seed pattern.
+    static const size_t kMaxSeedLength = 31;
+
+    // Maps index file 'path' into memory.
+    explicit KmerIndex(const std::string& path) : data_(NULL), size_(0), header_(NULL) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw Exception("Unable to read file '%s'!", path.c_str());
+        Map(fd, path);
+        close(fd);
+    }
+
+    // Maps index written to open file 'fp' into memory.
+    explicit KmerIndex(FILE* fp) : data_(NULL), size_(0), header_(NULL) {
+        fflush(fp);
+        Map(fileno(fp), "<stream>");
+    }
+
+    ~KmerIndex() { if (data_) munmap(data_, size_); }
+
+    // Returns true if file 'path' starts with the index magic.
+    static bool IsIndex(const std::string& path) {
+        char magic[sizeof(kMagic)] = { 0 };
+        FILE* fin = fopen(path.c_str(), "rb");
+        if (!fin) return false;
+        const bool ok = fread(magic, sizeof(magic), 1, fin) == 1 &&
+            memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+        fclose(fin);
+        return ok;
+    }
+
+    // Indexes all sequences of 'db' with seed pattern 'seed' and writes the
+    // index to 'fout'. With 'bucket_bits' zero the number of buckets is the
+    // smallest power of two of at least a quarter of the residues, within
+    // 2^16 and 2^28. Returns the number of entries.
+    static size_t Build(const SequenceDb<Abc>& db, const std::string& seed, FILE* fout,
+                        size_t bucket_bits = 0);
+
+    // Returns the indices of database sequences sharing seeds with the 'len'
+    // letters at 'seq', paired with the number of distinct shared buckets and
+    // ranked by decreasing count. At most 'max_candidates' with at least
+    // 'min_hits' shared buckets are returned.
+    std::vector<std::pair<size_t, size_t> > Candidates(const uint8_t* seq, size_t len,
+                                                       size_t max_candidates,
+                                                       size_t min_hits = 1) const;
+
+    // Returns the seed pattern.
+    std::string seed() const { return header_->seed; }
+
+    // Returns the number of indexed database sequences.
+    size_t num_seqs() const { return header_->num_seqs; }
+
+    // Returns the number of buckets.
+    size_t num_buckets() const { return header_->num_buckets; }
+
+    // Returns the number of (bucket, sequence) entries.
+    size_t num_entries() const { return header_->num_entries; }
+
+  private:
+    static const char kMagic[8];
+    static const uint32_t kVersion = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t alphabet_size;
+        char seed[kMaxSeedLength + 1];
+        uint64_t num_seqs;
+        uint64_t num_buckets;
+        uint64_t num_entries;
+        uint64_t offsets_pos;
+        uint64_t entries_pos;
+        uint64_t file_size;
+    };
+
+    // Calls 'f' with the bucket of every seed window in the 'len' letters at
+    // 'seq' that contains no wildcard.
+    template<class Callback>
+    static void ForEachBucket(const uint8_t* seq, size_t len, const std::string& seed,
+                              size_t bucket_bits, Callback f);
+
+    // Maps file descriptor 'fd' and sets up section pointers.
+    void Map(int fd, const std::string& name);
+
+    // Mapped file
+    void* data_;
+    // Size of mapped file
+    size_t size_;
+    // Section pointers into mapped file
+    const Header* header_;
+    const uint64_t* offsets_;
+    const uint32_t* entries_;
+    // Base-two logarithm of number of buckets
+    size_t bucket_bits_;
+
+    DISALLOW_COPY_AND_ASSIGN(KmerIndex);
+};  // class KmerIndex
+
+template<class Abc>
+const char KmerIndex<Abc>::kMagic[8] = { 'C', 'S', 'K', 'I', 'D', 'X', '\0', '\0' };
+
+template<class Abc>
+template<class Callback>
+void KmerIndex<Abc>::ForEachBucket(const uint8_t* seq, size_t len, const std::string& seed,
+                                   size_t bucket_bits, Callback f) {
+    const size_t span = seed.length();
+    for (size_t j = 0; j + span <= len; ++j) {
+        uint64_t key = 0;
+        size_t p = 0;
+        for (; p < span; ++p) {
+            if (seed[p] == '0') continue;
+            if (seq[j + p] >= Abc::kSize) break;
+            key = key * Abc::kSize + seq[j + p];
+        }
+        if (p < span) continue;
+        // Fibonacci hashing of the k-mer into the upper bits
+        f(static_cast<size_t>((key * 0x9e3779b97f4a7c15ULL) >> (64 - bucket_bits)));
+    }
+}
+
+template<class Abc>
+size_t KmerIndex<Abc>::Build(const SequenceDb<Abc>& db, const std::string& seed, FILE* fout,
+                             size_t bucket_bits) {
+    const size_t weight = std::count(seed.begin(), seed.end(), '1');
+    if (seed.empty() || seed.length() > kMaxSeedLength ||
+        weight + std::count(seed.begin(), seed.end(), '0') != seed.length() ||
+        seed[0] != '1' || seed[seed.length() - 1] != '1')
+        throw Exception("Invalid seed pattern '%s'!", seed.c_str());
+    if (pow(static_cast<double>(Abc::kSize), static_cast<double>(weight)) > 1.8e19)
+        throw Exception("Seed pattern '%s' has too many letters!", seed.c_str());
+    if (bucket_bits > 32) throw Exception("Too many k-mer index buckets!");
+    if (bucket_bits == 0) {
+        bucket_bits = 16;
+        while (bucket_bits < 28 && (static_cast<size_t>(1) << bucket_bits) < db.num_residues() / 4)
+            ++bucket_bits;
+    }
+    const size_t nbuckets = static_cast<size_t>(1) << bucket_bits;
+    const size_t n = db.size();
+
+    // Count sequences per bucket, remembering the last sequence of each bucket
+    // so that a sequence is counted once
+    std::vector<uint64_t> offsets(nbuckets + 1, 0);
+    std::vector<uint32_t> last(nbuckets, UINT32_MAX);
+    for (size_t k = 0; k < n; ++k) {
+        ForEachBucket(db.residues(k), db.length(k), seed, bucket_bits, [&](size_t b) {
+            if (last[b] != k) {
+                last[b] = k;
+                ++offsets[b + 1];
+            }
+        });
+    }
+    for (size_t b = 0; b < nbuckets; ++b) offsets[b + 1] += offsets[b];
+
+    // Fill entries in ascending order of sequences
+    std::vector<uint32_t> entries(offsets[nbuckets]);
+    std::vector<uint64_t> fill(offsets.begin(), offsets.end() - 1);
+    last.assign(nbuckets, UINT32_MAX);
+    for (size_t k = 0; k < n; ++k) {
+        ForEachBucket(db.residues(k), db.length(k), seed, bucket_bits, [&](size_t b) {
+            if (last[b] != k) {
+                last[b] = k;
+                entries[fill[b]++] = k;
+            }
+        });
+    }
+
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.alphabet_size = Abc::kSizeAny;
+    strncpy(h.seed, seed.c_str(), kMaxSeedLength);
+    h.num_seqs = n;
+    h.num_buckets = nbuckets;
+    h.num_entries = entries.size();
+    h.offsets_pos = (sizeof(h) + 7) / 8 * 8;
+    h.entries_pos = h.offsets_pos + (nbuckets + 1) * sizeof(uint64_t);
+    h.file_size = (h.entries_pos + entries.size() * sizeof(uint32_t) + 7) / 8 * 8;
+
+    static const char kZeros[8] = { 0 };
+    fwrite(&h, sizeof(h), 1, fout);
+    fwrite(kZeros, 1, h.offsets_pos - sizeof(h), fout);
+    fwrite(&offsets[0], sizeof(uint64_t), nbuckets + 1, fout);
+    if (!entries.empty()) fwrite(&entries[0], sizeof(uint32_t), entries.size(), fout);
+    fwrite(kZeros, 1, h.file_size - h.entries_pos - entries.size() * sizeof(uint32_t), fout);
+    if (ferror(fout)) throw Exception("Error while writing k-mer index!");
+    return entries.size();
+}
+
+template<class Abc>
+std::vector<std::pair<size_t, size_t> > KmerIndex<Abc>::Candidates(
+        const uint8_t* seq, size_t len, size_t max_candidates, size_t min_hits) const {
+    // Distinct buckets of the query
+    std::vector<size_t> buckets;
+    ForEachBucket(seq, len, seed(), bucket_bits_, [&](size_t b) { buckets.push_back(b); });
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+
+    // Count shared buckets per database sequence
+    std::vector<uint32_t> counts(num_seqs(), 0);
+    std::vector<size_t> touched;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        // Offsets of each bucket are only checked here to keep mapping cheap
+        const uint64_t beg = offsets_[buckets[i]], end = offsets_[buckets[i] + 1];
+        if (beg > end || end > num_entries())
+            throw Exception("K-mer index has corrupt offsets in bucket %zu!", buckets[i]);
+        for (uint64_t e = beg; e < end; ++e) {
+            if (entries_[e] >= counts.size())
+                throw Exception("K-mer index has corrupt entries in bucket %zu!", buckets[i]);
+            if (counts[entries_[e]]++ == 0) touched.push_back(entries_[e]);
+        }
+    }
+
+    std::vector<std::pair<size_t, size_t> > rv;
+    for (size_t i = 0; i < touched.size(); ++i)
+        if (counts[touched[i]] >= min_hits)
+            rv.push_back(std::make_pair(touched[i], counts[touched[i]]));
+    std::sort(rv.begin(), rv.end(), [](const std::pair<size_t, size_t>& a,
+                                       const std::pair<size_t, size_t>& b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+    if (rv.size() > max_candidates) rv.resize(max_candidates);
+    return rv;
+}
+
+template<class Abc>
+void KmerIndex<Abc>::Map(int fd, const std::string& name) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+        throw Exception("File '%s' is not a k-mer index!", name.c_str());
+    size_ = st.st_size;
+    data_ = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data_ == MAP_FAILED) {
+        data_ = NULL;
+        throw Exception("Unable to map file '%s' into memory!", name.c_str());
+    }
+
+    const char* base = static_cast<const char*>(data_);
+    header_ = reinterpret_cast<const Header*>(base);
+    std::string error;
+    if (memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0)
+        error = strprintf("File '%s' is not a k-mer index!", name.c_str());
+    else if (header_->version != kVersion)
+        error = strprintf("K-mer index '%s' has version %u but expected %u!",
+                          name.c_str(), header_->version, kVersion);
+    else if (header_->alphabet_size != Abc::kSizeAny)
+        error = strprintf("K-mer index '%s' has wrong alphabet!", name.c_str());
+    else if (header_->file_size != size_)
+        error = strprintf("K-mer index '%s' is truncated!", name.c_str());
+    else if (!memchr(header_->seed, '\0', sizeof(header_->seed)) ||
+             header_->num_buckets < 2 || (header_->num_buckets & (header_->num_buckets - 1)) != 0)
+        error = strprintf("K-mer index '%s' has a corrupt header!", name.c_str());
+    else if (header_->offsets_pos % sizeof(uint64_t) != 0 || header_->offsets_pos > size_ ||
+             (size_ - header_->offsets_pos) / sizeof(uint64_t) < header_->num_buckets + 1 ||
+             header_->entries_pos % sizeof(uint32_t) != 0 || header_->entries_pos > size_ ||
+             (size_ - header_->entries_pos) / sizeof(uint32_t) < header_->num_entries)
+        error = strprintf("K-mer index '%s' has sections beyond the end of file!", name.c_str());
+    if (!error.empty()) {
+        munmap(data_, size_);
+        data_ = NULL;
+        throw Exception(error);
+    }
+
+    offsets_ = reinterpret_cast<const uint64_t*>(base + header_->offsets_pos);
+    entries_ = reinterpret_cast<const uint32_t*>(base + header_->entries_pos);
+    if (offsets_[0] != 0 || offsets_[header_->num_buckets] != header_->num_entries) {
+        munmap(data_, size_);
+        data_ = NULL;
+        throw Exception("K-mer index '%s' has corrupt bucket offsets!", name.c_str());
+    }
+    bucket_bits_ = 0;
+    while ((static_cast<uint64_t>(1) << bucket_bits_) < header_->num_buckets) ++bucket_bits_;
+}
+
+}  // namespace cs
+
+#endif  // CS_KMER_INDEX_H_
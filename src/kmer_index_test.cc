@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include "cs.h"
+#include "kmer_index.h"
+
+namespace cs {
+
+TEST(KmerIndexTest, BuildMapAndRankCandidates) {
+  FILE* fasta = tmpfile();
+  fputs(">seq0\nMKVLAAGIVGLLLAQ\n>seq1\nACDEFGHIKLMNPQRSTVWY\n>seq2\nWWWWWWWW\n"
+        ">seq3\nGHIKLMXPQRSTAAAA\n>seq4\nAC\n", fasta);
+  rewind(fasta);
+  FILE* fdb = tmpfile();
+  SequenceDb<AA>::Format(fasta, fdb);
+  fclose(fasta);
+  const SequenceDb<AA> db(fdb);
+  fclose(fdb);
+
+  FILE* fidx = tmpfile();
+  const size_t nentries = KmerIndex<AA>::Build(db, "1101", fidx, 10);
+  const KmerIndex<AA> index(fidx);
+  fclose(fidx);
+  EXPECT_EQ(nentries, index.num_entries());
+  EXPECT_EQ("1101", index.seed());
+  EXPECT_EQ(5u, index.num_seqs());
+  EXPECT_EQ(1024u, index.num_buckets());
+
+  // Query shares most seeds with seq1 and a few with seq3 across its 'X'
+  const Sequence<AA> query("FGHIKLMNPQRSTV");
+  std::vector<std::pair<size_t, size_t> > cands =
+    index.Candidates(query.begin(), query.length(), 10);
+  ASSERT_GE(cands.size(), 2u);
+  EXPECT_EQ(1u, cands[0].first);
+  EXPECT_EQ(11u, cands[0].second);
+  EXPECT_EQ(3u, cands[1].first);
+  EXPECT_GT(cands[0].second, cands[1].second);
+
+  // Limits on number and seed hits of candidates
+  EXPECT_EQ(1u, index.Candidates(query.begin(), query.length(), 1).size());
+  EXPECT_EQ(1u, index.Candidates(query.begin(), query.length(), 10, 8).size());
+  const Sequence<AA> xs("XXXXXXXX");
+  EXPECT_TRUE(index.Candidates(xs.begin(), xs.length(), 10).empty());
+}
+
+TEST(KmerIndexTest, RejectsInvalidSeedsAndFiles) {
+  FILE* fasta = tmpfile();
+  fputs(">seq0\nMKVLAAGIVGLLLAQ\n", fasta);
+  rewind(fasta);
+  FILE* fdb = tmpfile();
+  SequenceDb<AA>::Format(fasta, fdb);
+  fclose(fasta);
+  const SequenceDb<AA> db(fdb);
+
+  FILE* fidx = tmpfile();
+  EXPECT_THROW(KmerIndex<AA>::Build(db, "0110", fidx), Exception);
+  EXPECT_THROW(KmerIndex<AA>::Build(db, "1a1", fidx), Exception);
+  EXPECT_THROW(KmerIndex<AA>::Build(db, "", fidx), Exception);
+  fclose(fidx);
+
+  // A sequence database is not an index
+  EXPECT_THROW(KmerIndex<AA> index(fdb), Exception);
+  fclose(fdb);
+
+  // Header fields pointing outside of the file are rejected before use
+  const size_t kNumBucketsPos = 56, kEntriesPos = 80;
+  const uint64_t values[] = { 3, 1 << 30 };
+  const size_t positions[] = { kNumBucketsPos, kEntriesPos };
+  for (size_t t = 0; t < 2; ++t) {
+    fidx = tmpfile();
+    KmerIndex<AA>::Build(db, "1101", fidx, 10);
+    fseek(fidx, positions[t], SEEK_SET);
+    fwrite(&values[t], sizeof(values[t]), 1, fidx);
+    EXPECT_THROW(KmerIndex<AA> index(fidx), Exception);
+    fclose(fidx);
+  }
+}
+
+}  // namespace cs
@@ -0,0 +1,138 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cs.h"
+#include "kmer_prefilter.h"
+#include "sw_search.h"
+
+using std::vector;
+
+namespace cs {
+
+KmerPrefilter::KmerPrefilter(const PssmScores& scores, int threshold, int window,
+                             int xdrop, int gap_trigger)
+    : scores_(scores),
+      threshold_(threshold),
+      window_(window),
+      xdrop_(xdrop),
+      gap_trigger_(gap_trigger) {
+  const size_t a = AA::kSize;
+  const size_t nwords = a * a * a;
+  const size_t m = scores_.length();
+
+  // Best score per query position for pruning word enumeration
+  vector<int> best(m, PssmScores::kMinScore);
+  for (size_t i = 0; i < m; ++i)
+    for (size_t x = 0; x < a; ++x) best[i] = MAX(best[i], scores_(i, x));
+
+  // Collect neighborhood words of each query position, counting sort by word
+  vector<std::pair<uint32_t, uint32_t> > entries;
+  for (size_t i = 0; i + kWordLength <= m; ++i) {
+    if (best[i] + best[i + 1] + best[i + 2] < threshold_) continue;
+    for (size_t x = 0; x < a; ++x) {
+      const int s0 = scores_(i, x);
+      if (s0 + best[i + 1] + best[i + 2] < threshold_) continue;
+      for (size_t y = 0; y < a; ++y) {
+        const int s1 = s0 + scores_(i + 1, y);
+        if (s1 + best[i + 2] < threshold_) continue;
+        for (size_t z = 0; z < a; ++z)
+          if (s1 + scores_(i + 2, z) >= threshold_)
+            entries.push_back(std::make_pair((x * a + y) * a + z, i));
+      }
+    }
+  }
+  offsets_.assign(nwords + 1, 0);
+  for (size_t k = 0; k < entries.size(); ++k) ++offsets_[entries[k].first + 1];
+  for (size_t w = 0; w < nwords; ++w) offsets_[w + 1] += offsets_[w];
+  positions_.resize(entries.size());
+  vector<uint32_t> fill(offsets_.begin(), offsets_.end() - 1);
+  for (size_t k = 0; k < entries.size(); ++k)
+    positions_[fill[entries[k].first]++] = entries[k].second;
+}
+
+int KmerPrefilter::Extend(const uint8_t* seq, size_t len, size_t i, size_t j) const {
+  int word = 0;
+  for (size_t k = 0; k < kWordLength; ++k) word += scores_(i + k, seq[j + k]);
+
+  // Extend to the right of the word
+  int score = 0, right = 0;
+  for (size_t qi = i + kWordLength, sj = j + kWordLength;
+       qi < scores_.length() && sj < len; ++qi, ++sj) {
+    score += scores_(qi, seq[sj]);
+    if (score > right) right = score;
+    else if (right - score > xdrop_) break;
+  }
+  // Extend to the left of the word
+  int left = 0;
+  score = 0;
+  for (size_t qi = i, sj = j; qi > 0 && sj > 0; --qi, --sj) {
+    score += scores_(qi - 1, seq[sj - 1]);
+    if (score > left) left = score;
+    else if (left - score > xdrop_) break;
+  }
+  return word + left + right;
+}
+
+PrefilterStage KmerPrefilter::operator() (const uint8_t* seq, size_t len) const {
+  if (scores_.length() < kWordLength || len < kWordLength) return PREFILTER_NO_WORD_HIT;
+
+  // Last word hit per diagonal j - i + m, tagged with a per-call generation so
+  // that the buffers need no clearing between sequences
+  static thread_local vector<uint64_t> diag_gen;
+  static thread_local vector<int> diag_last;
+  static thread_local uint64_t gen = 0;
+  const size_t m = scores_.length();
+  if (diag_gen.size() < m + len) {
+    diag_gen.resize(m + len, 0);
+    diag_last.resize(m + len, 0);
+  }
+  ++gen;
+
+  const size_t a = AA::kSize;
+  PrefilterStage stage = PREFILTER_NO_WORD_HIT;
+  size_t word = 0, valid = 0;  // current word and number of valid residues in it
+  for (size_t j = 0; j < len; ++j) {
+    if (seq[j] >= a) {
+      valid = 0;
+      continue;
+    }
+    word = (word * a + seq[j]) % (a * a * a);
+    if (++valid < kWordLength) continue;
+
+    const size_t js = j + 1 - kWordLength;
+    for (uint32_t p = offsets_[word]; p < offsets_[word + 1]; ++p) {
+      const size_t i = positions_[p];
+      const size_t d = js + m - i;
+      stage = MAX(stage, PREFILTER_NO_TWO_HIT);
+      if (diag_gen[d] == gen) {
+        const int dist = static_cast<int>(js) - diag_last[d];
+        if (dist < static_cast<int>(kWordLength)) continue;  // overlapping hits
+        if (dist <= window_) {
+          stage = PREFILTER_UNGAPPED;
+          if (Extend(seq, len, i, js) >= gap_trigger_) return PREFILTER_PASSED;
+        }
+      }
+      diag_gen[d] = gen;
+      diag_last[d] = js;
+    }
+  }
+  return stage;
+}
+
+}  // namespace cs
@@ -0,0 +1,95 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_KMER_PREFILTER_H_
+#define CS_KMER_PREFILTER_H_
+
+#include <vector>
+
+namespace cs {
+
+class PssmScores;
+
+// Stages at which the prefilter stops examining a database sequence.
+enum PrefilterStage {
+  PREFILTER_NO_WORD_HIT = 0,  // no word scores at least the threshold
+  PREFILTER_NO_TWO_HIT  = 1,  // no two word hits on a diagonal within window
+  PREFILTER_UNGAPPED    = 2,  // no ungapped extension reaches gap trigger
+  PREFILTER_PASSED      = 3   // sequence goes on to gapped alignment
+};
+
+// Number of database sequences that reached each stage of the prefilter.
+struct PrefilterStats {
+  PrefilterStats() : num_seqs(0), num_word_hits(0), num_two_hits(0), num_passed(0) {}
+
+  // Counts a sequence that stopped at 'stage'.
+  void Add(PrefilterStage stage) {
+    ++num_seqs;
+    if (stage > PREFILTER_NO_WORD_HIT) ++num_word_hits;
+    if (stage > PREFILTER_NO_TWO_HIT) ++num_two_hits;
+    if (stage == PREFILTER_PASSED) ++num_passed;
+  }
+
+  size_t num_seqs;
+  size_t num_word_hits;
+  size_t num_two_hits;
+  size_t num_passed;
+};
+
+// BLAST-style two-hit prefilter of a PSSM against database sequences. All words
+// of length kWordLength that score at least 'threshold' against some query
+// position are put in a lookup table. A database sequence passes if two
+// non-overlapping word hits on the same diagonal lie within 'window' residues
+// and an ungapped X-drop extension from the second one reaches 'gap_trigger'.
+// Scores are in the units of PssmScores.
+class KmerPrefilter {
+ public:
+  static const size_t kWordLength = 3;
+
+  KmerPrefilter(const PssmScores& scores, int threshold, int window, int xdrop,
+                int gap_trigger);
+
+  // Returns the last stage reached by the 'len' residues at 'seq'.
+  PrefilterStage operator() (const uint8_t* seq, size_t len) const;
+
+  // Returns the number of (word, query position) pairs in the lookup table.
+  size_t num_entries() const { return positions_.size(); }
+
+ private:
+  // Returns the best score of an ungapped extension through the word hit at
+  // query position 'i' and database position 'j'.
+  int Extend(const uint8_t* seq, size_t len, size_t i, size_t j) const;
+
+  const PssmScores& scores_;
+  int threshold_;
+  int window_;
+  int xdrop_;
+  int gap_trigger_;
+  // Start of query positions of each word in 'positions_'
+  std::vector<uint32_t> offsets_;
+  // Query positions of all words
+  std::vector<uint32_t> positions_;
+
+  DISALLOW_COPY_AND_ASSIGN(KmerPrefilter);
+};  // class KmerPrefilter
+
+}  // namespace cs
+
+#endif  // CS_KMER_PREFILTER_H_
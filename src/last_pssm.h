@@ -21,6 +21,7 @@
 #define CS_LAST_PSSM_H_
 
 #include "profile-inl.h"
+#include "pseudocounts-inl.h"
 #include "sequence-inl.h"
 #include "substitution_matrix-inl.h"
 
@@ -32,20 +33,25 @@ class LastPssm {
   public:
     // Constructor to create a PSSM from query string and a sequence profile.
     LastPssm(const Sequence<Dna>& seq, const Profile<Dna>& prof, const SubstitutionMatrix<Dna>& mat)
-            : query_(seq), pssm_(prof.length()) {
-
-        for (size_t i = 0; i < pssm_.length(); ++i) {
-            for (size_t a = 0; a < Dna::kSize; ++a) {
-                pssm_[i][a] = log(prof[i][a] / mat.p(a));
-                // std::cerr << prof[i][a] << "\t" << mat.p(a) << "\t" << pssm_[i][a] << std::endl;
-            }
-        }
+            : query_(seq), pssm_(prof.length()), mat_(mat), pc_(NULL), admix_(NULL), chunk_(0) {
+        LogOdds(prof, pssm_);
     }
 
+    // Constructor for a PSSM whose rows are computed chunk by chunk from the
+    // query while writing, so that memory stays bounded for chromosome-scale
+    // queries. Pseudocount engine and admixture must outlive the PSSM.
+    LastPssm(const Sequence<Dna>& seq,
+             const Pseudocounts<Dna>& pc,
+             const Admix& admix,
+             const SubstitutionMatrix<Dna>& mat,
+             size_t chunk)
+            : query_(seq), pssm_(), mat_(mat), pc_(&pc), admix_(&admix), chunk_(chunk) {}
+
     // Writes PSSM in LAST format
     void Write(FILE* fout) const {
-        // Print header section
-        fputs("Last\n", fout);
+        // Print name line, which lastal reports as query name of all alignments
+        // found with this PSSM so that batched results can be told apart
+        fprintf(fout, "%s\n", name().c_str());
 
         // Print alphabet description line
         for (size_t a = 0; a < Dna::kSize; ++a)
@@ -53,20 +59,67 @@ class LastPssm {
         fputs("\n", fout);
 
         // Print PSSM in Last's human-readable PSSM format
-        for (size_t i = 0; i < pssm_.length(); ++i) {
-            fprintf(fout, "%zu %c", i+1, query_.chr(i));
+        if (pc_) {
+            ChunkWriter writer(*this, fout);
+            pc_->AddToChunked(query_, *admix_, chunk_, writer);
+        } else {
+            WriteRows(pssm_, 0, fout);
+        }
+    }
+
+    // Returns the first word of the query header or "Query" if it is empty.
+    std::string name() const {
+        const std::string& header = query_.header();
+        const size_t end = header.find_first_of(" \t");
+        return header.empty() || end == 0 ? "Query" : header.substr(0, end);
+    }
+
+  private:
+    // Sink for chunked pseudocounts that converts each chunk into PSSM rows.
+    struct ChunkWriter {
+        ChunkWriter(const LastPssm& pssm, FILE* fout) : pssm(pssm), fout(fout) {}
+
+        void operator() (const Profile<Dna>& prof, size_t offset) {
+            Profile<Dna> scores(prof.length());
+            pssm.LogOdds(prof, scores);
+            pssm.WriteRows(scores, offset, fout);
+        }
+
+        const LastPssm& pssm;
+        FILE* fout;
+    };
+
+    // Converts profile frequencies into log-odds scores log[p(a) / f(a)].
+    void LogOdds(const Profile<Dna>& prof, Profile<Dna>& scores) const {
+        for (size_t i = 0; i < scores.length(); ++i) {
+            for (size_t a = 0; a < Dna::kSize; ++a)
+                scores[i][a] = log(prof[i][a] / mat_.p(a));
+        }
+    }
+
+    // Prints PSSM rows for query positions starting at 'offset'.
+    void WriteRows(const Profile<Dna>& scores, size_t offset, FILE* fout) const {
+        for (size_t i = 0; i < scores.length(); ++i) {
+            fprintf(fout, "%zu %c", offset + i + 1, query_.chr(offset + i));
             for (size_t a = 0; a < Dna::kSize; ++a) {
-                fprintf(fout, "\t%i", iround(pssm_[i][a]));
+                fprintf(fout, "\t%i", iround(scores[i][a]));
             }
             fputs("\n", fout);
         }
     }
 
-  private:
     // Query sequence with which search was started
     Sequence<Dna> query_;
-    // The PSSM including as log[p(a) / f(a)]
+    // The PSSM including as log[p(a) / f(a)], empty if computed while writing
     Profile<Dna> pssm_;
+    // Substitution matrix with background frequencies
+    const SubstitutionMatrix<Dna>& mat_;
+    // Pseudocount engine for chunked PSSM generation (NULL if precomputed)
+    const Pseudocounts<Dna>* pc_;
+    // Pseudocount admixture for chunked PSSM generation
+    const Admix* admix_;
+    // Maximal number of query positions per chunk
+    size_t chunk_;
 };  // class LastPssm
 
 }  // namespace cs
@@ -35,23 +35,28 @@ void LibraryPseudocounts<Abc>::AddToSequence(const Sequence<Abc>& seq, Profile<A
     assert_eq(seq.length(), p.length());
     LOG(INFO) << "Adding library pseudocounts to sequence ...";
 
-    Matrix<double> pp(seq.length(), lib_.size(), 0.0);  // posterior probabilities
     int len = static_cast<int>(seq.length());
 
-    // Calculate and add pseudocounts for each sequence window X_i separately
-#pragma omp parallel for schedule(static)
-    for (int i = 0; i < len; ++i) {
-        double* ppi = &pp[i][0];
-        // Calculate posterior probability of state k given sequence window around 'i'
-        CalculatePosteriorProbs(lib_, emission_, seq, i, ppi);
-        // Calculate pseudocount vector P(a|X_i)
-        double* pc = p[i];
-        for (size_t a = 0; a < Abc::kSize; ++a) pc[a] = 0.0;
-        for (size_t k = 0; k < lib_.size(); ++k) {
-            for(size_t a = 0; a < Abc::kSize; ++a)
-                pc[a] += ppi[k] * lib_[k].pc[a];
+    // Calculate and add pseudocounts for each sequence window X_i separately.
+    // Posteriors are only needed per window, so that each thread reuses one
+    // buffer and memory does not grow with the query length.
+#pragma omp parallel
+    {
+        Vector<double> pp(lib_.size(), 0.0);  // posterior probabilities
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < len; ++i) {
+            // Calculate posterior probability of state k given sequence window around 'i'
+            CalculatePosteriorProbs(lib_, emission_, seq, i, &pp[0]);
+            // Calculate pseudocount vector P(a|X_i)
+            double* pc = p[i];
+            for (size_t a = 0; a < Abc::kSize; ++a) pc[a] = 0.0;
+            for (size_t k = 0; k < lib_.size(); ++k) {
+                for(size_t a = 0; a < Abc::kSize; ++a)
+                    pc[a] += pp[k] * lib_[k].pc[a];
+            }
+            Normalize(&pc[0], Abc::kSize);
         }
-        Normalize(&pc[0], Abc::kSize);
     }
 }
 
@@ -60,23 +65,26 @@ void LibraryPseudocounts<Abc>::AddToProfile(const CountProfile<Abc>& cp, Profile
     assert_eq(cp.counts.length(), p.length());
     LOG(INFO) << "Adding library pseudocounts to profile ...";
 
-    Matrix<double> pp(cp.counts.length(), lib_.size(), 0.0);  // posterior probs
     int len = static_cast<int>(cp.length());
 
-    // Calculate and add pseudocounts for each sequence window X_i separately
-#pragma omp parallel for schedule(static)
-    for (int i = 0; i < len; ++i) {
-        double* ppi = &pp[i][0];
-        // Calculate posterior probability of state k given sequence window around 'i'
-        CalculatePosteriorProbs(lib_, emission_, cp, i, ppi);
-        // Calculate pseudocount vector P(a|X_i)
-        double* pc = p[i];
-        for (size_t a = 0; a < Abc::kSize; ++a) pc[a] = 0.0;
-        for (size_t k = 0; k < lib_.size(); ++k) {
-            for(size_t a = 0; a < Abc::kSize; ++a)
-                pc[a] += ppi[k] * lib_[k].pc[a];
+    // Calculate and add pseudocounts for each profile window X_i separately
+#pragma omp parallel
+    {
+        Vector<double> pp(lib_.size(), 0.0);  // posterior probabilities
+
+#pragma omp for schedule(static)
+        for (int i = 0; i < len; ++i) {
+            // Calculate posterior probability of state k given profile window around 'i'
+            CalculatePosteriorProbs(lib_, emission_, cp, i, &pp[0]);
+            // Calculate pseudocount vector P(a|X_i)
+            double* pc = p[i];
+            for (size_t a = 0; a < Abc::kSize; ++a) pc[a] = 0.0;
+            for (size_t k = 0; k < lib_.size(); ++k) {
+                for(size_t a = 0; a < Abc::kSize; ++a)
+                    pc[a] += pp[k] * lib_[k].pc[a];
+            }
+            Normalize(&pc[0], Abc::kSize);
         }
-        Normalize(&pc[0], Abc::kSize);
     }
 }
 
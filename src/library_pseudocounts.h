@@ -42,6 +42,8 @@ class LibraryPseudocounts : public Pseudocounts<Abc> {
 
     virtual void AddToProfile(const CountProfile<Abc>& cp, Profile<Abc>& p) const;
 
+    virtual size_t ContextLength() const { return lib_.wlen(); }
+
   private:
     // Profile library with context profiles.
     const ContextLibrary<Abc>& lib_;
@@ -152,9 +152,11 @@ class Matrix {
   Matrix(size_t n, size_t m, const T &a);
   Matrix(size_t n, size_t m, const T *a);
   Matrix(const Matrix &rhs);
+  Matrix(Matrix &&rhs) noexcept;
   ~Matrix();
 
   Matrix & operator=(const Matrix &rhs);
+  Matrix & operator=(Matrix &&rhs) noexcept;
   T* operator[](const size_t i);
   const T* operator[](const size_t i) const;
   size_t nrows() const;
@@ -163,6 +165,8 @@ class Matrix {
   void Assign(size_t newn, size_t newm, const T &a);
   T* begin() { return *v; }
   const T* begin() const { return *v; }
+  // Exchanges contents with 'other' without copying any elements.
+  void Swap(Matrix &other) noexcept;
 
  private:
   size_t nn;
@@ -204,6 +208,29 @@ Matrix<T>::Matrix(const Matrix &rhs) : nn(rhs.nn), mm(rhs.mm), v(nn>0 ? new T*[n
   for (i=0; i< nn; i++) for (j=0; j<mm; j++) v[i][j] = rhs[i][j];
 }
 
+template <class T>
+Matrix<T>::Matrix(Matrix &&rhs) noexcept : nn(rhs.nn), mm(rhs.mm), v(rhs.v) {
+  rhs.nn = 0;
+  rhs.mm = 0;
+  rhs.v = NULL;
+}
+
+template <class T>
+Matrix<T> & Matrix<T>::operator=(Matrix<T> &&rhs) noexcept {
+  Swap(rhs);
+  return *this;
+}
+
+template <class T>
+void Matrix<T>::Swap(Matrix<T> &other) noexcept {
+  std::swap(nn, other.nn);
+  std::swap(mm, other.mm);
+  std::swap(v, other.v);
+}
+
+template <class T>
+inline void swap(Matrix<T> &a, Matrix<T> &b) { a.Swap(b); }
+
 template <class T>
 Matrix<T> & Matrix<T>::operator=(const Matrix<T> &rhs) {
   if (this != &rhs) {
@@ -20,6 +20,10 @@
 #ifndef CS_PARALLEL_TEMPERING_H_
 #define CS_PARALLEL_TEMPERING_H_
 
+#include <unistd.h>
+
+#include "checkpoint.h"
+
 namespace cs {
 
 template<class Abc, class TrainingPair>
@@ -30,10 +34,181 @@ struct ParallelTempering {
 
   virtual void ReplicaExchange(double myloglike, double& mytemp) = 0;
 
+  // Writes exchange state shared by all replicas to checkpoint stream.
+  virtual void WriteCheckpoint(FILE* /* fout */) const {}
+
+  // Restores state written by WriteCheckpoint().
+  virtual void ReadCheckpoint(FILE* /* fin */) {}
+
   const int rank;        // rank of this replica
   const int nreplicas;   // total number of replicas
 };
 
+// Exchange board shared by all replicas of a threaded parallel tempering run.
+// Each replica runs in its own OpenMP thread of the enclosing parallel region
+// and publishes its likelihood and temperature here; the training data and
+// all other read-only objects are shared by the threads.
+struct ReplicaBoard {
+  ReplicaBoard(int n, double t, unsigned int s)
+      : loglikes(n, 0.0), temps(n, 0.0), replicas(n), theta(t), ran(s),
+        failed(-1), narrived(0), generation(0) {
+    for (int i = 0; i < n; ++i) replicas[i] = i;
+#ifdef OPENMP
+    omp_init_lock(&lock);
+#endif
+  }
+
+  ~ReplicaBoard() {
+#ifdef OPENMP
+    omp_destroy_lock(&lock);
+#endif
+  }
+
+  // Waits until all replicas have called Wait() as often as this one. Unlike an
+  // OpenMP barrier it throws once a replica has failed, so that the others do
+  // not wait forever for a replica that left the exchange.
+  void Wait() {
+#ifdef OPENMP
+    omp_set_lock(&lock);
+    const size_t gen = generation;
+    if (failed < 0 && ++narrived == static_cast<int>(replicas.size())) {
+      narrived = 0;
+      ++generation;
+    }
+    bool done = generation != gen;
+    bool stop = failed >= 0;
+    omp_unset_lock(&lock);
+    while (!done && !stop) {
+      usleep(kWaitMicroseconds);
+      omp_set_lock(&lock);
+      done = generation != gen;
+      stop = failed >= 0;
+      omp_unset_lock(&lock);
+    }
+    if (!done)
+      throw Exception("Replica exchange stopped since replica %d failed!", failed + 1);
+#else
+    if (failed >= 0)
+      throw Exception("Replica exchange stopped since replica %d failed!", failed + 1);
+#endif
+  }
+
+  // Marks replica 'rank' as failed and releases all replicas waiting for it.
+  // Only the first failure is recorded.
+  void Fail(int rank) {
+#ifdef OPENMP
+    omp_set_lock(&lock);
+#endif
+    if (failed < 0) failed = rank;
+#ifdef OPENMP
+    omp_unset_lock(&lock);
+#endif
+  }
+
+  Vector<double> loglikes;  // likelihoods in rank-order
+  Vector<double> temps;     // temperatures in rank-order
+  Vector<int> replicas;     // ranks of all replicas sorted by temperature
+  double theta;             // probability for trying a replica exchange
+  Ran ran;                  // needed for random swap
+  int failed;               // rank of first failed replica or -1
+
+ private:
+  // Polling interval of replicas waiting for the others.
+  static const useconds_t kWaitMicroseconds = 200;
+
+  int narrived;             // replicas waiting in current round
+  size_t generation;        // number of completed rounds
+#ifdef OPENMP
+  omp_lock_t lock;          // guards failed, narrived and generation
+#endif
+
+  DISALLOW_COPY_AND_ASSIGN(ReplicaBoard);
+};
+
+// Replica exchange between threads of one process. All replicas must call
+// ReplicaExchange() the same number of times from within the same OpenMP
+// parallel region, since the exchange is synchronized by the board. A replica
+// that fails must call ReplicaBoard::Fail() to release the others.
+template<class Abc, class TrainingPair>
+struct ThreadedParallelTempering : public ParallelTempering<Abc, TrainingPair> {
+  typedef std::pair<double, int> LoglikeRankPair;
+
+  ThreadedParallelTempering(int r, int n, ReplicaBoard& b, bool s = true)
+      : ParallelTempering<Abc, TrainingPair>(r, n), board(b), sorted(s) {}
+
+  virtual ~ThreadedParallelTempering() {}
+
+  virtual void ReplicaExchange(double myloglike, double& mytemp) {
+    board.loglikes[rank] = myloglike;
+    board.temps[rank]    = mytemp;
+    board.Wait();
+    if (sorted) {
+      // Each replica picks the temperature that corresponds to the rank of its
+      // likelihood such that the best replicas run at the lower temperatures.
+      std::vector<LoglikeRankPair> loglike_rank_pairs;
+      for (int r = 0; r < nreplicas; ++r)
+        loglike_rank_pairs.push_back(std::make_pair(board.loglikes[r], r));
+      std::sort(loglike_rank_pairs.begin(), loglike_rank_pairs.end());
+      std::reverse(loglike_rank_pairs.begin(), loglike_rank_pairs.end());
+      Vector<double> temps(board.temps);
+      std::sort(&temps[0], &temps[0] + nreplicas);
+      for (int i = 0; i < nreplicas; ++i)
+        if (loglike_rank_pairs[i].second == rank) mytemp = temps[i];
+
+    } else {
+      // Replica with rank 0 tries to swap the temperatures of a random pair
+      // of adjacent temperature levels on behalf of all replicas.
+      if (rank == 0 && nreplicas > 1 && board.ran.doub() < board.theta) {
+        const int l = board.ran(nreplicas - 1);  // pick random temperature level
+        const int lower = board.replicas[l];     // rank of replica with lower temp
+        const int upper = board.replicas[l+1];   // rank of replica with upper temp
+        const double alph = AcceptanceProb(board.temps[lower], board.loglikes[lower],
+                                           board.temps[upper], board.loglikes[upper]);
+        if (board.ran.doub() < alph) {
+          std::swap(board.temps[lower], board.temps[upper]);
+          board.replicas[l]   = upper;
+          board.replicas[l+1] = lower;
+        }
+      }
+      board.Wait();
+      mytemp = board.temps[rank];
+    }
+    // Make sure no replica publishes its next likelihood before all others
+    // are done reading the board.
+    board.Wait();
+  }
+
+  double AcceptanceProb(double temp_i, double loklike_i,
+                        double temp_j, double loklike_j) {
+    double p = exp((loklike_j - loklike_i) * ((1.0 / temp_i) - (1.0 / temp_j)));
+    return MIN(1.0, p);
+  }
+
+  // Writes replica table and exchange RNG, which every replica checkpoints.
+  virtual void WriteCheckpoint(FILE* fout) const {
+    WriteBinary(fout, board.replicas);
+    WriteBinary(fout, board.ran);
+  }
+
+  // Restores the board from the checkpoint of replica 0, which is the only
+  // replica that reads the replica table and the RNG during exchanges.
+  virtual void ReadCheckpoint(FILE* fin) {
+    Vector<int> replicas(nreplicas);
+    Ran ran(0);
+    ReadBinary(fin, replicas);
+    ReadBinary(fin, ran);
+    if (rank == 0) {
+      board.replicas = replicas;
+      board.ran = ran;
+    }
+  }
+
+  using ParallelTempering<Abc, TrainingPair>::rank;
+  using ParallelTempering<Abc, TrainingPair>::nreplicas;
+  ReplicaBoard& board;  // exchange board shared by all replicas
+  bool sorted;          // use sorted instead of single exchange tempering
+};
+
 #ifdef PARALLEL
 
 template<class Abc, class TrainingPair>
@@ -115,6 +290,16 @@ struct SingleExchParallelTempering : public ParallelTempering<Abc, TrainingPair>
     return MIN(1.0, p);
   }
 
+  virtual void WriteCheckpoint(FILE* fout) const {
+    WriteBinary(fout, replicas);
+    WriteBinary(fout, ran);
+  }
+
+  virtual void ReadCheckpoint(FILE* fin) {
+    ReadBinary(fin, replicas);
+    ReadBinary(fin, ran);
+  }
+
   using ParallelTempering<Abc, TrainingPair>::rank;
   using ParallelTempering<Abc, TrainingPair>::nreplicas;
   Vector<int> replicas;  // ranks of all replicas sorted by temperature
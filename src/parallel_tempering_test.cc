@@ -0,0 +1,138 @@
+#include <gtest/gtest.h>
+
+#include "cs.h"
+#include "parallel_tempering.h"
+#include "training_sequence.h"
+
+namespace cs {
+
+typedef ThreadedParallelTempering<AA, TrainingSequence<AA> > ThreadedPT;
+
+const int kNumReplicas = 4;
+
+TEST(ParallelTemperingTest, CheckpointRestoresReplicaTable) {
+  ReplicaBoard board(kNumReplicas, 0.5, 7);
+  std::swap(board.replicas[1], board.replicas[2]);
+  board.ran.doub();
+  FILE* fp = tmpfile();
+  ASSERT_TRUE(fp != NULL);
+  ThreadedPT(0, kNumReplicas, board, false).WriteCheckpoint(fp);
+
+  // Only replica 0 restores the shared board
+  ReplicaBoard board2(kNumReplicas, 0.5, 0);
+  rewind(fp);
+  ThreadedPT(1, kNumReplicas, board2, false).ReadCheckpoint(fp);
+  EXPECT_EQ(1, board2.replicas[1]);
+  rewind(fp);
+  ThreadedPT(0, kNumReplicas, board2, false).ReadCheckpoint(fp);
+  fclose(fp);
+  for (int l = 0; l < kNumReplicas; ++l)
+    EXPECT_EQ(board.replicas[l], board2.replicas[l]);
+  EXPECT_EQ(board.ran.int64(), board2.ran.int64());
+}
+
+#ifdef OPENMP
+
+TEST(ParallelTemperingTest, SortedExchangeGivesBestReplicasLowestTemps) {
+  // Replica r starts at temperature r+1 regardless of its likelihood
+  const double loglikes[kNumReplicas] = { -40.0, -10.0, -30.0, -20.0 };
+  const double expected[kNumReplicas] = { 4.0, 1.0, 3.0, 2.0 };
+  std::vector<double> temps(kNumReplicas);
+  int nthreads = 0;
+  ReplicaBoard board(kNumReplicas, 1.0, 0);
+
+  omp_set_dynamic(0);
+#pragma omp parallel num_threads(kNumReplicas)
+  {
+    const int r = omp_get_thread_num();
+#pragma omp single
+    nthreads = omp_get_num_threads();
+    ThreadedPT partemp(r, kNumReplicas, board, true);
+    double temp = r + 1.0;
+    partemp.ReplicaExchange(loglikes[r], temp);
+    // A second exchange with unchanged likelihoods keeps the order
+    partemp.ReplicaExchange(loglikes[r], temp);
+    temps[r] = temp;
+  }
+
+  ASSERT_EQ(kNumReplicas, nthreads);
+  for (int r = 0; r < kNumReplicas; ++r)
+    EXPECT_EQ(expected[r], temps[r]);
+}
+
+TEST(ParallelTemperingTest, SingleExchangeKeepsReplicaOrder) {
+  const int kNumRounds = 50;
+  // Equal likelihoods make every proposed swap accepted
+  ReplicaBoard board(kNumReplicas, 1.0, 0);
+  std::vector< std::vector<double> > temps(kNumRounds, std::vector<double>(kNumReplicas));
+  std::vector< std::vector<int> > orders(kNumRounds);
+  int nthreads = 0;
+
+  omp_set_dynamic(0);
+#pragma omp parallel num_threads(kNumReplicas)
+  {
+    const int r = omp_get_thread_num();
+#pragma omp single
+    nthreads = omp_get_num_threads();
+    ThreadedPT partemp(r, kNumReplicas, board, false);
+    double temp = r + 1.0;
+    for (int n = 0; n < kNumRounds; ++n) {
+      partemp.ReplicaExchange(-10.0, temp);
+      temps[n][r] = temp;
+#pragma omp single
+      orders[n].assign(&board.replicas[0], &board.replicas[0] + kNumReplicas);
+    }
+  }
+
+  ASSERT_EQ(kNumReplicas, nthreads);
+  size_t nswaps = 0;
+  std::vector<int> prev;
+  for (int r = 0; r < kNumReplicas; ++r) prev.push_back(r);
+  for (int n = 0; n < kNumRounds; ++n) {
+    // The replica at level l of the replica table runs at temperature l+1
+    for (int l = 0; l < kNumReplicas; ++l)
+      EXPECT_EQ(l + 1.0, temps[n][orders[n][l]]);
+    // Each round swaps exactly one pair of adjacent levels
+    int ndiff = 0;
+    for (int l = 0; l < kNumReplicas; ++l)
+      if (orders[n][l] != prev[l]) ++ndiff;
+    EXPECT_EQ(2, ndiff);
+    nswaps += ndiff / 2;
+    prev = orders[n];
+  }
+  EXPECT_EQ(static_cast<size_t>(kNumRounds), nswaps);
+}
+
+TEST(ParallelTemperingTest, FailedReplicaReleasesOthers) {
+  ReplicaBoard board(kNumReplicas, 1.0, 0);
+  std::vector<int> stopped(kNumReplicas, 0);
+  int nthreads = 0;
+
+  omp_set_dynamic(0);
+#pragma omp parallel num_threads(kNumReplicas)
+  {
+    const int r = omp_get_thread_num();
+#pragma omp single
+    nthreads = omp_get_num_threads();
+    ThreadedPT partemp(r, kNumReplicas, board, true);
+    double temp = r + 1.0;
+    try {
+      partemp.ReplicaExchange(-10.0, temp);
+      // Replica 2 fails before the second exchange the others are waiting in
+      if (r == 2) throw Exception("Replica failed!");
+      partemp.ReplicaExchange(-10.0, temp);
+    } catch (const std::exception&) {
+      board.Fail(r);
+      stopped[r] = 1;
+    }
+  }
+
+  ASSERT_EQ(kNumReplicas, nthreads);
+  EXPECT_EQ(2, board.failed);
+  for (int r = 0; r < kNumReplicas; ++r)
+    EXPECT_EQ(1, stopped[r]);
+}
+
+#endif  // OPENMP
+
+}  // namespace cs
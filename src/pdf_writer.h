@@ -39,7 +39,7 @@ class PdfWriter {
     void WriteToFile(std::string outfile, bool keep = false);
 
     // TexShade residue width in cm
-    static const float kResWidth = 0.21212;
+    static constexpr float kResWidth = 0.21212;
 
     // Writes header section of latex file
     void WriteHeader(FILE* fp) const;
@@ -89,7 +89,7 @@ class ProfilePdfWriter : public PdfWriter {
     virtual void WriteBody(FILE* fp);
 
     // Y-Scale for TikZ
-    static const float kScaleY = 0.1;
+    static constexpr float kScaleY = 0.1;
 
     Profile<Abc> profile_;
 };
@@ -116,7 +116,7 @@ class StateProfilePdfWriter : public PdfWriter {
     void DefineColors(FILE* fp) const;
 
     // Y-Scale for TikZ
-    static const float kScaleY = 0.1;
+    static constexpr float kScaleY = 0.1;
 
     Profile<AS> profile_;
     const ContextLibrary<Abc>& lib_;
@@ -145,7 +145,7 @@ class ContextLibraryPdfWriter : public PdfWriter {
     void DefineColors(FILE* fp) const;
 
     // Y-Scale for TikZ
-    static const float kScaleY = 0.1;
+    static constexpr float kScaleY = 0.1;
 
     const ContextLibrary<Abc>& lib_;
 };
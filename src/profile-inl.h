@@ -20,6 +20,10 @@
 #ifndef CS_PROFILE_INL_H_
 #define CS_PROFILE_INL_H_
 
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+
 #include "profile.h"
 
 namespace cs {
@@ -28,67 +32,70 @@ template <class Abc>
 Profile<Abc>::Profile() : nn(0), v(NULL) {}
 
 template <class Abc>
-Profile<Abc>::Profile(size_t n) : nn(n), v(n>0 ? new double*[n] : NULL) {
-    size_t i,nel=n*Abc::kSizeAny;
-    if (v) v[0] = nel>0 ? new double[nel] : NULL;
-    for (i=1;i<n;i++) v[i] = v[i-1] + Abc::kSizeAny;
+Profile<Abc>::Profile(size_t n) : nn(0), v(NULL) {
+    Allocate(n);
+}
+
+template <class Abc>
+Profile<Abc>::Profile(size_t n, const double &a) : nn(0), v(NULL) {
+    Allocate(n);
+    for (size_t i=0; i< n; i++) for (size_t j=0; j<Abc::kSizeAny; j++) v[i][j] = a;
 }
 
+// Copies values from array 'a' with rows of Abc::kSizeAny consecutive entries.
 template <class Abc>
-Profile<Abc>::Profile(size_t n, const double &a)
-        : nn(n), v(n>0 ? new double*[n] : NULL) {
-    size_t i,j,nel=n*Abc::kSizeAny;
-    if (v) v[0] = nel>0 ? new double[nel] : NULL;
-    for (i=1; i< n; i++) v[i] = v[i-1] + Abc::kSizeAny;
-    for (i=0; i< n; i++) for (j=0; j<Abc::kSizeAny; j++) v[i][j] = a;
+Profile<Abc>::Profile(size_t n, const double *a) : nn(0), v(NULL) {
+    Allocate(n);
+    for (size_t i=0; i< n; i++)
+        memcpy(v[i], a + i * Abc::kSizeAny, Abc::kSizeAny * sizeof(double));
 }
 
 template <class Abc>
-Profile<Abc>::Profile(size_t n, const double *a)
-        : nn(n), v(n>0 ? new double*[n] : NULL) {
-    size_t i,nel=n*Abc::kSizeAny;
-    if (v) v[0] = nel>0 ? new double[nel] : NULL;
-    for (i=1; i< n; i++) v[i] = v[i-1] + Abc::kSizeAny;
-    memcpy(v[0], a, nel * sizeof(double));
+Profile<Abc>::Profile(const Profile &rhs) : nn(0), v(NULL) {
+    Allocate(rhs.nn);
+    if (v) memcpy(v[0], rhs[0], nn * stride() * sizeof(double));
 }
 
 template <class Abc>
-Profile<Abc>::Profile(const Profile &rhs)
-        : nn(rhs.nn), v(nn>0 ? new double*[nn] : NULL) {
-    size_t i,nel=nn*Abc::kSizeAny;
-    if (v) v[0] = nel>0 ? new double[nel] : NULL;
-    for (i=1; i< nn; i++) v[i] = v[i-1] + Abc::kSizeAny;
-    memcpy(v[0], rhs[0], nel * sizeof(double));
+Profile<Abc>::Profile(Profile &&rhs) noexcept : nn(rhs.nn), v(rhs.v) {
+    rhs.nn = 0;
+    rhs.v = NULL;
 }
 
 template <class Abc>
-Profile<Abc>::Profile(const CountProfile<Abc>& cp)
-        : nn(cp.length()), v(nn>0 ? new double*[nn] : NULL) {
-    size_t i,j,nel=nn*Abc::kSizeAny;
-    if (v) v[0] = nel>0 ? new double[nel] : NULL;
-    for (i=1; i< nn; i++) v[i] = v[i-1] + Abc::kSizeAny;
-    for (i=0; i< nn; i++) 
-      for (j=0; j<Abc::kSizeAny; j++) 
+Profile<Abc>::Profile(const CountProfile<Abc>& cp) : nn(0), v(NULL) {
+    Allocate(cp.length());
+    for (size_t i=0; i< nn; i++)
+      for (size_t j=0; j<Abc::kSizeAny; j++)
         v[i][j] = cp.neff[i] > 0 ? cp.counts[i][j] / cp.neff[i] : 0.0;
 }
 
+template <class Abc>
+void Profile<Abc>::Allocate(size_t n) {
+    nn = n;
+    v = n>0 ? new double*[n] : NULL;
+    if (v) v[0] = AlignedAlloc(n * stride(), kProfileAlign);
+    for (size_t i=1; i< n; i++) v[i] = v[i-1] + stride();
+}
+
+template <class Abc>
+void Profile<Abc>::Free() {
+    if (v != NULL) {
+        AlignedFree(v[0]);
+        delete[] v;
+    }
+    nn = 0;
+    v = NULL;
+}
 
 template <class Abc>
 Profile<Abc> & Profile<Abc>::operator=(const Profile<Abc> &rhs) {
     if (this != &rhs) {
-        size_t i,nel;
-        nel = rhs.nn*Abc::kSizeAny;
         if (nn != rhs.nn) {
-            if (v != NULL) {
-                delete[] v[0];
-                delete[] v;
-            }
-            nn=rhs.nn;
-            v = nn>0 ? new double*[nn] : NULL;
-            if (v) v[0] = nel>0 ? new double[nel] : NULL;
-            for (i=1; i< nn; i++) v[i] = v[i-1] + Abc::kSizeAny;
+            Free();
+            Allocate(rhs.nn);
         }
-        memcpy(v[0], rhs[0], nel * sizeof(double));
+        if (v) memcpy(v[0], rhs[0], nn * stride() * sizeof(double));
     }
     return *this;
 }
@@ -113,51 +120,41 @@ inline const double* Profile<Abc>::operator[](const size_t i) const {
     return v[i];
 }
 
+template <class Abc>
+Profile<Abc> & Profile<Abc>::operator=(Profile<Abc> &&rhs) noexcept {
+    Swap(rhs);
+    return *this;
+}
+
+template <class Abc>
+void Profile<Abc>::Swap(Profile<Abc> &other) noexcept {
+    std::swap(nn, other.nn);
+    std::swap(v, other.v);
+}
+
 template <class Abc>
 void Profile<Abc>::Resize(size_t newn) {
-    size_t i,nel;
     if (newn != nn) {
-        if (v != NULL) {
-            delete[] v[0];
-            delete[] v;
-        }
-        nn = newn;
-        v = nn>0 ? new double*[nn] : NULL;
-        nel = nn*Abc::kSizeAny;
-        if (v) v[0] = nel>0 ? new double[nel] : NULL;
-        for (i=1; i< nn; i++) v[i] = v[i-1] + Abc::kSizeAny;
+        Free();
+        Allocate(newn);
     }
 }
 
 template <class Abc>
 void Profile<Abc>::Assign(size_t newn, const double& a) {
-    size_t i,j,nel;
-    if (newn != nn) {
-        if (v != NULL) {
-            delete[] v[0];
-            delete[] v;
-        }
-        nn = newn;
-        v = nn>0 ? new double*[nn] : NULL;
-        nel = nn*Abc::kSizeAny;
-        if (v) v[0] = nel>0 ? new double[nel] : NULL;
-        for (i=1; i< nn; i++) v[i] = v[i-1] + *Abc::kSizeAny;
-    }
-    for (i=0; i< nn; i++) for (j=0; j<*Abc::kSizeAny; j++) v[i][j] = a;
+    Resize(newn);
+    for (size_t i=0; i< nn; i++) for (size_t j=0; j<Abc::kSizeAny; j++) v[i][j] = a;
 }
 
 template<class Abc>
 void Profile<Abc>::Insert(size_t idx, const Profile<Abc>& other) {
     size_t n = MIN(other.length(), length() - idx);
-    memcpy(v[idx], other[0], n * Abc::kSizeAny * sizeof(double));
+    if (n > 0) memcpy(v[idx], other[0], n * stride() * sizeof(double));
 }
 
 template <class Abc>
 Profile<Abc>::~Profile() {
-    if (v != NULL) {
-        delete[] v[0];
-        delete[] v;
-    }
+    Free();
 }
 
 // Assigns given constant value or default to all entries in matrix
@@ -232,6 +229,20 @@ inline double Neff(const Profile<Abc>& p) {
 }
 
 
+inline double RowDot(const double* x, const double* y, size_t n) {
+    size_t a = 0;
+    double rv = 0.0;
+#ifdef __AVX__
+    __m256d sum = _mm256_setzero_pd();
+    for (; a + 4 <= n; a += 4)
+        sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_load_pd(x + a), _mm256_load_pd(y + a)));
+    const __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+    rv = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+#endif
+    for (; a < n; ++a) rv += x[a] * y[a];
+    return rv;
+}
+
 }  // namespace cs
 
 #endif  // CS_PROFILE_INL_H_
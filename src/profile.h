@@ -27,8 +27,12 @@ namespace cs {
 template <class Abc>
 struct CountProfile;
 
+// Alignment in bytes of profile rows, enough for aligned AVX loads.
+const size_t kProfileAlign = 32;
+
 // A simple container class acting pretty much like a matrix but with column size
-// fixed to Abc::kSizeAny
+// fixed to Abc::kSizeAny. Rows are padded with zeros to a multiple of
+// kProfileAlign bytes and start at kProfileAlign boundaries.
 template <class Abc>
 class Profile {
   public:
@@ -37,22 +41,41 @@ class Profile {
     Profile(size_t n, const double &a);
     Profile(size_t n, const double *a);
     Profile(const Profile &rhs);
+    Profile(Profile &&rhs) noexcept;
     Profile(const CountProfile<Abc>& cp);
     ~Profile();
 
     Profile & operator=(const Profile &rhs);
+    Profile & operator=(Profile &&rhs) noexcept;
     double* operator[](const size_t i);
     const double* operator[](const size_t i) const;
     size_t length() const { return nn; }
     void Resize(size_t newn);
     void Assign(size_t newn, const double &a);
     void Insert(size_t idx, const Profile<Abc>& other);
+    // Exchanges contents with 'other' without copying any rows.
+    void Swap(Profile &other) noexcept;
+
+    // Returns the distance in doubles between consecutive rows.
+    static size_t stride() {
+        const size_t lanes = kProfileAlign / sizeof(double);
+        return (Abc::kSizeAny + lanes - 1) / lanes * lanes;
+    }
 
   private:
+    // Allocates zeroed storage for 'n' rows and sets up row pointers.
+    void Allocate(size_t n);
+    // Releases storage and row pointers.
+    void Free();
+
     size_t nn;
     double **v;
 };
 
+// Exchanges the contents of two profiles without copying.
+template <class Abc>
+void swap(Profile<Abc>& a, Profile<Abc>& b) { a.Swap(b); }
+
 // Assigns given constant value or default to all entries in matrix
 template <class Abc>
 void Assign(Profile<Abc>& p, double val = 0.0);
@@ -79,6 +102,11 @@ inline double Entropy(const Profile<Abc>& p);
 template <class Abc>
 inline double Neff(const Profile<Abc>& p);
 
+// Returns the dot product of the first 'n' entries of rows 'x' and 'y', which
+// must start at kProfileAlign boundaries like all profile rows, so that the
+// products are summed with aligned AVX loads.
+inline double RowDot(const double* x, const double* y, size_t n);
+
 }  // namespace cs
 
 #endif  // CS_PROFILE_H_
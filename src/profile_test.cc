@@ -37,7 +37,7 @@ class ProfileTest : public testing::Test {
     Ran ran;
 
     static const size_t kLen   = 100;
-    static const double kDelta = 1e-5;
+    static constexpr double kDelta = 1e-5;
 };
 
 TEST_F(ProfileTest, InitValue) {
@@ -55,9 +55,34 @@ TEST_F(ProfileTest, InitArray) {
   for (size_t i = 0; i < l; ++i)
     v[i] = ran.doub();
   Profile<AA> p(kLen, v);
-  for (size_t i = 0; i < l; ++i) {
-    ASSERT_EQ(p[0][i], v[i]);
+  for (size_t i = 0; i < l; ++i)
     ASSERT_EQ(p[i / AA::kSizeAny][i % AA::kSizeAny], v[i]);
+}
+
+TEST_F(ProfileTest, AlignedPaddedRows) {
+  EXPECT_EQ(24u, Profile<AA>::stride());
+  EXPECT_EQ(8u, Profile<Dna>::stride());
+  Profile<AA> p(kLen, 1.0);
+  Profile<AA> q;
+  q = p;
+  q.Resize(kLen + 1);
+  for (size_t i = 0; i < kLen; ++i) {
+    EXPECT_EQ(0u, reinterpret_cast<size_t>(p[i]) % kProfileAlign);
+    EXPECT_EQ(0u, reinterpret_cast<size_t>(q[i]) % kProfileAlign);
+    for (size_t a = AA::kSizeAny; a < Profile<AA>::stride(); ++a)
+      EXPECT_EQ(0.0, p[i][a]);
+  }
+}
+
+TEST_F(ProfileTest, RowDot) {
+  Profile<AA> p = GetRndProfile();
+  Profile<AA> q = GetRndProfile();
+  for (size_t i = 0; i < kLen; ++i) {
+    for (size_t n = 0; n <= AA::kSizeAny; ++n) {
+      double ref = 0.0;
+      for (size_t a = 0; a < n; ++a) ref += p[i][a] * q[i][a];
+      EXPECT_NEAR(ref, RowDot(p[i], q[i], n), 1e-12);
+    }
   }
 }
 
@@ -74,6 +99,23 @@ TEST_F(ProfileTest, AssignProfile) {
   ASSERT_TRUE(IsEqual(p, q));
 }
 
+TEST_F(ProfileTest, MoveAndSwap) {
+  Profile<AA> p = GetRndProfile();
+  Profile<AA> ref(p);
+  const double* rows = p[0];
+  Profile<AA> q(std::move(p));
+  EXPECT_EQ(0u, p.length());
+  EXPECT_EQ(rows, q[0]);
+  ASSERT_TRUE(IsEqual(ref, q));
+
+  CountProfile<AA> cp(std::move(q));
+  EXPECT_EQ(rows, cp.counts[0]);
+  Profile<AA> r(kLen / 2);
+  r.Swap(cp.counts);
+  EXPECT_EQ(kLen / 2, cp.length());
+  EXPECT_EQ(rows, r[0]);
+}
+
 TEST_F(ProfileTest, InitCountProfile) {
   CountProfile<AA> cp(kLen);
   for (size_t i = 0; i < kLen; ++i) {
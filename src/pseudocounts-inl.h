@@ -55,6 +55,101 @@ Profile<Abc> Pseudocounts<Abc>::AddTo(const CountProfile<Abc>& cp, Admix& admix)
     return p;
 }
 
+template<class Abc>
+Profile<Abc> Pseudocounts<Abc>::AddTo(const CountProfile<Abc>& cp, Admix& admix,
+                                      PseudocountsState<Abc>& state) const {
+    const size_t len = cp.length();
+    // Pseudocounts of a column depend on the columns within half a window
+    const size_t margin = ContextLength() > 0 ? (ContextLength() - 1) / 2 : 0;
+
+    // Mark all columns within 'margin' of a column that changed since last call
+    std::vector<bool> dirty(len, true);
+    if (state.cp.length() == len && state.pc.length() == len) {
+        std::vector<bool> changed(len, false);
+        for (size_t i = 0; i < len; ++i) {
+            changed[i] = cp.neff[i] != state.cp.neff[i];
+            for (size_t a = 0; a < Abc::kSize && !changed[i]; ++a)
+                changed[i] = cp.counts[i][a] != state.cp.counts[i][a];
+        }
+        size_t dist = margin + 1;  // distance to the nearest changed column
+        for (size_t i = 0; i < len; ++i) {
+            dist = changed[i] ? 0 : dist + 1;
+            dirty[i] = dist <= margin;
+        }
+        dist = margin + 1;
+        for (size_t i = len; i-- > 0; ) {
+            dist = changed[i] ? 0 : dist + 1;
+            if (dist <= margin) dirty[i] = true;
+        }
+    } else {
+        state.pc.Resize(len);
+    }
+
+    // Recompute runs of dirty columns padded with their context as in
+    // AddToChunked(). Runs closer than twice the padding are merged.
+    state.ncomputed = 0;
+    for (size_t beg = 0; beg < len; ) {
+        if (!dirty[beg]) { ++beg; continue; }
+        size_t end = beg + 1;
+        for (size_t i = end; i < len && i <= end + 2 * margin; ++i)
+            if (dirty[i]) end = i + 1;
+        const size_t left = MIN(beg, margin);
+        const size_t right = MIN(len - end, margin);
+        CountProfile<Abc> sub(cp, beg - left, left + (end - beg) + right);
+        Profile<Abc> p(sub.length());
+        AddToProfile(sub, p);
+        for (size_t i = beg; i < end; ++i)
+            for (size_t a = 0; a < Abc::kSizeAny; ++a)
+                state.pc[i][a] = p[left + i - beg][a];
+        state.ncomputed += end - beg;
+        beg = end;
+    }
+    state.cp = cp;
+
+    // Admix and normalize a copy of the pseudocounts as in AddTo()
+    Profile<Abc> p(state.pc);
+    if (target_neff_ >= 1.0) {
+      AdmixToTargetNeff(cp, p, admix);
+    } else {
+      AdmixTo(cp, p, admix);
+    }
+    for(size_t i = 0; i < len; ++i)
+        p[i][Abc::kAny] = 0.0;
+    Normalize(p, 1.0);
+    return p;
+}
+
+template<class Abc>
+template<class Sink>
+void Pseudocounts<Abc>::AddToChunked(const Sequence<Abc>& seq, const Admix& admix,
+                                     size_t chunk, Sink& sink) const {
+    if (target_neff_ >= 1.0)
+        throw Exception("Target Neff admixture is not supported for chunked pseudocounts!");
+    assert(chunk > 0);
+    const size_t len = seq.length();
+    // Pseudocounts of a column depend on the columns within half a window
+    const size_t margin = ContextLength() > 0 ? (ContextLength() - 1) / 2 : 0;
+
+    for (size_t beg = 0; beg < len; beg += chunk) {
+        const size_t end = MIN(beg + chunk, len);
+        const size_t left = MIN(beg, margin);
+        const size_t right = MIN(len - end, margin);
+        Sequence<Abc> sub(seq, beg - left, left + (end - beg) + right);
+        Profile<Abc> p(sub.length());
+        AddToSequence(sub, p);
+        AdmixTo(sub, p, admix);
+
+        // Strip the padding and normalize the remaining columns as in AddTo()
+        Profile<Abc> q(end - beg);
+        for (size_t i = 0; i < q.length(); ++i) {
+            for (size_t a = 0; a < Abc::kSize; ++a) q[i][a] = p[left + i][a];
+            q[i][Abc::kAny] = 0.0;
+        }
+        Normalize(q, 1.0);
+        sink(q, beg);
+    }
+}
+
 template<class Abc>
 void Pseudocounts<Abc>::AdmixTo(const Sequence<Abc>& q, Profile<Abc>& p, const Admix& admix) const {
     double tau = admix(1.0);
@@ -76,37 +171,117 @@ void Pseudocounts<Abc>::AdmixTo(const CountProfile<Abc>& q, Profile<Abc>& p, con
     }
 }
 
-// Adjusts the Neff in 'p' to 'neff' by admixing q and returns tau.
+// Returns the frequency of letter 'a' in column 'i' of a query sequence.
+template<class Abc>
+inline double QueryFreq(const Sequence<Abc>& q, size_t i, size_t a) {
+    return q[i] == a ? 1.0 : 0.0;
+}
+
+// Returns the frequency of letter 'a' in column 'i' of a query count profile.
+template<class Abc>
+inline double QueryFreq(const CountProfile<Abc>& q, size_t i, size_t a) {
+    return q.counts[i][a] / q.neff[i];
+}
+
+// Returns the number of effective sequences in column 'i' of a query sequence.
+template<class Abc>
+inline double QueryNeff(const Sequence<Abc>&, size_t) { return 1.0; }
+
+// Returns the number of effective sequences in column 'i' of a query count profile.
+template<class Abc>
+inline double QueryNeff(const CountProfile<Abc>& q, size_t i) { return q.neff[i]; }
+
+// Evaluates the Neff that admixing query 'q' to pseudocount profile 'p' results
+// in for varying admixture parameters without modifying 'p'. Letters absent
+// from a query column are only scaled by tau, so that their entropy is
+// precomputed per column and each evaluation takes logs only of letters that
+// occur in the query.
+template<class Abc, class T>
+class AdmixedNeff {
+  public:
+    AdmixedNeff(const T& q, const Profile<Abc>& p)
+            : q_(q), p_(p), mass_(p.length(), 0.0), plogp_(p.length(), 0.0) {
+        for (size_t i = 0; i < p.length(); ++i) {
+            for (size_t a = 0; a < Abc::kSize; ++a) {
+                if (QueryFreq(q, i, a) != 0.0 || p[i][a] <= 0.0) continue;
+                mass_[i] += p[i][a];
+                plogp_[i] += p[i][a] * log2(p[i][a]);
+            }
+        }
+    }
+
+    // Returns the Neff of the profile admixed with given admixture.
+    double operator() (const Admix& admix) const {
+        const int len = p_.length();
+        double entropy = 0.0;
+#pragma omp parallel for schedule(static) reduction(+:entropy) if(len >= kParallelMinLength)
+        for (int i = 0; i < len; ++i) {
+            const double tau = admix(QueryNeff(q_, i));
+            const double t = 1 - tau;
+            if (tau > 0.0) entropy -= tau * (plogp_[i] + log2(tau) * mass_[i]);
+            for (size_t a = 0; a < Abc::kSize; ++a) {
+                const double f = QueryFreq(q_, i, a);
+                if (f == 0.0) continue;
+                const double m = tau * p_[i][a] + t * f;
+                if (m > FLT_MIN) entropy -= m * log2(m);
+            }
+        }
+        return len > 0 ? pow(2, entropy / len) : 0;
+    }
+
+  private:
+    // Minimal profile length for evaluating the Neff in parallel.
+    static const int kParallelMinLength = 1000;
+
+    const T& q_;
+    const Profile<Abc>& p_;
+    Vector<double> mass_;   // summed pseudocounts of letters absent from query column
+    Vector<double> plogp_;  // summed p*log2(p) of letters absent from query column
+};
+
+// Adjusts the Neff in 'p' to 'neff' by admixing q and returns tau. Since the
+// Neff grows with the admixture parameter, its root is bracketed by the
+// parameter range and found by regula falsi with the Illinois modification.
+// Only the final parameter is applied to 'p'.
 template<class Abc>
 template<class T>
 double Pseudocounts<Abc>::AdmixToTargetNeff(const T& q, Profile<Abc>& p, Admix& admix) const {
-
+    const AdmixedNeff<Abc, T> neff(q, p);
     double l = kTargetNeffParamMin;
     double r = kTargetNeffParamMax;
-    admix.SetTargetNeffParam(kTargetNeffParamInit);
-    Profile<Abc> pp;
-    while (l < kTargetNeffParamMax - kTargetNeffEps && r > kTargetNeffParamMin + kTargetNeffEps) {
-        pp = p;
-        AdmixTo(q, pp, admix);
-        double ne = Neff(pp);
-        if (fabs(ne - target_neff_) <= target_neff_delta_) {
-            break;
-        } else {
-            if (ne < target_neff_) l = admix.GetTargetNeffParam();
-            else r = admix.GetTargetNeffParam();
+    double x = l;
+    admix.SetTargetNeffParam(l);
+    double fl = neff(admix) - target_neff_;
+
+    if (fl < -target_neff_delta_) {
+        x = r;
+        admix.SetTargetNeffParam(r);
+        double fr = neff(admix) - target_neff_;
+
+        if (fr > target_neff_delta_) {
+            int side = 0;  // bracket end replaced in last iteration
+            for (int n = 0; n < kTargetNeffMaxIter; ++n) {
+                x = (l * fr - r * fl) / (fr - fl);
+                admix.SetTargetNeffParam(x);
+                const double fx = neff(admix) - target_neff_;
+                if (fabs(fx) <= target_neff_delta_) break;
+                if (fx < 0.0) {
+                    l = x;
+                    fl = fx;
+                    if (side == -1) fr *= 0.5;
+                    side = -1;
+                } else {
+                    r = x;
+                    fr = fx;
+                    if (side == 1) fl *= 0.5;
+                    side = 1;
+                }
+            }
         }
-        admix.SetTargetNeffParam(0.5 * (l + r));
-    }
-    if (l > kTargetNeffParamMax - kTargetNeffEps) {
-        admix.SetTargetNeffParam(kTargetNeffParamMax);
-        AdmixTo(q, p, admix);
-    } else if (r < kTargetNeffParamMin + kTargetNeffEps) {
-        admix.SetTargetNeffParam(kTargetNeffParamMin);
-        AdmixTo(q, p, admix);
-    } else {
-        p = pp;
     }
-    return admix.GetTargetNeffParam();
+    admix.SetTargetNeffParam(x);
+    AdmixTo(q, p, admix);
+    return x;
 }
 
 
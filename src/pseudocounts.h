@@ -113,6 +113,18 @@ struct HHsearchAdmix : public Admix {
 
 
 
+// Count profile of the last call to Pseudocounts::AddTo() with this state and
+// its pseudocounts before admixture, so that the next call only recomputes
+// columns whose context window changed.
+template<class Abc>
+struct PseudocountsState {
+    PseudocountsState() : ncomputed(0) {}
+
+    CountProfile<Abc> cp;  // profile of the last call
+    Profile<Abc> pc;       // pseudocounts of 'cp' before admixture
+    size_t ncomputed;      // number of columns recomputed in the last call
+};
+
 // An abstract base class for pseudocount factories.
 template<class Abc>
 class Pseudocounts {
@@ -127,6 +139,21 @@ class Pseudocounts {
     // Adds pseudocounts to sequence using admixture and returns normalized profile.
     Profile<Abc> AddTo(const CountProfile<Abc>& cp, Admix& admix) const;
 
+    // Same as above but reuses the pseudocounts in 'state' for all columns whose
+    // context window is unchanged since the last call and updates 'state'.
+    Profile<Abc> AddTo(const CountProfile<Abc>& cp, Admix& admix, PseudocountsState<Abc>& state) const;
+
+    // Adds pseudocounts to an arbitrarily long sequence in chunks of at most
+    // 'chunk' positions and passes each normalized chunk profile together with
+    // the index of its first column to sink(profile, offset). Chunks are padded
+    // with half a context window on both sides, so the rows are identical to those
+    // returned by AddTo() while memory no longer grows with sequence length.
+    template<class Sink>
+    void AddToChunked(const Sequence<Abc>& seq, const Admix& admix, size_t chunk, Sink& sink) const;
+
+    // Returns the number of sequence positions a pseudocount column depends on.
+    virtual size_t ContextLength() const { return 1; }
+
     // Gets the target Neff in the resulting profile after admixing pseudocounts.
     double GetTargetNeff() const {
       return target_neff_;
@@ -169,11 +196,10 @@ class Pseudocounts {
     double target_neff_delta_; // Maximal deviation from the target Neff.
 
   private:
-    static const double kNormalize           = 1e-5; // Normalization threshold.
-    static const double kTargetNeffParamMin  = 0.0;  // Minimal paramater value for adjusting to the target Neff.
-    static const double kTargetNeffParamMax  = 1.0;  // Maximal parameter value for adjusting to the target Neff.
-    static const double kTargetNeffParamInit = 0.5;  // Initial parameter value for adjusting to the target Neff.
-    static const double kTargetNeffEps       = 0.01; // Convergence threshold for adjusting to the target Neff.
+    static constexpr double kNormalize           = 1e-5; // Normalization threshold.
+    static constexpr double kTargetNeffParamMin  = 0.0;  // Minimal paramater value for adjusting to the target Neff.
+    static constexpr double kTargetNeffParamMax  = 1.0;  // Maximal parameter value for adjusting to the target Neff.
+    static const int kTargetNeffMaxIter          = 100;  // Maximal number of iterations for adjusting to the target Neff.
 
     DISALLOW_COPY_AND_ASSIGN(Pseudocounts);
 };  // Pseudocounts
@@ -235,6 +235,114 @@ TEST_F(PseudocountsTest, CrfLibEquality) {
 }
 
 
+// Adjusts the Neff of 'q' to the target Neff of 'pc' by bisection of the
+// admixture parameter, as AdmixToTargetNeff did before the regula falsi solver,
+// and returns the normalized profile.
+template<class T>
+static Profile<AA> BisectTargetNeff(Pseudocounts<AA>& pc, const T& q, Admix& admix) {
+  const double kEps = 0.01;
+  const double target_neff = pc.GetTargetNeff();
+  double l = 0.0, r = 1.0;
+  Profile<AA> p;
+  pc.SetTargetNeff(0.0);
+  admix.SetTargetNeffParam(0.5);
+  while (l < 1.0 - kEps && r > kEps) {
+    p = pc.AddTo(q, admix);
+    const double ne = Neff(p);
+    if (fabs(ne - target_neff) <= pc.GetTargetNeffDelta()) break;
+    if (ne < target_neff) l = admix.GetTargetNeffParam();
+    else r = admix.GetTargetNeffParam();
+    admix.SetTargetNeffParam(0.5 * (l + r));
+  }
+  if (l > 1.0 - kEps) {
+    admix.SetTargetNeffParam(1.0);
+    p = pc.AddTo(q, admix);
+  } else if (r < kEps) {
+    admix.SetTargetNeffParam(0.0);
+    p = pc.AddTo(q, admix);
+  }
+  pc.SetTargetNeff(target_neff);
+  return p;
+}
 
+// Checks that the target Neff solver reaches targets inside the range of the
+// admixture parameter and agrees with bisection inside and outside of it.
+template<class T>
+static void ExpectTargetNeffAsBisection(Pseudocounts<AA>& pc, const T& q, Admix& admix) {
+  const double kTargetNeffDelta = 0.01;
+  pc.SetTargetNeffDelta(kTargetNeffDelta);
+
+  // Neff range reachable with parameters in [0,1]
+  pc.SetTargetNeff(0.0);
+  admix.SetTargetNeffParam(0.0);
+  const double neff_min = Neff(pc.AddTo(q, admix));
+  admix.SetTargetNeffParam(1.0);
+  const Profile<AA> pmax(pc.AddTo(q, admix));
+  const double neff_max = Neff(pmax);
+  ASSERT_LT(neff_min + 1.0, neff_max);
+
+  // Neff evaluated by the solver equals Neff() of the admixed profile
+  ConstantAdmix full(1.0);
+  const Profile<AA> pcs(pc.AddTo(q, full));
+  for (double x = 0.0; x <= 1.0; x += 0.25) {
+    admix.SetTargetNeffParam(x);
+    EXPECT_NEAR(Neff(pc.AddTo(q, admix)), (AdmixedNeff<AA, T>(q, pcs)(admix)), 1e-6);
+  }
+
+  const double targets[] = { MAX(1.0, neff_min - 1.0),
+                             neff_min + 0.25 * (neff_max - neff_min),
+                             neff_min + 0.5 * (neff_max - neff_min),
+                             neff_min + 0.75 * (neff_max - neff_min),
+                             neff_max + 1.0 };
+  for (size_t i = 0; i < 5; ++i) {
+    pc.SetTargetNeff(targets[i]);
+    const Profile<AA> p(pc.AddTo(q, admix));
+    const double x = admix.GetTargetNeffParam();
+    const Profile<AA> b(BisectTargetNeff(pc, q, admix));
+    const double xb = admix.GetTargetNeffParam();
+    if (targets[i] < neff_min) {
+      EXPECT_EQ(0.0, x);
+      EXPECT_EQ(0.0, xb);
+      EXPECT_NEAR(neff_min, Neff(p), 1e-9);
+    } else if (targets[i] > neff_max) {
+      EXPECT_EQ(1.0, x);
+      EXPECT_EQ(1.0, xb);
+      EXPECT_NEAR(neff_max, Neff(p), 1e-9);
+    } else {
+      EXPECT_NEAR(targets[i], Neff(p), kTargetNeffDelta);
+      EXPECT_NEAR(targets[i], Neff(b), kTargetNeffDelta);
+      EXPECT_NEAR(xb, x, 0.05);
+    }
+    EXPECT_NEAR(Neff(b), Neff(p), 2 * kTargetNeffDelta);
+  }
+}
+
+TEST(TargetNeffTest, SequenceAgreesWithBisection) {
+  BlosumMatrix sm;
+  MatrixPseudocounts<AA> pc(sm);
+  Ran ran(1);
+  Sequence<AA> seq(80);
+  for (size_t i = 0; i < seq.length(); ++i) seq[i] = ran(AA::kSize);
+  ConstantAdmix constant(0.5);
+  ExpectTargetNeffAsBisection(pc, seq, constant);
+  CSBlastAdmix csblast(0.5, 12.0);
+  ExpectTargetNeffAsBisection(pc, seq, csblast);
+}
+
+TEST(TargetNeffTest, CountProfileAgreesWithBisection) {
+  BlosumMatrix sm;
+  MatrixPseudocounts<AA> pc(sm);
+  Ran ran(2);
+  Sequence<AA> seq(80);
+  for (size_t i = 0; i < seq.length(); ++i) seq[i] = ran(AA::kSize);
+  ConstantAdmix mix(0.3);
+  CountProfile<AA> cp(pc.AddTo(seq, mix));
+  for (size_t i = 0; i < cp.length(); ++i) cp.neff[i] = 2.0 + ran(4);
+  Normalize(cp.counts, cp.neff);
+  ConstantAdmix constant(0.5);
+  ExpectTargetNeffAsBisection(pc, cp, constant);
+  HHsearchAdmix hhsearch(0.5, 10.0);
+  ExpectTargetNeffAsBisection(pc, cp, hhsearch);
+}
 
 };  // namespace cs
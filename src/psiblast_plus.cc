@@ -0,0 +1,210 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <unistd.h>
+
+#include "cs.h"
+#include "psiblast_plus.h"
+#include "blast_hits.h"
+
+using std::string;
+
+namespace cs {
+
+#ifdef _WIN32
+const char* PsiBlastPlus::kPsiBlastExec = "psiblast.exe";
+#else
+const char* PsiBlastPlus::kPsiBlastExec = "psiblast";
+#endif
+
+// Rows of a PSSM in NCBIstdaa order
+static const char kNcbiStdAa[] = "-ABCDEFGHIKLMNPQRSTVWXYZU*OJ";
+
+// blastpgp options with a BLAST+ equivalent taking the same argument
+static const struct {
+  char opt;
+  const char* name;
+} kOptionNames[] = {
+  { 'd', "-db" },
+  { 'e', "-evalue" },
+  { 'h', "-inclusion_ethresh" },
+  { 'G', "-gapopen" },
+  { 'E', "-gapextend" },
+  { 't', "-comp_based_stats" },
+  { 'f', "-threshold" },
+  { 'A', "-window_size" },
+  { 'y', "-xdrop_ungap" },
+  { 'X', "-xdrop_gap" },
+  { 'Z', "-xdrop_gap_final" },
+  { 'z', "-dbsize" },
+  { 'Y', "-searchsp" }
+};
+
+// blastpgp options that are handled separately or have no meaning here
+static const char* kIgnoreOptions = "abiFjmoRTCBvQ";
+
+// Quotes a string for ASN.1 text by doubling quotes.
+static string AsnString(const string& s) {
+  string rv("\"");
+  for (size_t i = 0; i < s.length(); ++i) {
+    if (s[i] == '"') rv += '"';
+    rv += s[i];
+  }
+  return rv + '"';
+}
+
+void WritePssmAsn(const Pssm& pssm, FILE* fout) {
+  const size_t ncols = pssm.profile.length();
+  const size_t nrows = strlen(kNcbiStdAa);
+
+  fputs("PssmWithParameters ::= {\n", fout);
+  fputs("  pssm {\n", fout);
+  fputs("    isProtein TRUE,\n", fout);
+  fprintf(fout, "    numRows %zu,\n", nrows);
+  fprintf(fout, "    numColumns %zu,\n", ncols);
+  fputs("    byRow FALSE,\n", fout);
+  fputs("    query seq {\n", fout);
+  fputs("      id {\n        local str \"query\"\n      },\n", fout);
+  fprintf(fout, "      descr {\n        title %s\n      },\n",
+          AsnString(pssm.query.header()).c_str());
+  fputs("      inst {\n        repr raw,\n        mol aa,\n", fout);
+  fprintf(fout, "        length %zu,\n", pssm.query.length());
+  fprintf(fout, "        seq-data ncbieaa \"%s\"\n", pssm.query.ToString().c_str());
+  fputs("      }\n    },\n", fout);
+  fputs("    intermediateData {\n      freqRatios {\n", fout);
+  for (size_t i = 0; i < ncols; ++i) {
+    for (size_t r = 0; r < nrows; ++r) {
+      const char c = kNcbiStdAa[r];
+      long long mantissa = 0;
+      if (strchr("ACDEFGHIKLMNPQRSTVWY", c)) {  // ambiguous letters get no frequency
+        const size_t a = AA::kCharToInt[static_cast<int>(c)];
+        mantissa = llround(pssm.profile[i][a] * 1e8);
+      }
+      const bool last = i + 1 == ncols && r + 1 == nrows;
+      if (mantissa == 0)
+        fprintf(fout, "        { 0, 10, 0 }%s\n", last ? "" : ",");
+      else
+        fprintf(fout, "        { %lld, 10, -8 }%s\n", mantissa, last ? "" : ",");
+    }
+  }
+  fputs("      }\n    }\n  },\n", fout);
+  fputs("  params {\n    rpsdbparams {\n      matrixName \"BLOSUM62\"\n    }\n  }\n}\n", fout);
+}
+
+PsiBlastPlus::PsiBlastPlus(const Sequence<AA>* query,
+                           const Pssm* pssm,
+                           const CSBlastOptions& opts)
+    : query_(query), pssm_(pssm), opts_(opts), exec_path_(), emulate_(false) {}
+
+int PsiBlastPlus::Run(FILE* fout, BlastHits* hits) {
+  if (!pssm_) throw Exception("psiblast search needs a PSSM!");
+  int status = 0;
+  string basename, pssmfile, resultsfile;
+
+  try {
+    // Create unique basename for PSSM and results file
+    char name_template[] = "/tmp/csblast_XXXXXX";
+    const int fd = mkstemp(name_template);
+    if (fd < 0) throw Exception("Unable to create unique filename!");
+    close(fd);
+    basename    = name_template;
+    pssmfile    = basename + ".asn";
+    resultsfile = basename + ".tab";
+
+    FILE* fpssm = fopen(pssmfile.c_str(), "w");
+    if (!fpssm) throw Exception("Unable to write to file '%s'!", pssmfile.c_str());
+    WritePssmAsn(*pssm_, fpssm);
+    fclose(fpssm);
+
+    const string command(ComposeCommandString(pssmfile, resultsfile));
+    if (emulate_) {
+      fprintf(fout, "%s\n", command.c_str());
+    } else {
+      status = system(command.c_str());
+      FILE* fres = fopen(resultsfile.c_str(), "r");
+      if (!fres) throw Exception("Error executing '%s'", command.c_str());
+
+      // Copy report to output and parse hits from it
+      if (fout) {
+        char buffer[64 * KB];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), fres)) > 0) fwrite(buffer, 1, n, fout);
+        fflush(fout);
+      }
+      if (hits) {
+        rewind(fres);
+        hits->ReadTabular(fres);
+        if (hits->query_length() == 0) hits->set_query_length(pssm_->query.length());
+      }
+      fclose(fres);
+    }
+
+    // Cleanup temporary files
+    remove(basename.c_str());
+    remove(pssmfile.c_str());
+    remove(resultsfile.c_str());
+
+  } catch(const std::exception&) { // something went wrong => cleanup before rethrow
+    if (!basename.empty()) remove(basename.c_str());
+    if (!pssmfile.empty()) remove(pssmfile.c_str());
+    if (!resultsfile.empty()) remove(resultsfile.c_str());
+    throw;
+  }
+  return status;
+}
+
+string PsiBlastPlus::ComposeCommandString(string pssmfile, string resultsfile) const {
+  string rv(exec_path_ + kPsiBlastExec);
+  if (!emulate_ && !IsRegularFile(rv))
+    throw Exception("No psiblast binary in directory '%s'!", exec_path_.c_str());
+  rv += " -in_pssm '" + pssmfile + "' -out '" + resultsfile + "'";
+  rv += strprintf(" -outfmt '7 %s'", BlastHits::kTabularFields);
+
+  // Number of threads
+  CSBlastOptions::const_iterator it = opts_.find('a');
+  const long nthreads = it != opts_.end() ? atol(it->second.c_str()) :
+    sysconf(_SC_NPROCESSORS_ONLN);
+  rv += strprintf(" -num_threads %ld", MAX(1L, nthreads));
+
+  // Number of reported hits
+  int max_hits = 0;
+  if ((it = opts_.find('v')) != opts_.end()) max_hits = MAX(max_hits, atoi(it->second.c_str()));
+  if ((it = opts_.find('b')) != opts_.end()) max_hits = MAX(max_hits, atoi(it->second.c_str()));
+  if (max_hits > 0) rv += strprintf(" -max_target_seqs %d", max_hits);
+
+  // Low-complexity filter
+  if ((it = opts_.find('F')) != opts_.end())
+    rv += string(" -seg ") + (it->second == "F" ? "no" : "yes");
+
+  for (it = opts_.begin(); it != opts_.end(); ++it) {
+    const size_t n = sizeof(kOptionNames) / sizeof(kOptionNames[0]);
+    size_t k = 0;
+    while (k < n && kOptionNames[k].opt != it->first) ++k;
+    if (k < n) {
+      rv = rv + " " + kOptionNames[k].name + " '" + it->second + "'";
+    } else if (!strchr(kIgnoreOptions, it->first)) {
+      LOG(WARNING) << strprintf("Ignoring blastpgp option -%c for psiblast", it->first);
+    }
+  }
+  LOG(INFO) << rv;
+
+  return rv;
+}
+
+}  // namespace cs
@@ -0,0 +1,86 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_PSIBLAST_PLUS_H_
+#define CS_PSIBLAST_PLUS_H_
+
+#include "csblast.h"
+
+namespace cs {
+
+// Writes PSSM as ASN.1 text PssmWithParameters for psiblast -in_pssm. Despite
+// its name, the freqRatios field holds the target frequencies of the profile as
+// in the blastpgp checkpoint of Pssm::Write(); psiblast divides them by the
+// BLOSUM62 background frequencies itself when it computes its scores.
+void WritePssmAsn(const Pssm& pssm, FILE* fout);
+
+// Encapsulation of database searching with BLAST+ psiblast. The PSSM is handed
+// over with -in_pssm, the search runs on -num_threads cores and results are
+// read from tabular output. Understands the blastpgp options used by CS-BLAST
+// and translates them to their BLAST+ equivalents; -a sets the number of
+// threads (def=all cores).
+class PsiBlastPlus : public SearchEngine {
+ public:
+  PsiBlastPlus(const Sequence<AA>* query,
+               const Pssm* pssm,
+               const CSBlastOptions& opts);
+
+  virtual ~PsiBlastPlus() {}
+
+  // Runs one iteration of psiblast with cs-PSSM, writes its tabular report
+  // to 'fout' and returns found hits in BlastHits object.
+  virtual int Run(FILE* fout, BlastHits* hits = NULL);
+
+  // Sets path to psiblast executable.
+  void set_exec_path(std::string exec_path) {
+    exec_path_ = exec_path;
+    if (*exec_path.rbegin() != kDirSep) exec_path_ += kDirSep;
+  }
+
+  virtual void set_pssm(const Pssm* pssm) { pssm_ = pssm; }
+
+  virtual void set_options(const CSBlastOptions& opts) { opts_ = opts; }
+
+  // Sets BLAST call emulation
+  void set_emulate(bool emulate = true) { emulate_ = emulate; }
+
+ private:
+  // Name of psiblast executable
+  static const char* kPsiBlastExec;
+
+  std::string ComposeCommandString(std::string pssmfile, std::string resultsfile) const;
+
+  // Query sequence provided by constructor
+  const Sequence<AA>* query_;
+  // Position-specific scoring matrix
+  const Pssm* pssm_;
+  // Options map with blastpgp-style arguments
+  CSBlastOptions opts_;
+  // Path to psiblast executable
+  std::string exec_path_;
+  // Emulate BLAST call
+  bool emulate_;
+
+  DISALLOW_COPY_AND_ASSIGN(PsiBlastPlus);
+};  // class PsiBlastPlus
+
+}  // namespace cs
+
+#endif  // CS_PSIBLAST_PLUS_H_
@@ -0,0 +1,80 @@
+#include <gtest/gtest.h>
+
+#include "cs.h"
+#include "blast_hits.h"
+#include "blosum_matrix.h"
+#include "psiblast_plus.h"
+
+namespace cs {
+
+TEST(PsiBlastPlusTest, ReadTabular) {
+  FILE* fp = tmpfile();
+  fputs("# PSIBLAST 2.12.0+\n"
+        "# Query: query\n"
+        "# Fields: query length, subject id, subject title, evalue, bit score, score, "
+        "q. start, q. end, s. start, s. end, query seq, subject seq\n"
+        "# 3 hits found\n"
+        "120\tsp|P1|A\tfirst protein\t1e-50\t180.2\t455\t1\t60\t11\t71\tACDEF-GH\tACDEFKGH\n"
+        "120\tsp|P1|A\tfirst protein\t1e-05\t40.1\t95\t80\t90\t100\t110\tKLMN\tKIMN\n"
+        "120\tsp|P2|B\tN/A\t0.002\t30.0\t70\t5\t9\t1\t5\tWWYY\tWWYF\n"
+        "# BLAST processed 1 queries\n", fp);
+  rewind(fp);
+  BlastHits hits;
+  hits.ReadTabular(fp);
+  fclose(fp);
+
+  EXPECT_EQ(120u, hits.query_length());
+  ASSERT_EQ(2u, hits.size());
+  EXPECT_EQ("sp|P1|A first protein", hits[0].definition);
+  EXPECT_EQ("sp|P2|B", hits[1].definition);
+  EXPECT_DOUBLE_EQ(1e-50, hits[0].evalue);
+  EXPECT_DOUBLE_EQ(180.2, hits[0].bit_score);
+  ASSERT_EQ(2u, hits[0].hsps.size());
+  const BlastHsp& hsp = hits[0].hsps[0];
+  EXPECT_EQ(455, hsp.score);
+  EXPECT_EQ(1, hsp.query_start);
+  EXPECT_EQ(60, hsp.query_end);
+  EXPECT_EQ(11, hsp.subject_start);
+  EXPECT_EQ(71, hsp.subject_end);
+  EXPECT_EQ(8u, hsp.length);
+  EXPECT_EQ("ACDEF-GH", std::string(hsp.query_seq.begin(), hsp.query_seq.end()));
+  EXPECT_EQ("ACDEFKGH", std::string(hsp.subject_seq.begin(), hsp.subject_seq.end()));
+  EXPECT_EQ(80, hits[0].hsps[1].query_start);
+}
+
+TEST(PsiBlastPlusTest, WritePssmAsn) {
+  const Sequence<AA> query("MKV", "test \"query\"");
+  Profile<AA> prof(query.length(), 0.0);
+  BlosumMatrix sm;
+  for (size_t a = 0; a < AA::kSize; ++a) prof[0][a] = sm.p(a);
+  prof[1][AA::kCharToInt[static_cast<int>('K')]] = 1.0;
+  prof[2][AA::kCharToInt[static_cast<int>('V')]] = 1.0;
+  const Pssm pssm(query, prof);
+
+  FILE* fp = tmpfile();
+  WritePssmAsn(pssm, fp);
+  rewind(fp);
+  std::string asn;
+  char buffer[KB];
+  while (fgetline(buffer, KB, fp)) asn += std::string(buffer) + "\n";
+  fclose(fp);
+
+  EXPECT_NE(std::string::npos, asn.find("numRows 28,"));
+  EXPECT_NE(std::string::npos, asn.find("numColumns 3,"));
+  EXPECT_NE(std::string::npos, asn.find("title \"test \"\"query\"\"\""));
+  EXPECT_NE(std::string::npos, asn.find("seq-data ncbieaa \"MKV\""));
+  EXPECT_NE(std::string::npos, asn.find("matrixName \"BLOSUM62\""));
+
+  // Target frequencies are written as they are, not as ratios to the background
+  size_t ones = 0, pos = 0;
+  while ((pos = asn.find("{ 100000000, 10, -8 }", pos)) != std::string::npos) {
+    ++ones;
+    ++pos;
+  }
+  EXPECT_EQ(2u, ones);
+  const size_t a = AA::kCharToInt[static_cast<int>('A')];
+  EXPECT_NE(std::string::npos,
+            asn.find(strprintf("{ %lld, 10, -8 }", llround(sm.p(a) * 1e8))));
+}
+
+}  // namespace cs
@@ -32,8 +32,12 @@ struct Pssm {
   Pssm(const Sequence<AA>& seq, const Profile<AA>& prof)
       : query(seq), profile(prof) {}
 
+  // Same as above but takes over a temporary profile without copying it.
+  Pssm(const Sequence<AA>& seq, Profile<AA>&& prof)
+      : query(seq), profile(std::move(prof)) {}
+
   // Constructor to create a PSSM from a PSI-BLAST checkpoint file.
-  Pssm(FILE* fin);
+  explicit Pssm(FILE* fin) { Read(fin); }
 
   // Overwrites existing PSSM with PSSM from PSI-BLAST checkpoint.
   void Read(FILE* fin) {
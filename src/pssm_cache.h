@@ -0,0 +1,183 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_PSSM_CACHE_H_
+#define CS_PSSM_CACHE_H_
+
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "count_profile-inl.h"
+#include "sequence-inl.h"
+
+namespace cs {
+
+// Incremental 64-bit FNV-1a hash for building cache keys.
+class KeyHash {
+  public:
+    KeyHash() : h_(14695981039346656037ULL) {}
+
+    // Hashes 'n' bytes at 'data'.
+    KeyHash& Add(const void* data, size_t n) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < n; ++i) h_ = (h_ ^ p[i]) * 1099511628211ULL;
+        return *this;
+    }
+
+    // Hashes a string followed by a separator.
+    KeyHash& Add(const std::string& s) { return Add(s.data(), s.size()).Add("\n", 1); }
+
+    // Hashes the full contents of file 'path'.
+    KeyHash& AddFile(const std::string& path) {
+        FILE* fin = fopen(path.c_str(), "rb");
+        if (!fin) throw Exception("Unable to read file '%s'!", path.c_str());
+        char buffer[64 * KB];
+        size_t n;
+        while ((n = fread(buffer, 1, sizeof(buffer), fin)) > 0) Add(buffer, n);
+        fclose(fin);
+        return Add("\n", 1);
+    }
+
+    // Returns the hash as 16 hex digits.
+    std::string str() const { return strprintf("%016llx", static_cast<unsigned long long>(h_)); }
+
+  private:
+    uint64_t h_;
+};
+
+// On-disk cache of query profiles with context-specific pseudocounts. Entries
+// live in a directory shared by all runs and are addressed by a key that hashes
+// everything the profile depends on: the query or input alignment, the context
+// model file and the pseudocount parameters. Entries are exact binary dumps in
+// native byte order and are written to a private temporary file that is renamed
+// into place, so that concurrent processes can share a cache directory.
+template<class Abc>
+class PssmCache {
+  public:
+    // Uses directory 'dir' for cache entries and creates it if needed.
+    explicit PssmCache(const std::string& dir) : dir_(dir) {
+        if (mkdir(dir_.c_str(), 0777) != 0 && errno != EEXIST)
+            throw Exception("Unable to create cache directory '%s'!", dir_.c_str());
+    }
+
+    // Reads the entry with given key into query residues 'query' and 'profile'
+    // and returns true, or returns false if there is no valid entry.
+    bool Load(const std::string& key, Sequence<Abc>& query, CountProfile<Abc>& profile) const {
+        FILE* fin = fopen(Path(key).c_str(), "rb");
+        if (!fin) return false;
+        bool ok = true;
+        try {
+            std::string kind;
+            int version = 0;
+            size_t qlen = 0, len = 0, nalph = 0;
+            ReadBinary(fin, kind);
+            ReadBinary(fin, version);
+            ReadBinary(fin, nalph);
+            if (kind != kKind || version != kCheckpointVersion || nalph != Abc::kSizeAny)
+                throw Exception("Cache entry '%s' has an incompatible format!", Path(key).c_str());
+            ReadBinary(fin, profile.name);
+            ReadBinary(fin, qlen);
+            ReadBinary(fin, len);
+            query.Resize(qlen);
+            profile.counts.Resize(len);
+            profile.neff.Resize(len);
+            if (qlen > 0 && fread(&query[0], sizeof(query[0]), qlen, fin) != qlen)
+                throw Exception("Cache entry '%s' is truncated!", Path(key).c_str());
+            for (size_t i = 0; i < len; ++i)
+                if (fread(profile.counts[i], sizeof(double), Abc::kSizeAny, fin) != Abc::kSizeAny)
+                    throw Exception("Cache entry '%s' is truncated!", Path(key).c_str());
+            ReadBinary(fin, profile.neff);
+        } catch (const Exception& e) {
+            LOG(WARNING) << e.what();
+            ok = false;
+        }
+        fclose(fin);
+        return ok;
+    }
+
+    // Atomically stores 'query' and 'profile' under given key and returns true
+    // on success. A failed write only loses the cache entry: the temporary file
+    // is removed and a warning logged, so that the search can go on.
+    bool Store(const std::string& key, const Sequence<Abc>& query,
+               const CountProfile<Abc>& profile) const {
+        const std::string path = Path(key);
+        const std::string tmp = strprintf("%s.%d.tmp", path.c_str(), static_cast<int>(getpid()));
+        FILE* fout = fopen(tmp.c_str(), "wb");
+        if (!fout) {
+            LOG(WARNING) << strprintf("Can't write to file '%s'!", tmp.c_str());
+            return false;
+        }
+        bool ok = true;
+        try {
+            const size_t qlen = query.length(), len = profile.length();
+            WriteBinary(fout, std::string(kKind));
+            WriteBinary(fout, kCheckpointVersion);
+            WriteBinary(fout, Abc::kSizeAny);
+            WriteBinary(fout, profile.name);
+            WriteBinary(fout, qlen);
+            WriteBinary(fout, len);
+            if (qlen > 0 && fwrite(&query[0], sizeof(query[0]), qlen, fout) != qlen)
+                throw Exception("Failed to write cache entry '%s'!", tmp.c_str());
+            for (size_t i = 0; i < len; ++i)
+                if (fwrite(profile.counts[i], sizeof(double), Abc::kSizeAny, fout) != Abc::kSizeAny)
+                    throw Exception("Failed to write cache entry '%s'!", tmp.c_str());
+            WriteBinary(fout, profile.neff);
+            if (fflush(fout) != 0 || ferror(fout))
+                throw Exception("Failed to write cache entry '%s'!", tmp.c_str());
+        } catch (const Exception& e) {
+            LOG(WARNING) << e.what();
+            ok = false;
+        }
+        if (fclose(fout) != 0 && ok) {
+            LOG(WARNING) << strprintf("Failed to write cache entry '%s'!", tmp.c_str());
+            ok = false;
+        }
+        if (ok && rename(tmp.c_str(), path.c_str()) != 0) {
+            LOG(WARNING) << strprintf("Can't rename '%s' to '%s'!", tmp.c_str(), path.c_str());
+            ok = false;
+        }
+        if (!ok) remove(tmp.c_str());
+        return ok;
+    }
+
+    // Returns the path of the entry with given key.
+    std::string Path(const std::string& key) const {
+        std::string path = dir_;
+        if (!path.empty() && *path.rbegin() != kDirSep) path += kDirSep;
+        return path + key + ".pssm";
+    }
+
+  private:
+    static const char* const kKind;
+
+    const std::string dir_;
+
+    DISALLOW_COPY_AND_ASSIGN(PssmCache);
+};  // class PssmCache
+
+template<class Abc>
+const char* const PssmCache<Abc>::kKind = "PssmCache";
+
+}  // namespace cs
+
+#endif  // CS_PSSM_CACHE_H_
@@ -43,7 +43,7 @@ class RepeatPenalizer {
   // Maximal length of repeats that can be penalized.
   static const int kDelta = 100;
   // Minimal posterior probability for inclusion in abstract state profile.
-  static const float kMinPosterior = 0.02f;
+  static constexpr float kMinPosterior = 0.02f;
 
   // Baseline penalty to be applied to all profile columns.
   float alpha_;
@@ -0,0 +1,306 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_SEQUENCE_DB_H_
+#define CS_SEQUENCE_DB_H_
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sequence-inl.h"
+
+namespace cs {
+
+// Read-only sequence database in a pre-encoded binary format that is mapped
+// into memory, so that opening takes constant time regardless of database size
+// and searches stream residues without any parsing. Written by csformatdb.
+//
+// Layout (native byte order, sections aligned to 8 bytes):
+//   Header            magic, version, alphabet size, counts and section offsets
+//   residues          residue indices of all sequences, each followed by kEnd
+//   seq offsets       num_seqs + 1 uint64 start positions in 'residues'
+//   header offsets    num_seqs + 1 uint64 start positions in 'headers'
+//   order             num_seqs uint32 sequence indices by decreasing length
+//   headers           header strings without '>' and terminating zeros
+template<class Abc>
+class SequenceDb {
+  public:
+    // Residue value marking the end of each sequence.
+    static const uint8_t kEnd = 0xff;
+
+    // Maps database file 'path' into memory.
+    explicit SequenceDb(const std::string& path) : data_(NULL), size_(0), header_(NULL) {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw Exception("Unable to read file '%s'!", path.c_str());
+        Map(fd, path);
+        close(fd);
+    }
+
+    // Maps database written to open file 'fp' into memory.
+    explicit SequenceDb(FILE* fp) : data_(NULL), size_(0), header_(NULL) {
+        fflush(fp);
+        Map(fileno(fp), "<stream>");
+    }
+
+    ~SequenceDb() { if (data_) munmap(data_, size_); }
+
+    // Returns true if file 'path' starts with the database magic.
+    static bool IsDatabase(const std::string& path) {
+        char magic[sizeof(kMagic)] = { 0 };
+        FILE* fin = fopen(path.c_str(), "rb");
+        if (!fin) return false;
+        const bool ok = fread(magic, sizeof(magic), 1, fin) == 1 &&
+            memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+        fclose(fin);
+        return ok;
+    }
+
+    // Converts all sequences in FASTA file 'fin' to database written to the
+    // seekable stream 'fout' and returns the number of sequences. Residues are
+    // written as they are read, so that only the index tables are kept in memory.
+    static size_t Format(FILE* fin, FILE* fout);
+
+    // Returns the number of sequences.
+    size_t size() const { return header_->num_seqs; }
+
+    // Returns the total number of residues.
+    size_t num_residues() const { return header_->num_residues; }
+
+    // Returns the length of sequence 'k'.
+    size_t length(size_t k) const { return seq_offsets_[k + 1] - seq_offsets_[k] - 1; }
+
+    // Returns the residue indices of sequence 'k', terminated by kEnd.
+    const uint8_t* residues(size_t k) const { return residues_ + seq_offsets_[k]; }
+
+    // Returns the header of sequence 'k'.
+    std::string header(size_t k) const {
+        return std::string(headers_ + header_offsets_[k],
+                           header_offsets_[k + 1] - header_offsets_[k]);
+    }
+
+    // Returns the index of the sequence with the 'r'-th largest length.
+    size_t by_length(size_t r) const { return order_[r]; }
+
+    // Returns a copy of sequence 'k' with its header.
+    Sequence<Abc> GetSequence(size_t k) const {
+        Sequence<Abc> seq(length(k));
+        std::copy(residues(k), residues(k) + length(k), seq.begin());
+        seq.set_header(header(k));
+        return seq;
+    }
+
+  private:
+    static const char kMagic[8];
+    static const uint32_t kVersion = 1;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t alphabet_size;
+        uint64_t num_seqs;
+        uint64_t num_residues;
+        uint64_t residues_pos;
+        uint64_t seq_offsets_pos;
+        uint64_t header_offsets_pos;
+        uint64_t order_pos;
+        uint64_t headers_pos;
+        uint64_t file_size;
+    };
+
+    // Maps file descriptor 'fd' and sets up section pointers.
+    void Map(int fd, const std::string& name);
+
+    // Pads stream with zeros to the next multiple of 8 bytes and returns position.
+    static uint64_t Align(FILE* fout);
+
+    // Mapped file
+    void* data_;
+    // Size of mapped file
+    size_t size_;
+    // Section pointers into mapped file
+    const Header* header_;
+    const uint8_t* residues_;
+    const uint64_t* seq_offsets_;
+    const uint64_t* header_offsets_;
+    const uint32_t* order_;
+    const char* headers_;
+
+    template<class> friend class SequenceDbWriter;
+
+    DISALLOW_COPY_AND_ASSIGN(SequenceDb);
+};  // class SequenceDb
+
+
+// Writes a sequence database to a seekable stream one sequence at a time, for
+// databases whose sequences are not read from FASTA, e.g. translated ones.
+template<class Abc>
+class SequenceDbWriter {
+  public:
+    explicit SequenceDbWriter(FILE* fout);
+
+    ~SequenceDbWriter() { if (fhdr_) fclose(fhdr_); }
+
+    // Appends sequence 'seq' to the database.
+    void Add(const Sequence<Abc>& seq);
+
+    // Writes index tables and header and returns the number of sequences.
+    size_t Close();
+
+  private:
+    typedef typename SequenceDb<Abc>::Header Header;
+
+    // Output stream
+    FILE* fout_;
+    // Temporary file with headers
+    FILE* fhdr_;
+    // Header with section positions
+    Header h_;
+    // Start positions of sequences and headers
+    std::vector<uint64_t> seq_offsets_;
+    std::vector<uint64_t> header_offsets_;
+
+    DISALLOW_COPY_AND_ASSIGN(SequenceDbWriter);
+};  // class SequenceDbWriter
+
+template<class Abc>
+const uint8_t SequenceDb<Abc>::kEnd;
+
+template<class Abc>
+const char SequenceDb<Abc>::kMagic[8] = { 'C', 'S', 'S', 'E', 'Q', 'D', 'B', '\0' };
+
+template<class Abc>
+void SequenceDb<Abc>::Map(int fd, const std::string& name) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header))
+        throw Exception("File '%s' is not a sequence database!", name.c_str());
+    size_ = st.st_size;
+    data_ = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd, 0);
+    if (data_ == MAP_FAILED) {
+        data_ = NULL;
+        throw Exception("Unable to map file '%s' into memory!", name.c_str());
+    }
+
+    const char* base = static_cast<const char*>(data_);
+    header_ = reinterpret_cast<const Header*>(base);
+    std::string error;
+    if (memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0)
+        error = strprintf("File '%s' is not a sequence database!", name.c_str());
+    else if (header_->version != kVersion)
+        error = strprintf("Sequence database '%s' has version %u but expected %u!",
+                          name.c_str(), header_->version, kVersion);
+    else if (header_->alphabet_size != Abc::kSizeAny)
+        error = strprintf("Sequence database '%s' has wrong alphabet!", name.c_str());
+    else if (header_->file_size != size_)
+        error = strprintf("Sequence database '%s' is truncated!", name.c_str());
+    if (!error.empty()) {
+        munmap(data_, size_);
+        data_ = NULL;
+        throw Exception(error);
+    }
+
+    residues_ = reinterpret_cast<const uint8_t*>(base + header_->residues_pos);
+    seq_offsets_ = reinterpret_cast<const uint64_t*>(base + header_->seq_offsets_pos);
+    header_offsets_ = reinterpret_cast<const uint64_t*>(base + header_->header_offsets_pos);
+    order_ = reinterpret_cast<const uint32_t*>(base + header_->order_pos);
+    headers_ = base + header_->headers_pos;
+}
+
+template<class Abc>
+uint64_t SequenceDb<Abc>::Align(FILE* fout) {
+    static const char kZeros[8] = { 0 };
+    const long pos = ftell(fout);
+    if (pos % 8 != 0) fwrite(kZeros, 1, 8 - pos % 8, fout);
+    return ftell(fout);
+}
+
+template<class Abc>
+size_t SequenceDb<Abc>::Format(FILE* fin, FILE* fout) {
+    SequenceDbWriter<Abc> writer(fout);
+    for (int c = getc(fin); c != EOF; c = getc(fin)) {
+        ungetc(c, fin);
+        writer.Add(Sequence<Abc>(fin));
+    }
+    return writer.Close();
+}
+
+template<class Abc>
+SequenceDbWriter<Abc>::SequenceDbWriter(FILE* fout)
+        : fout_(fout), fhdr_(tmpfile()), seq_offsets_(1, 0), header_offsets_(1, 0) {
+    if (!fhdr_) throw Exception("Unable to create temporary file!");
+    memset(&h_, 0, sizeof(h_));
+    fwrite(&h_, sizeof(h_), 1, fout_);  // placeholder
+    h_.residues_pos = SequenceDb<Abc>::Align(fout_);
+}
+
+template<class Abc>
+void SequenceDbWriter<Abc>::Add(const Sequence<Abc>& seq) {
+    fwrite(seq.begin(), 1, seq.length(), fout_);
+    fputc(SequenceDb<Abc>::kEnd, fout_);
+    seq_offsets_.push_back(seq_offsets_.back() + seq.length() + 1);
+    fwrite(seq.header().data(), 1, seq.header().size(), fhdr_);
+    header_offsets_.push_back(header_offsets_.back() + seq.header().size());
+}
+
+template<class Abc>
+size_t SequenceDbWriter<Abc>::Close() {
+    const size_t n = seq_offsets_.size() - 1;
+    if (n > UINT32_MAX) throw Exception("Too many sequences for sequence database!");
+
+    // Order sequences by decreasing length
+    std::vector<uint32_t> order(n);
+    std::vector<std::pair<uint64_t, uint32_t> > lengths(n);
+    for (size_t k = 0; k < n; ++k)
+        lengths[k] = std::make_pair(~(seq_offsets_[k + 1] - seq_offsets_[k]), k);
+    std::sort(lengths.begin(), lengths.end());
+    for (size_t k = 0; k < n; ++k) order[k] = lengths[k].second;
+
+    h_.seq_offsets_pos = SequenceDb<Abc>::Align(fout_);
+    fwrite(&seq_offsets_[0], sizeof(uint64_t), n + 1, fout_);
+    h_.header_offsets_pos = SequenceDb<Abc>::Align(fout_);
+    fwrite(&header_offsets_[0], sizeof(uint64_t), n + 1, fout_);
+    h_.order_pos = SequenceDb<Abc>::Align(fout_);
+    if (n > 0) fwrite(&order[0], sizeof(uint32_t), n, fout_);
+    h_.headers_pos = SequenceDb<Abc>::Align(fout_);
+    rewind(fhdr_);
+    char buffer[64 * KB];
+    size_t nread;
+    while ((nread = fread(buffer, 1, sizeof(buffer), fhdr_)) > 0)
+        fwrite(buffer, 1, nread, fout_);
+    fclose(fhdr_);
+    fhdr_ = NULL;
+    h_.file_size = SequenceDb<Abc>::Align(fout_);
+
+    memcpy(h_.magic, SequenceDb<Abc>::kMagic, sizeof(SequenceDb<Abc>::kMagic));
+    h_.version = SequenceDb<Abc>::kVersion;
+    h_.alphabet_size = Abc::kSizeAny;
+    h_.num_seqs = n;
+    h_.num_residues = seq_offsets_.back() - n;
+    fseek(fout_, 0, SEEK_SET);
+    fwrite(&h_, sizeof(h_), 1, fout_);
+    fseek(fout_, 0, SEEK_END);
+    if (ferror(fout_)) throw Exception("Error while writing sequence database!");
+    return n;
+}
+
+}  // namespace cs
+
+#endif  // CS_SEQUENCE_DB_H_
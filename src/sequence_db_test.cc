@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+
+#include "cs.h"
+#include "sequence_db.h"
+
+namespace cs {
+
+TEST(SequenceDbTest, FormatAndMap) {
+  FILE* fasta = tmpfile();
+  fputs(">seq1 first\nACDEF\nGHIK\n>seq2\nLMNPQRSTVWYX\n>empty\n\n>seq4 last\nAAA\n", fasta);
+  rewind(fasta);
+  FILE* fdb = tmpfile();
+  EXPECT_EQ(4u, SequenceDb<AA>::Format(fasta, fdb));
+  fclose(fasta);
+  SequenceDb<AA> db(fdb);
+  fclose(fdb);
+
+  ASSERT_EQ(4u, db.size());
+  EXPECT_EQ(24u, db.num_residues());
+  EXPECT_EQ(9u, db.length(0));
+  EXPECT_EQ(12u, db.length(1));
+  EXPECT_EQ(0u, db.length(2));
+  EXPECT_EQ("seq1 first", db.header(0));
+  EXPECT_EQ("empty", db.header(2));
+  EXPECT_EQ("seq4 last", db.header(3));
+  EXPECT_EQ(AA::kCharToInt[static_cast<int>('L')], db.residues(1)[0]);
+  EXPECT_EQ(AA::kAny, db.residues(1)[11]);
+  EXPECT_EQ(SequenceDb<AA>::kEnd, db.residues(1)[12]);
+  EXPECT_EQ("ACDEFGHIK", db.GetSequence(0).ToString());
+  EXPECT_EQ("seq1 first", db.GetSequence(0).header());
+
+  // Longest first
+  EXPECT_EQ(1u, db.by_length(0));
+  EXPECT_EQ(0u, db.by_length(1));
+  EXPECT_EQ(3u, db.by_length(2));
+  EXPECT_EQ(2u, db.by_length(3));
+}
+
+TEST(SequenceDbTest, RejectsFasta) {
+  FILE* fp = tmpfile();
+  fputs(">seq1\nACDEF\n", fp);
+  EXPECT_THROW(SequenceDb<AA> db(fp), Exception);
+  fclose(fp);
+}
+
+}  // namespace cs
@@ -122,6 +122,94 @@ TYPED_TEST(SgdTestBlosum, DISABLED_PcPrior) {
   }
 }
 
+// Gaussian prior that disables the lazy prior and thus sparse SGD steps.
+template<class Abc>
+struct DenseGaussianPrior : public GaussianDerivCrfFuncPrior<Abc> {
+  bool ContextDecay(const Crf<Abc>& crf, const TrainingBlock& block,
+                    Vector<double>& fac) const {
+    return false;
+  }
+};
+
+TYPED_TEST(SgdTestBlosum, SparseStepsEqualDenseSteps) {
+  GaussianCrfInit<AA> init(0.1, this->m_);
+  Crf<AA> crf(this->kNumStates, this->kWindowLength, init);
+  GaussianDerivCrfFuncPrior<AA> sparse_prior;
+  DenseGaussianPrior<AA> dense_prior;
+  DerivCrfFunc<AA, TypeParam> sparse_func(this->trainset_, this->m_, sparse_prior);
+  DerivCrfFunc<AA, TypeParam> dense_func(this->trainset_, this->m_, dense_prior);
+  Sgd<AA, TypeParam> sparse_sgd(sparse_func, this->params_);
+  Sgd<AA, TypeParam> dense_sgd(dense_func, this->params_);
+  SgdState<AA> s1(crf);
+  SgdState<AA> s2(crf);
+
+  for (size_t r = 0; r < 2; ++r) {
+    sparse_sgd(s1);
+    dense_sgd(s2);
+    EXPECT_NEAR(s2.loglike, s1.loglike, 1e-6 * fabs(s2.loglike));
+  }
+  for (size_t k = 0; k < crf.size(); ++k) {
+    EXPECT_NEAR(s2.crf[k].bias_weight, s1.crf[k].bias_weight, kDelta);
+    for (size_t j = 0; j < crf.wlen(); ++j)
+      for (size_t a = 0; a < AA::kSize; ++a)
+        EXPECT_NEAR(s2.crf[k].context_weights[j][a], s1.crf[k].context_weights[j][a], kDelta);
+    for (size_t a = 0; a < AA::kSize; ++a)
+      EXPECT_NEAR(s2.crf[k].pc_weights[a], s1.crf[k].pc_weights[a], kDelta);
+  }
+}
+
+TYPED_TEST(SgdTestBlosum, ResumeFromCheckpoint) {
+  const std::string chkfile = PathCat(test_dir, "sgd_test.chk");
+  GaussianCrfInit<AA> init(0.1, this->m_);
+  Crf<AA> crf(this->kNumStates, this->kWindowLength, init);
+  GaussianDerivCrfFuncPrior<AA> prior;
+  DerivCrfFunc<AA, TypeParam> func(this->trainset_, this->m_, prior);
+  SgdParams params;
+  params.nblocks = 100;
+  params.min_epochs = 4;
+  params.max_epochs = 4;
+#ifdef OPENMP
+  // Log-likelihoods are reduced over threads in varying order, so that only a
+  // single thread reproduces the uninterrupted run bit for bit.
+  const int nthreads = omp_get_max_threads();
+  omp_set_num_threads(1);
+#endif
+
+  // Uninterrupted run
+  Crf<AA> crf1(crf);
+  SgdOptimizer<AA, TypeParam, TypeParam> opt1(func, func, params);
+  double loglike1 = opt1.Optimize(crf1);
+
+  // Run that is interrupted after two epochs and resumed from the checkpoint
+  Crf<AA> crf2(crf);
+  SgdParams params2(params);
+  params2.max_epochs = 2;
+  params2.min_epochs = 2;
+  SgdOptimizer<AA, TypeParam, TypeParam> opt2(func, func, params2);
+  opt2.checkpoint.file = chkfile;
+  opt2.Optimize(crf2);
+
+  Crf<AA> crf3(crf);
+  SgdOptimizer<AA, TypeParam, TypeParam> opt3(func, func, params);
+  opt3.checkpoint.file = chkfile;
+  opt3.checkpoint.resume = true;
+  double loglike3 = opt3.Optimize(crf3);
+  remove(chkfile.c_str());
+#ifdef OPENMP
+  omp_set_num_threads(nthreads);
+#endif
+
+  EXPECT_EQ(loglike1, loglike3);
+  for (size_t k = 0; k < crf.size(); ++k) {
+    EXPECT_EQ(crf1[k].bias_weight, crf3[k].bias_weight);
+    for (size_t j = 0; j < crf.wlen(); ++j)
+      for (size_t a = 0; a < AA::kSize; ++a)
+        EXPECT_EQ(crf1[k].context_weights[j][a], crf3[k].context_weights[j][a]);
+    for (size_t a = 0; a < AA::kSize; ++a)
+      EXPECT_EQ(crf1[k].pc_weights[a], crf3[k].pc_weights[a]);
+  }
+}
+
 class SgdTest : public testing::Test {
 
   virtual void SetUp() {
@@ -0,0 +1,422 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "cs.h"
+#include "sw_search.h"
+#include "blosum_matrix.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::string;
+using std::vector;
+
+namespace cs {
+
+// Ungapped lambda of BLOSUM62 in half-bit units. PSSM scores are scaled with it
+// as in blastpgp so that the BLOSUM62 gapped parameters apply.
+static const double kBlosum62Lambda = 0.3176;
+
+// Score of query padding positions in the striped profile.
+static const int16_t kPadScore = -16384;
+
+PssmScores::PssmScores(const Pssm& pssm)
+    : length_(pssm.profile.length()),
+      scores_(length_ * AA::kSizeAny, kAnyScore) {
+  BlosumMatrix sm;  // background frequencies
+  for (size_t i = 0; i < length_; ++i) {
+    for (size_t a = 0; a < AA::kSize; ++a) {
+      const double p = pssm.profile[i][a];
+      int s = p > 0.0 ? iround(log(p / sm.p(a)) / kBlosum62Lambda) : kMinScore;
+      scores_[i * AA::kSizeAny + a] = MAX(kMinScore, MIN(kMaxScore, s));
+    }
+  }
+}
+
+StripedProfile::StripedProfile(const PssmScores& scores)
+    : seglen_(MAX(static_cast<size_t>(1), (scores.length() + kLanes - 1) / kLanes)),
+      data_(AA::kSizeAny * seglen_ * kLanes, kPadScore) {
+  for (size_t a = 0; a < AA::kSizeAny; ++a)
+    for (size_t s = 0; s < seglen_; ++s)
+      for (size_t l = 0; l < kLanes; ++l) {
+        const size_t i = l * seglen_ + s;
+        if (i < scores.length())
+          data_[(a * seglen_ + s) * kLanes + l] = scores(i, a);
+      }
+}
+
+// Best local alignment score by the scalar Gotoh recursion in 32-bit integers.
+static int ScalarScore(const PssmScores& scores, const uint8_t* seq, size_t len,
+                       int gap_open, int gap_extend) {
+  const int goe = gap_open + gap_extend;
+  const size_t m = scores.length();
+  vector<int> h(m + 1, 0), e(m + 1, INT_MIN / 2);
+  int best = 0;
+  for (size_t j = 0; j < len; ++j) {
+    int hdiag = 0, hup = 0, f = INT_MIN / 2;
+    for (size_t i = 1; i <= m; ++i) {
+      e[i] = MAX(e[i] - gap_extend, h[i] - goe);
+      f = MAX(f - gap_extend, hup - goe);
+      const int hij = MAX(MAX(0, hdiag + scores(i - 1, seq[j])), MAX(e[i], f));
+      hdiag = h[i];
+      h[i] = hup = hij;
+      best = MAX(best, hij);
+    }
+  }
+  return best;
+}
+
+#ifdef __SSE2__
+// Best local alignment score by Farrar's striped recursion in saturated 16-bit
+// lanes, using lazy evaluation of vertical gaps.
+static int StripedScore(const StripedProfile& prof, const uint8_t* seq, size_t len,
+                        int gap_open, int gap_extend) {
+  static thread_local vector<uint8_t> buffer;
+  const size_t seglen = prof.seglen();
+  const __m128i vZero = _mm_setzero_si128();
+  const __m128i vMin = _mm_set1_epi16(-32768);
+  const __m128i vMinLane0 = _mm_insert_epi16(vZero, -32768, 0);
+  const __m128i vGapOE = _mm_set1_epi16(gap_open + gap_extend);
+  const __m128i vGapE = _mm_set1_epi16(gap_extend);
+
+  __m128i* hstore = reinterpret_cast<__m128i*>(
+      AlignedScratch(buffer, 3 * seglen * sizeof(__m128i)));
+  __m128i* hload = hstore + seglen;
+  __m128i* e = hload + seglen;
+  for (size_t s = 0; s < seglen; ++s) {
+    hstore[s] = vZero;
+    e[s] = vMin;
+  }
+
+  __m128i vMax = vZero;
+  for (size_t j = 0; j < len; ++j) {
+    const __m128i* vP = reinterpret_cast<const __m128i*>(prof.segments(seq[j]));
+    __m128i vF = vMin;
+    __m128i vH = _mm_slli_si128(hstore[seglen - 1], 2);
+    std::swap(hload, hstore);
+
+    for (size_t s = 0; s < seglen; ++s) {
+      vH = _mm_adds_epi16(vH, _mm_loadu_si128(vP + s));
+      vH = _mm_max_epi16(vH, e[s]);
+      vH = _mm_max_epi16(vH, vF);
+      vH = _mm_max_epi16(vH, vZero);
+      vMax = _mm_max_epi16(vMax, vH);
+      hstore[s] = vH;
+      vH = _mm_subs_epi16(vH, vGapOE);
+      e[s] = _mm_max_epi16(_mm_subs_epi16(e[s], vGapE), vH);
+      vF = _mm_max_epi16(_mm_subs_epi16(vF, vGapE), vH);
+      vH = hload[s];
+    }
+
+    // Propagate vertical gaps across segment boundaries until they can no
+    // longer improve any cell
+    size_t s = 0;
+    vF = _mm_or_si128(_mm_slli_si128(vF, 2), vMinLane0);
+    vH = hstore[0];
+    while (_mm_movemask_epi8(_mm_cmpgt_epi16(vF, _mm_subs_epi16(vH, vGapOE)))) {
+      vH = _mm_max_epi16(vH, vF);
+      hstore[s] = vH;
+      e[s] = _mm_max_epi16(e[s], _mm_subs_epi16(vH, vGapOE));
+      vF = _mm_subs_epi16(vF, vGapE);
+      if (++s >= seglen) {
+        s = 0;
+        vF = _mm_or_si128(_mm_slli_si128(vF, 2), vMinLane0);
+      }
+      vH = hstore[s];
+    }
+  }
+
+  int16_t lanes[StripedProfile::kLanes];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), vMax);
+  int best = 0;
+  for (size_t l = 0; l < StripedProfile::kLanes; ++l) best = MAX(best, static_cast<int>(lanes[l]));
+  return best;
+}
+#endif
+
+int SmithWatermanScore(const PssmScores& scores, const StripedProfile& prof,
+                       const uint8_t* seq, size_t len, int gap_open, int gap_extend) {
+#ifdef __SSE2__
+  const int score = StripedScore(prof, seq, len, gap_open, gap_extend);
+  if (score < 32767 - PssmScores::kMaxScore) return score;
+#endif
+  return ScalarScore(scores, seq, len, gap_open, gap_extend);
+}
+
+BlastHsp SmithWatermanAlign(const PssmScores& scores, const Sequence<AA>& query,
+                            const uint8_t* seq, size_t len, int gap_open, int gap_extend) {
+  // Traceback bits: source of H in the lowest two bits (0: start, 1: diagonal,
+  // 2: horizontal gap, 3: vertical gap), extension of E and F in bits 2 and 3.
+  const int goe = gap_open + gap_extend;
+  const size_t m = scores.length(), n = len;
+  vector<uint8_t> tb((m + 1) * (n + 1), 0);
+  vector<int> h(n + 1, 0), f(n + 1, INT_MIN / 2);
+  int best = 0;
+  size_t bi = 0, bj = 0;
+  for (size_t i = 1; i <= m; ++i) {
+    int hdiag = 0, hleft = 0, e = INT_MIN / 2;
+    for (size_t j = 1; j <= n; ++j) {
+      uint8_t t = 0;
+      if (e - gap_extend >= hleft - goe) { e -= gap_extend; t |= 4; } else { e = hleft - goe; }
+      if (f[j] - gap_extend >= h[j] - goe) { f[j] -= gap_extend; t |= 8; } else { f[j] = h[j] - goe; }
+      int hij = hdiag + scores(i - 1, seq[j - 1]);
+      t |= 1;
+      if (e > hij) { hij = e; t = (t & ~3) | 2; }
+      if (f[j] > hij) { hij = f[j]; t = (t & ~3) | 3; }
+      if (hij <= 0) { hij = 0; t &= ~3; }
+      tb[i * (n + 1) + j] = t;
+      hdiag = h[j];
+      h[j] = hleft = hij;
+      if (hij > best) { best = hij; bi = i; bj = j; }
+    }
+  }
+
+  // Trace back from the best cell
+  std::string qali, sali;
+  size_t i = bi, j = bj;
+  int state = 0;  // 0: H, 2: E, 3: F
+  while (i > 0 && j > 0) {
+    const uint8_t t = tb[i * (n + 1) + j];
+    if (state == 0) {
+      if ((t & 3) == 0) break;
+      if ((t & 3) == 1) {
+        qali += AA::kIntToChar[query[i - 1]];
+        sali += AA::kIntToChar[seq[j - 1]];
+        --i;
+        --j;
+      } else {
+        state = t & 3;
+      }
+    } else if (state == 2) {
+      qali += '-';
+      sali += AA::kIntToChar[seq[j - 1]];
+      state = (t & 4) ? 2 : 0;
+      --j;
+    } else {
+      qali += AA::kIntToChar[query[i - 1]];
+      sali += '-';
+      state = (t & 8) ? 3 : 0;
+      --i;
+    }
+  }
+
+  BlastHsp hsp;
+  hsp.query_start = i + 1;
+  hsp.query_end = bi;
+  hsp.subject_start = j + 1;
+  hsp.subject_end = bj;
+  hsp.query_seq.assign(qali.rbegin(), qali.rend());
+  hsp.subject_seq.assign(sali.rbegin(), sali.rend());
+  hsp.length = qali.length();
+  hsp.score = best;
+  return hsp;
+}
+
+SwSearch::SwSearch(const Sequence<AA>* query,
+                   const Pssm* pssm,
+                   const SequenceDb<AA>* db,
+                   const CSBlastOptions& opts)
+    : query_(query), pssm_(pssm), db_(db), opts_(opts), prefilter_(true), ka_cache_(NULL) {}
+
+double SwSearch::GetOption(char opt, double def) const {
+  CSBlastOptions::const_iterator it = opts_.find(opt);
+  return it == opts_.end() ? def : atof(it->second.c_str());
+}
+
+int SwSearch::Run(FILE* fout, BlastHits* hits) {
+  if (!pssm_) throw Exception("In-process search needs a PSSM!");
+  const PssmScores scores(*pssm_);
+  const StripedProfile prof(scores);
+  const int gap_open = static_cast<int>(GetOption('G', 11));
+  const int gap_extend = static_cast<int>(GetOption('E', 1));
+  const double evalue = GetOption('e', 10.0);
+  const size_t ndescr = static_cast<size_t>(GetOption('v', 500));
+  const size_t nalis = static_cast<size_t>(GetOption('b', 250));
+
+  // Statistics of this PSSM's scores against the background frequencies
+  BlosumMatrix sm;
+  vector<double> freqs(AA::kSize);
+  for (size_t a = 0; a < AA::kSize; ++a) freqs[a] = sm.p(a);
+  const ScoreProbabilities probs(PositionScoreProbabilities(scores, freqs));
+  KarlinAltschulParams ungapped = ka_cache_ ? ka_cache_->Ungapped(probs) : UngappedParams(probs);
+  if (ungapped.lambda <= 0.0) {
+    LOG(WARNING) << "PSSM scores are positive on average; E-values use BLOSUM62 statistics";
+    ungapped = Blosum62UngappedParams();
+  }
+  ka_ = ScaledGappedParams(ungapped, gap_open, gap_extend);
+  const KarlinAltschulParams& ka = ka_;
+  const double space = EffectiveSearchSpace(ka, scores.length(), db_->num_residues(), db_->size());
+  LOG(INFO) << strprintf("Ungapped lambda=%.4f K=%.4f H=%.4f, gapped lambda=%.4f K=%.4f",
+                         ungapped.lambda, ungapped.K, ungapped.H, ka.lambda, ka.K);
+
+  // Prefilter cutoffs with blastpgp defaults, bits converted to raw scores
+  const double threshold = GetOption('f', 0);
+  const double window = GetOption('A', 0);
+  const KmerPrefilter filter(scores,
+                             threshold > 0 ? iround(threshold) : 11,
+                             window > 0 ? iround(window) : 40,
+                             iround(GetOption('y', 7) * log(2.0) / ungapped.lambda),
+                             iround((GetOption('N', 22) * log(2.0) + log(ungapped.K)) /
+                                    ungapped.lambda));
+
+  // Score all database sequences passing the prefilter, longest first for load
+  // balancing
+  const int n = static_cast<int>(db_->size());
+  vector<int> raw(n, 0);
+  vector<uint8_t> stage(n, PREFILTER_PASSED);
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int r = 0; r < n; ++r) {
+    const size_t k = db_->by_length(r);
+    if (prefilter_) stage[k] = filter(db_->residues(k), db_->length(k));
+    if (stage[k] == PREFILTER_PASSED)
+      raw[k] = SmithWatermanScore(scores, prof, db_->residues(k), db_->length(k),
+                                  gap_open, gap_extend);
+  }
+  stats_ = PrefilterStats();
+  for (int k = 0; k < n; ++k) stats_.Add(static_cast<PrefilterStage>(stage[k]));
+  LOG(INFO) << strprintf("Prefilter: %zu of %zu sequences with word hits, %zu with two hits, "
+                         "%zu passed", stats_.num_word_hits, stats_.num_seqs,
+                         stats_.num_two_hits, stats_.num_passed);
+
+  // Collect significant hits sorted by decreasing score. Sequences rejected by
+  // the prefilter or without a positive score must not pass a generous E-value
+  // cutoff.
+  vector<std::pair<int, int> > ranked;
+  for (int k = 0; k < n; ++k)
+    if (stage[k] == PREFILTER_PASSED && raw[k] > 0 &&
+        ka.K * space * exp(-ka.lambda * raw[k]) <= evalue)
+      ranked.push_back(std::make_pair(-raw[k], k));
+  std::sort(ranked.begin(), ranked.end());
+  if (ranked.size() > MAX(ndescr, nalis)) ranked.resize(MAX(ndescr, nalis));
+
+  // Align hits
+  BlastHits found;
+  found.set_query_length(scores.length());
+  vector<BlastHit> aligned(ranked.size());
+  const int nhits = static_cast<int>(ranked.size());
+#pragma omp parallel for schedule(dynamic, 1)
+  for (int r = 0; r < nhits; ++r) {
+    const size_t k = ranked[r].second;
+    BlastHsp hsp = SmithWatermanAlign(scores, pssm_->query, db_->residues(k),
+                                      db_->length(k), gap_open, gap_extend);
+    hsp.bit_score = (ka.lambda * hsp.score - log(ka.K)) / log(2.0);
+    hsp.evalue = ka.K * space * exp(-ka.lambda * hsp.score);
+    BlastHit& hit = aligned[r];
+    hit.oid = k + 1;
+    hit.definition = db_->header(k);
+    hit.bit_score = hsp.bit_score;
+    hit.evalue = hsp.evalue;
+    hit.hsps.push_back(hsp);
+  }
+  for (size_t r = 0; r < aligned.size(); ++r) found.push_back(aligned[r]);
+
+  if (fout) WriteReport(fout, found, ndescr, nalis);
+  if (hits) *hits = found;
+  return 0;
+}
+
+// Returns 'count' in percent of 'total', or zero for an empty alignment.
+static size_t Percent(size_t count, size_t total) {
+  return total > 0 ? 100 * count / total : 0;
+}
+
+string FormatEvalue(double evalue) {
+  if (evalue < 1e-180) return "0.0";
+  if (evalue < 1e-3) return strprintf("%.0e", evalue);
+  return strprintf("%.2g", evalue);
+}
+
+void SwSearch::WriteReport(FILE* fout, const BlastHits& hits, size_t ndescr,
+                           size_t nalis) const {
+  static const size_t kLineWidth = 60;
+  const Sequence<AA>& query = pssm_->query;
+
+  fputs("CS-BLAST in-process Smith-Waterman search\n\n", fout);
+  fprintf(fout, "Query= %s\n", query_ ? query_->header().c_str() : "");
+  fprintf(fout, "         (%zu letters)\n\n", query.length());
+  fprintf(fout, "Database: %zu sequences; %zu total letters\n\n", db_->size(),
+          db_->num_residues());
+  if (prefilter_)
+    fprintf(fout, "Prefilter: %zu with word hits, %zu with two hits, %zu aligned\n\n",
+            stats_.num_word_hits, stats_.num_two_hits, stats_.num_passed);
+  fprintf(fout, "Lambda     K      H\n  %6.3f %8.4f %8.3f\n\n", ka_.lambda, ka_.K, ka_.H);
+  if (hits.empty()) {
+    fputs(" ***** No hits found ******\n\n", fout);
+    return;
+  }
+
+  fputs("Sequences producing significant alignments:                      (bits) Value\n\n", fout);
+  for (size_t k = 0; k < hits.size() && k < ndescr; ++k)
+    fprintf(fout, "%-66.66s %5.0f   %s\n", hits[k].definition.c_str(),
+            hits[k].bit_score, FormatEvalue(hits[k].evalue).c_str());
+  fputs("\n", fout);
+
+  const PssmScores scores(*pssm_);
+  for (size_t k = 0; k < hits.size() && k < nalis; ++k) {
+    const BlastHit& hit = hits[k];
+    const BlastHsp& hsp = hit.hsps[0];
+    size_t ident = 0, pos = 0, gaps = 0;
+    string mid;
+    for (size_t c = 0, i = hsp.query_start - 1; c < hsp.length; ++c) {
+      const char qc = hsp.query_seq[c], sc = hsp.subject_seq[c];
+      if (qc == '-' || sc == '-') {
+        ++gaps;
+        mid += ' ';
+      } else if (qc == sc) {
+        ++ident;
+        ++pos;
+        mid += qc;
+      } else if (scores(i, AA::kCharToInt[static_cast<int>(sc)]) > 0) {
+        ++pos;
+        mid += '+';
+      } else {
+        mid += ' ';
+      }
+      if (qc != '-') ++i;
+    }
+
+    fprintf(fout, ">%s\n          Length = %zu\n\n", hit.definition.c_str(),
+            db_->length(hit.oid - 1));
+    fprintf(fout, " Score = %.1f bits (%d), Expect = %s\n",
+            hsp.bit_score, hsp.score, FormatEvalue(hsp.evalue).c_str());
+    fprintf(fout, " Identities = %zu/%zu (%zu%%), Positives = %zu/%zu (%zu%%)",
+            ident, hsp.length, Percent(ident, hsp.length), pos, hsp.length,
+            Percent(pos, hsp.length));
+    if (gaps > 0)
+      fprintf(fout, ", Gaps = %zu/%zu (%zu%%)", gaps, hsp.length, Percent(gaps, hsp.length));
+    fputs("\n\n", fout);
+
+    int qpos = hsp.query_start, spos = hsp.subject_start;
+    for (size_t c = 0; c < hsp.length; c += kLineWidth) {
+      const size_t w = MIN(kLineWidth, hsp.length - c);
+      const string qs(hsp.query_seq.begin() + c, hsp.query_seq.begin() + c + w);
+      const string ss(hsp.subject_seq.begin() + c, hsp.subject_seq.begin() + c + w);
+      const int qn = w - std::count(qs.begin(), qs.end(), '-');
+      const int sn = w - std::count(ss.begin(), ss.end(), '-');
+      fprintf(fout, "Query: %-5d %s %d\n", qpos, qs.c_str(), qpos + qn - 1);
+      fprintf(fout, "             %s\n", mid.substr(c, w).c_str());
+      fprintf(fout, "Sbjct: %-5d %s %d\n\n", spos, ss.c_str(), spos + sn - 1);
+      qpos += qn;
+      spos += sn;
+    }
+  }
+}
+
+}  // namespace cs
@@ -0,0 +1,164 @@
+/*
+  Copyright 2009-2012 Andreas Biegert, Christof Angermueller
+
+  This file is part of the CS-BLAST package.
+
+  The CS-BLAST package is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  The CS-BLAST package is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CS_SW_SEARCH_H_
+#define CS_SW_SEARCH_H_
+
+#include "csblast.h"
+#include "karlin_altschul.h"
+#include "kmer_prefilter.h"
+#include "sequence_db.h"
+
+namespace cs {
+
+// Formats an E-value the way BLAST prints it.
+std::string FormatEvalue(double evalue);
+
+// Integer position-specific scores of a PSSM in half-bit units, one row of
+// Abc::kSizeAny scores per query position.
+class PssmScores {
+ public:
+  // Score of a database residue 'X' in all query positions.
+  static const int kAnyScore = -1;
+  // Range of scores; letters with zero probability get the minimal score.
+  static const int kMinScore = -64;
+  static const int kMaxScore = 64;
+
+  explicit PssmScores(const Pssm& pssm);
+
+  // Returns the score of database letter 'a' at query position 'i'.
+  int operator() (size_t i, size_t a) const { return scores_[i * AA::kSizeAny + a]; }
+
+  // Returns the number of query positions.
+  size_t length() const { return length_; }
+
+ private:
+  size_t length_;
+  std::vector<int> scores_;
+};
+
+// Query profile of a PSSM striped for 8-lane SIMD Smith-Waterman (Farrar
+// 2007). Query position i is stored in segment i % seglen at lane i / seglen.
+class StripedProfile {
+ public:
+  static const size_t kLanes = 8;
+
+  explicit StripedProfile(const PssmScores& scores);
+
+  // Returns pointer to the 'seglen' segments of letter 'a'.
+  const int16_t* segments(size_t a) const { return &data_[a * seglen_ * kLanes]; }
+
+  // Returns the number of segments.
+  size_t seglen() const { return seglen_; }
+
+ private:
+  size_t seglen_;
+  std::vector<int16_t> data_;
+};
+
+// Resizes 'buffer' to hold 'n' bytes from a 16-byte aligned address and returns
+// that address, so that SIMD kernels can keep their scratch rows in a reusable
+// byte vector.
+inline uint8_t* AlignedScratch(std::vector<uint8_t>& buffer, size_t n) {
+  const size_t kAlign = 16;
+  buffer.resize(n + kAlign - 1);
+  const size_t offset = reinterpret_cast<uintptr_t>(&buffer[0]) % kAlign;
+  return &buffer[0] + (offset > 0 ? kAlign - offset : 0);
+}
+
+// Returns the best local alignment score of the PSSM against the 'len' residues
+// at 'seq' with gap costs 'gap_open' + k * 'gap_extend', computed by the striped
+// SIMD kernel if available and by the scalar recursion if the 16-bit scores
+// would saturate.
+int SmithWatermanScore(const PssmScores& scores, const StripedProfile& prof,
+                       const uint8_t* seq, size_t len, int gap_open, int gap_extend);
+
+// Returns the best local alignment of the PSSM of 'query' against the 'len'
+// residues at 'seq' as a BLAST HSP with raw score but without statistics.
+BlastHsp SmithWatermanAlign(const PssmScores& scores, const Sequence<AA>& query,
+                            const uint8_t* seq, size_t len, int gap_open, int gap_extend);
+
+// In-process database search of a PSSM against a memory-mapped sequence
+// database, scoring every sequence with striped Smith-Waterman on all cores.
+// Understands the blastpgp options -e (E-value threshold), -v and -b (number
+// of descriptions and alignments), and -G and -E (gap costs). Unless disabled,
+// a k-mer prefilter selects the sequences to align, controlled by -f (word
+// threshold), -A (two-hit window), -y (ungapped X-drop in bits) and -N (bits
+// to trigger gapped alignment). E-values use Karlin-Altschul parameters
+// computed for each PSSM against the BLOSUM62 background frequencies.
+class SwSearch : public SearchEngine {
+ public:
+  SwSearch(const Sequence<AA>* query,
+           const Pssm* pssm,
+           const SequenceDb<AA>* db,
+           const CSBlastOptions& opts);
+
+  virtual ~SwSearch() {}
+
+  // Searches the database with the current PSSM, writes a report in BLAST
+  // pairwise format and returns found hits in BlastHits object.
+  virtual int Run(FILE* fout, BlastHits* hits = NULL);
+
+  virtual void set_pssm(const Pssm* pssm) { pssm_ = pssm; }
+
+  virtual void set_options(const CSBlastOptions& opts) { opts_ = opts; }
+
+  // Enables or disables the k-mer prefilter.
+  void set_prefilter(bool prefilter) { prefilter_ = prefilter; }
+
+  // Returns prefilter statistics of the last search.
+  const PrefilterStats& prefilter_stats() const { return stats_; }
+
+  // Shares ungapped statistics between searches through 'cache' if not NULL.
+  void set_statistics_cache(KarlinAltschulCache* cache) { ka_cache_ = cache; }
+
+  // Returns the gapped Karlin-Altschul parameters of the last search.
+  const KarlinAltschulParams& statistics() const { return ka_; }
+
+ private:
+  // Returns value of option 'opt' or 'def' if not given.
+  double GetOption(char opt, double def) const;
+
+  // Writes hits in BLAST pairwise format.
+  void WriteReport(FILE* fout, const BlastHits& hits, size_t ndescr, size_t nalis) const;
+
+  // Query sequence provided by constructor
+  const Sequence<AA>* query_;
+  // Position-specific scoring matrix
+  const Pssm* pssm_;
+  // Sequence database
+  const SequenceDb<AA>* db_;
+  // Options map with blastpgp-style arguments
+  CSBlastOptions opts_;
+  // Use k-mer prefilter before gapped alignment
+  bool prefilter_;
+  // Prefilter statistics of last search
+  PrefilterStats stats_;
+  // Optional cache of ungapped statistics
+  KarlinAltschulCache* ka_cache_;
+  // Gapped statistics of last search
+  KarlinAltschulParams ka_;
+
+  DISALLOW_COPY_AND_ASSIGN(SwSearch);
+};  // class SwSearch
+
+}  // namespace cs
+
+#endif  // CS_SW_SEARCH_H_
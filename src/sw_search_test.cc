@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+
+#include "cs.h"
+#include "blast_hits.h"
+#include "sequence-inl.h"
+#include "sw_search.h"
+
+namespace cs {
+
+// Returns a random protein sequence of given length.
+Sequence<AA> RandomSequence(size_t len, unsigned int* seed, const std::string& header = "") {
+  std::string s;
+  for (size_t i = 0; i < len; ++i)
+    s += AA::kIntToChar[rand_r(seed) % AA::kSize];
+  return Sequence<AA>(s, header);
+}
+
+// Returns a PSSM with profile concentrated on the residues of 'seq'.
+Pssm MakePssm(const Sequence<AA>& seq) {
+  Profile<AA> prof(seq.length(), 0.02 / (AA::kSize - 1));
+  for (size_t i = 0; i < seq.length(); ++i) prof[i][seq[i]] = 0.98;
+  return Pssm(seq, prof);
+}
+
+TEST(SwSearchTest, StripedScoreEqualsAlignmentScore) {
+  unsigned int seed = 42;
+  const Sequence<AA> query(RandomSequence(97, &seed));
+  const Pssm pssm(MakePssm(query));
+  const PssmScores scores(pssm);
+  const StripedProfile prof(scores);
+
+  for (int k = 0; k < 50; ++k) {
+    // Embed a mutated piece of the query with an insertion into random sequence
+    std::string s = RandomSequence(20 + k, &seed).ToString();
+    std::string q = query.ToString().substr(k % 40, 50);
+    for (size_t i = 0; i < q.length(); i += 4) q[i] = AA::kIntToChar[rand_r(&seed) % AA::kSize];
+    q.insert(25, "GGG");
+    const Sequence<AA> seq(s + q + RandomSequence(k, &seed).ToString());
+
+    const int score = SmithWatermanScore(scores, prof, seq.begin(), seq.length(), 11, 1);
+    const BlastHsp hsp = SmithWatermanAlign(scores, query, seq.begin(), seq.length(), 11, 1);
+    EXPECT_EQ(hsp.score, score);
+    EXPECT_GT(score, 0);
+    EXPECT_EQ(hsp.query_seq.size(), hsp.length);
+    EXPECT_EQ(hsp.subject_seq.size(), hsp.length);
+  }
+}
+
+TEST(SwSearchTest, PrefilterPassesHomologsOnly) {
+  unsigned int seed = 3;
+  const Sequence<AA> query(RandomSequence(150, &seed));
+  const Pssm pssm(MakePssm(query));
+  const PssmScores scores(pssm);
+  const KmerPrefilter filter(scores, 11, 40, 15, 41);
+  EXPECT_GT(filter.num_entries(), 0u);
+
+  // Homolog with every fifth residue mutated
+  std::string h = query.ToString();
+  for (size_t i = 0; i < h.length(); i += 5) h[i] = AA::kIntToChar[rand_r(&seed) % AA::kSize];
+  const Sequence<AA> homolog(RandomSequence(40, &seed).ToString() + h);
+  EXPECT_EQ(PREFILTER_PASSED, filter(homolog.begin(), homolog.length()));
+  EXPECT_EQ(PREFILTER_PASSED, filter(homolog.begin(), homolog.length()));
+
+  PrefilterStats stats;
+  for (int k = 0; k < 200; ++k) {
+    const Sequence<AA> seq(RandomSequence(300, &seed));
+    stats.Add(filter(seq.begin(), seq.length()));
+  }
+  EXPECT_EQ(200u, stats.num_seqs);
+  EXPECT_LT(stats.num_passed, 10u);
+  EXPECT_LE(stats.num_two_hits, stats.num_word_hits);
+  EXPECT_LE(stats.num_passed, stats.num_two_hits);
+
+  // Short sequences and unknown residues produce no word hits
+  const Sequence<AA> xs("XXXXXXXXXX");
+  EXPECT_EQ(PREFILTER_NO_WORD_HIT, filter(xs.begin(), xs.length()));
+  EXPECT_EQ(PREFILTER_NO_WORD_HIT, filter(homolog.begin(), 2));
+}
+
+TEST(SwSearchTest, ReportParsesBack) {
+  unsigned int seed = 7;
+  const Sequence<AA> query(RandomSequence(120, &seed, "query"));
+  const Pssm pssm(MakePssm(query));
+  FILE* fasta = tmpfile();
+  for (int k = 0; k < 100; ++k)
+    RandomSequence(150, &seed, strprintf("rand%d", k)).Write(fasta);
+  Sequence<AA>(RandomSequence(30, &seed).ToString() + query.ToString(),
+               "homolog").Write(fasta);
+  rewind(fasta);
+  FILE* fdb = tmpfile();
+  SequenceDb<AA>::Format(fasta, fdb);
+  fclose(fasta);
+  const SequenceDb<AA> db(fdb);
+  fclose(fdb);
+
+  CSBlastOptions opts;
+  opts['e'] = "1e-3";
+  SwSearch search(&query, &pssm, &db, opts);
+  FILE* fp = tmpfile();
+  BlastHits hits;
+  EXPECT_EQ(0, search.Run(fp, &hits));
+  ASSERT_EQ(1u, hits.size());
+  EXPECT_EQ("homolog", hits[0].definition);
+  EXPECT_EQ(31, hits[0].hsps[0].subject_start);
+  EXPECT_LT(hits[0].evalue, 1e-50);
+
+  rewind(fp);
+  BlastHits parsed(fp);
+  fclose(fp);
+  ASSERT_EQ(1u, parsed.size());
+  ASSERT_EQ(1u, parsed[0].hsps.size());
+  EXPECT_TRUE(hits[0].hsps[0].query_seq == parsed[0].hsps[0].query_seq);
+  EXPECT_TRUE(hits[0].hsps[0].subject_seq == parsed[0].hsps[0].subject_seq);
+  EXPECT_EQ(hits[0].hsps[0].subject_start, parsed[0].hsps[0].subject_start);
+}
+
+TEST(SwSearchTest, GenerousEvalueSkipsUnscoredSequences) {
+  unsigned int seed = 5;
+  const Sequence<AA> query(RandomSequence(60, &seed, "query"));
+  const Pssm pssm(MakePssm(query));
+  FILE* fasta = tmpfile();
+  Sequence<AA>(query.ToString(), "self").Write(fasta);
+  Sequence<AA>("WWWWWWWWWWWWWWWWWWWW", "rejected").Write(fasta);
+  Sequence<AA>("XXXXXXXXXX", "unknown").Write(fasta);
+  rewind(fasta);
+  FILE* fdb = tmpfile();
+  SequenceDb<AA>::Format(fasta, fdb);
+  fclose(fasta);
+  const SequenceDb<AA> db(fdb);
+  fclose(fdb);
+
+  // Sequences rejected by the prefilter have no score and are not reported
+  CSBlastOptions opts;
+  opts['e'] = "1e5";
+  SwSearch search(&query, &pssm, &db, opts);
+  FILE* fp = tmpfile();
+  BlastHits hits;
+  EXPECT_EQ(0, search.Run(fp, &hits));
+  fclose(fp);
+  ASSERT_EQ(1u, hits.size());
+  EXPECT_EQ("self", hits[0].definition);
+  EXPECT_GT(hits[0].hsps[0].length, 0u);
+}
+
+}  // namespace cs
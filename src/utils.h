@@ -322,6 +322,19 @@ inline void Assign(double* array, size_t length, double value) {
   for (size_t i = 0; i < length; ++i) array[i] = value;
 }
 
+// Allocates a zero-initialized array of 'length' doubles whose first element is
+// aligned to 'align' bytes. The array must be released with AlignedFree().
+inline double* AlignedAlloc(size_t length, size_t align = 32) {
+  void* p = NULL;
+  if (posix_memalign(&p, align, MAX(length, static_cast<size_t>(1)) * sizeof(double)))
+    throw std::bad_alloc();
+  Reset(static_cast<double*>(p), length);
+  return static_cast<double*>(p);
+}
+
+// Releases an array allocated with AlignedAlloc().
+inline void AlignedFree(double* array) { free(array); }
+
 // Gets a good random seed from /dev/random
 inline unsigned int GetRandomSeed() {
  unsigned int seed;
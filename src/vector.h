@@ -30,9 +30,11 @@ class Vector {
   Vector(size_t n, const T &a);
   Vector(size_t n, const T *a);
   Vector(const Vector &rhs);
+  Vector(Vector &&rhs) noexcept;
   ~Vector();
 
   Vector & operator=(const Vector &rhs);
+  Vector & operator=(Vector &&rhs) noexcept;
 
   inline T & operator[](const size_t i);
   inline const T & operator[](const size_t i) const;
@@ -40,6 +42,8 @@ class Vector {
   void Resize(size_t newn);
   void Assign(size_t newn, const T &a);
   inline void Assign(const T &a);
+  // Exchanges contents with 'other' without copying any elements.
+  void Swap(Vector &other) noexcept;
 
  private:
   size_t nn;
@@ -68,6 +72,27 @@ Vector<T>::Vector(const Vector<T> &rhs) : nn(rhs.nn), v(nn>0 ? new T[nn] : NULL)
   for(size_t i=0; i<nn; i++) v[i] = rhs[i];
 }
 
+template <class T>
+Vector<T>::Vector(Vector<T> &&rhs) noexcept : nn(rhs.nn), v(rhs.v) {
+  rhs.nn = 0;
+  rhs.v = NULL;
+}
+
+template <class T>
+Vector<T> & Vector<T>::operator=(Vector<T> &&rhs) noexcept {
+  Swap(rhs);
+  return *this;
+}
+
+template <class T>
+void Vector<T>::Swap(Vector<T> &other) noexcept {
+  std::swap(nn, other.nn);
+  std::swap(v, other.v);
+}
+
+template <class T>
+inline void swap(Vector<T> &a, Vector<T> &b) { a.Swap(b); }
+
 template <class T>
 Vector<T> & Vector<T>::operator=(const Vector<T> &rhs) {
   if (this != &rhs) {